@@ -0,0 +1,114 @@
+// Startup cost of getting a runnable yt-dlp on disk, median of N runs (default 5):
+//   raw write - what every YtDLP() used to do, the whole uncompressed binary written with ofstream
+//   cold      - YtDLP() into an empty cache directory (streaming decompression when YT_DLP_COMPRESSED, atomic rename)
+//   warm      - YtDLP() with the binary already extracted (stat only)
+//
+// usage: spotify_dlp_extract_benchmark [runs]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../src/dlp/youtube/yt-dlp.h"
+#include "../src/dlp/youtube/data/yt-dlp-data.h"
+
+#ifdef YT_DLP_COMPRESSED
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    vector<unsigned char> raw_binary()
+    {
+#ifdef YT_DLP_COMPRESSED
+        // the packer always records the content size, anything else means the embedded frame is broken
+        unsigned long long size = ZSTD_getFrameContentSize(YtDLPData::yt_dlp_zstd, YtDLPData::yt_dlp_zstd_size);
+        if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN)
+        {
+            fprintf(stderr, "embedded yt-dlp is not a zstd frame with a known content size\n");
+            exit(EXIT_FAILURE);
+        }
+        vector<unsigned char> raw(static_cast<size_t>(size));
+        size_t decompressed = ZSTD_decompress(raw.data(), raw.size(), YtDLPData::yt_dlp_zstd, YtDLPData::yt_dlp_zstd_size);
+        if (ZSTD_isError(decompressed) || decompressed != raw.size())
+        {
+            fprintf(stderr, "failed to decompress the embedded yt-dlp: %s\n",
+                    ZSTD_isError(decompressed) ? ZSTD_getErrorName(decompressed) : "size mismatch");
+            exit(EXIT_FAILURE);
+        }
+        return raw;
+#elif defined(_WIN32)
+        return vector<unsigned char>(YtDLPData::yt_dlp_windows, YtDLPData::yt_dlp_windows + YtDLPData::yt_dlp_windows_size);
+#else
+        return vector<unsigned char>(YtDLPData::yt_dlp_linux, YtDLPData::yt_dlp_linux + YtDLPData::yt_dlp_linux_size);
+#endif
+    }
+
+    double median_ms(int runs, const function<void(int run)> &setup, const function<void()> &body)
+    {
+        vector<double> samples;
+        for (int run = 0; run < runs; run++)
+        {
+            setup(run);
+            auto start = chrono::steady_clock::now();
+            body();
+            samples.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        }
+        sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    void set_cache_home(const filesystem::path &dir)
+    {
+#ifdef _WIN32
+        _putenv_s("LOCALAPPDATA", dir.string().c_str());
+#else
+        setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+#endif
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? max(atoi(argv[1]), 1) : 5;
+    filesystem::path root = filesystem::temp_directory_path() / "spotify_dlp_extract_benchmark";
+    filesystem::remove_all(root);
+    filesystem::create_directories(root);
+
+    vector<unsigned char> raw = raw_binary();
+    printf("yt-dlp: %zu bytes", raw.size());
+#ifdef YT_DLP_COMPRESSED
+    printf(", embedded as %zu bytes of zstd", YtDLPData::yt_dlp_zstd_size);
+#endif
+    printf("\n");
+
+    double raw_write = median_ms(
+        runs, [&](int) { filesystem::remove(root / "raw"); },
+        [&]
+        {
+            ofstream out(root / "raw", ios::binary);
+            out.write(reinterpret_cast<const char *>(raw.data()), static_cast<streamsize>(raw.size()));
+        });
+
+    double cold = median_ms(
+        runs, [&](int run) { set_cache_home(root / ("cold" + to_string(run))); },
+        [] { YtDLP dlp; });
+
+    double warm = median_ms(
+        runs, [&](int) { set_cache_home(root / "cold0"); },
+        [] { YtDLP dlp; });
+
+    printf("raw write: %10.2f ms\n", raw_write);
+    printf("cold:      %10.2f ms\n", cold);
+    printf("warm:      %10.2f ms\n", warm);
+
+    filesystem::remove_all(root);
+    return 0;
+}
@@ -2,6 +2,7 @@
 #define SPOTIFY_DLP_H
 
 #include <string>
+#include <cstring>
 #include <filesystem>
 
 #ifdef __cplusplus
@@ -30,12 +31,11 @@ extern "C"
     typedef struct DownloadConfig
     {
 
-        // note: -x is set on by default
-
         // yt-dlp flags
         // File type for audio extraction
-        // Flag: --extract-audio --audio-format FORMAT
-        // where FORMAT = mp3|m4a|opus|vorbis|wav|best|aac|alac|flac
+        // yt-dlp only fetches the best audio stream, ffmpeg then converts it on the transcode pool (see transcode_jobs)
+        // BEST keeps the stream as served: --extract-audio --audio-format best
+        // FORMAT = mp3|m4a|opus|vorbis|wav|best|aac|alac|flac
         DownloadFileType download_file_type;
 
         // Number of download retries on failure
@@ -43,8 +43,7 @@ extern "C"
         // Default: 10, -1 means use default
         int retries;
 
-        // Audio quality for transcoding
-        // Flag: --audio-quality QUALITY
+        // Audio quality for transcoding, mapped to ffmpeg -q:a the way yt-dlp maps --audio-quality
         // Range: 0-10 (0=best, 10=worst)
         // Default: 10, -1 means use default
         int audio_quality;
@@ -59,6 +58,36 @@ extern "C"
         // algorithim options
         double minimum_match_score; // 0.0 - 1.0 default 0.7
 
+        // Maximum number of YouTube search requests in flight at once
+        // Default: 8, values <= 0 mean use default
+        int max_concurrent_searches;
+
+        // Number of tracks downloaded in parallel, each one runs its own yt-dlp process
+        // Default: 4, values <= 0 mean use default
+        int jobs;
+
+        // Persistent Spotify track -> YouTube video cache (JSONL file), skips searching tracks resolved before
+        // NULL disables the cache
+        const char *resolution_cache_path;
+
+        // How long a "no acceptable match" result is trusted before the track is searched again
+        // Default: 86400 (1 day), values <= 0 mean use default
+        int no_match_ttl_seconds;
+
+        // Linux only: run yt-dlp from a sealed in-memory file instead of extracting it to the cache directory,
+        // for read-only or noexec hosts. Falls back to extracting it when memfd is unavailable
+        // Default: 0 (off)
+        int yt_dlp_in_memory;
+
+        // Start one long-lived yt-dlp per job and feed it that job's share of the tracks (--batch-file -),
+        // so the yt-dlp startup is paid once per job instead of once per track
+        // Default: 1 (on), 0 starts a separate yt-dlp for every track
+        int batch_downloads;
+
+        // Number of ffmpeg conversions run at once, separate from jobs so downloads never wait on the CPU
+        // Default: 0, one per CPU core
+        int transcode_jobs;
+
         Return error;
     } DownloadConfig;
 
@@ -71,6 +100,13 @@ extern "C"
                 .audio_quality = 10,
                 .output = NULL,
                 .minimum_match_score = 0.7,
+                .max_concurrent_searches = 8,
+                .jobs = 4,
+                .resolution_cache_path = NULL,
+                .no_match_ttl_seconds = 86400,
+                .yt_dlp_in_memory = 0,
+                .batch_downloads = 1,
+                .transcode_jobs = 0,
                 .error = OK};
      */
     static inline DownloadConfig dlp_create_default_download_config()
@@ -81,6 +117,13 @@ extern "C"
         config.audio_quality = 10;
         config.output = NULL;
         config.minimum_match_score = 0.7;
+        config.max_concurrent_searches = 8;
+        config.jobs = 4;
+        config.resolution_cache_path = NULL;
+        config.no_match_ttl_seconds = 86400;
+        config.yt_dlp_in_memory = 0;
+        config.batch_downloads = 1;
+        config.transcode_jobs = 0;
         config.error = OK;
         return config;
     }
@@ -111,6 +154,13 @@ extern "C"
         config.audio_quality = 10;
         config.output = nullptr;
         config.minimum_match_score = 0.7;
+        config.max_concurrent_searches = 8;
+        config.jobs = 4;
+        config.resolution_cache_path = nullptr;
+        config.no_match_ttl_seconds = 86400;
+        config.yt_dlp_in_memory = 0;
+        config.batch_downloads = 1;
+        config.transcode_jobs = 0;
         config.error = OK;
 
         if (path == nullptr || strlen(path) == 0)
@@ -1,10 +1,15 @@
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <stdexcept>
+#include <unordered_map>
 
 #include "./api.h"
 #include "../../utils/curl_utils.h"
+#include "../../utils/curl_multi.h"
+#include "../../utils/http_pool.h"
 #include "../../utils/logger.h"
 
 using namespace std;
@@ -31,148 +36,494 @@ namespace
 }
 
 SpotifyAPI::SpotifyAPI(string client_id, string client_secret)
-    : client_id(move(client_id)), client_secret(move(client_secret))
+    : client_id(client_id), client_secret(client_secret), token_manager(move(client_id), move(client_secret)),
+      rate_governor(RateGovernor::instance())
 {
-    fetch_oauth_token();
 }
 
-void SpotifyAPI::fetch_oauth_token()
+AnyMetadata SpotifyAPI::get_metadata(const string &url, const Deadline &deadline) const
 {
-    LOG_DEBUG("Fetching token for client ID: ", this->client_id);
+    SpotifyItem item = parse_url(url);
 
-    string response;
-    struct curl_slist *headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
+    switch (item.type)
+    {
+    case DownloadType::Track:
+        return this->fetch_track_metadata(item.id, deadline);
+    case DownloadType::Album:
+        return this->fetch_album_metadata(item.id, deadline);
+    case DownloadType::Playlist:
+    default:
+        return this->fetch_playlist_metadata(item.id, deadline);
+    }
+}
 
-    string data = "grant_type=client_credentials&client_id=" + this->client_id +
-                  "&client_secret=" + this->client_secret;
+vector<MetadataResult> SpotifyAPI::get_metadata_batch(const vector<string> &urls, const Deadline &deadline) const
+{
+    vector<MetadataResult> results(urls.size());
+    // id -> every input index asking for it, the ids themselves in first-seen order
+    unordered_map<string, vector<size_t>> track_indices, album_indices, playlist_indices;
+    vector<string> track_ids, album_ids, playlist_ids;
 
-    CURL *curl = this->curl_guard.get();
-    if (!curl)
+    for (size_t i = 0; i < urls.size(); i++)
     {
-        string log = "Failed to initialize CURL";
-        THROW_AND_LOG(CurlException, log, log);
+        results[i].url = urls[i];
+        try
+        {
+            SpotifyItem item = parse_url(urls[i]);
+            auto &indices = item.type == DownloadType::Track   ? track_indices
+                            : item.type == DownloadType::Album ? album_indices
+                                                               : playlist_indices;
+            auto &ids = item.type == DownloadType::Track   ? track_ids
+                        : item.type == DownloadType::Album ? album_ids
+                                                           : playlist_ids;
+            vector<size_t> &same_id = indices[item.id];
+            if (same_id.empty())
+                ids.push_back(item.id);
+            same_id.push_back(i);
+        }
+        catch (const exception &e)
+        {
+            results[i].error = e.what();
+        }
     }
 
-    this->curl_guard.set_headers(headers);
+    LOG_INFO("Fetching metadata in batches", "Fetching metadata for " + to_string(track_ids.size()) + " tracks, " + to_string(album_ids.size()) + " albums and " + to_string(playlist_ids.size()) + " playlists (" + to_string(urls.size()) + " urls)");
 
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-    curl_easy_setopt(curl, CURLOPT_URL, "https://accounts.spotify.com/api/token");
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    auto settle = [&](const vector<size_t> &indices, const optional<AnyMetadata> &metadata, const string &error)
+    {
+        for (size_t index : indices)
+        {
+            results[index].metadata = metadata;
+            results[index].error = error;
+        }
+    };
+
+    vector<vector<ItemLookup>> lookups = this->fetch_items_by_ids(
+        {{.endpoint = "/tracks", .ids = track_ids, .ids_per_request = TRACKS_PER_REQUEST},
+         {.endpoint = "/albums", .ids = album_ids, .ids_per_request = ALBUMS_PER_REQUEST}},
+        deadline);
 
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK)
+    for (size_t i = 0; i < track_ids.size(); i++)
     {
-        string base_msg = "Failed to send request to fetch authorization token for spotify.";
-        string verbose_msg = base_msg + curl_easy_strerror(res) + " (" + to_string(res) + ")";
-        THROW_AND_LOG(CurlException, base_msg, verbose_msg);
+        ItemLookup &lookup = lookups[0][i];
+        const vector<size_t> &indices = track_indices[track_ids[i]];
+        if (!lookup.item.has_value())
+        {
+            settle(indices, nullopt, lookup.error);
+            continue;
+        }
+        try
+        {
+            settle(indices, TrackMetadata::serialize(lookup.item.value()), "");
+        }
+        catch (const json::exception &e)
+        {
+            settle(indices, nullopt, e.what());
+        }
     }
 
-    string obtain_msg = "Successfully obtained spotify access token";
-    LOG_INFO(obtain_msg, obtain_msg);
+    for (size_t i = 0; i < album_ids.size(); i++)
+    {
+        ItemLookup &lookup = lookups[1][i];
+        const vector<size_t> &indices = album_indices[album_ids[i]];
+        if (!lookup.item.has_value())
+        {
+            settle(indices, nullopt, lookup.error);
+            continue;
+        }
+        try
+        {
+            json &album = lookup.item.value();
+            this->fetch_remaining_track_pages(album["tracks"], "/albums/" + album_ids[i] + "/tracks", ALBUM_TRACKS_PAGE_LIMIT, deadline);
+            settle(indices, AlbumMetadata::serialize(album), "");
+        }
+        catch (const DeadlineExceeded &)
+        {
+            throw;
+        }
+        catch (const exception &e)
+        {
+            settle(indices, nullopt, e.what());
+        }
+    }
 
-    try
+    for (const string &id : playlist_ids)
     {
-        json json_response = json::parse(response);
-        if (json_response.contains("error"))
+        const vector<size_t> &indices = playlist_indices[id];
+        try
+        {
+            settle(indices, this->fetch_playlist_metadata(id, deadline), "");
+        }
+        catch (const DeadlineExceeded &)
+        {
+            throw;
+        }
+        catch (const exception &e)
         {
-            string error = json_response["error"].get<string>();
-            string base_log = "Spotify API Error.";
-            THROW_AND_LOG(CurlException, base_log, base_log + error);
+            settle(indices, nullopt, e.what());
         }
-        this->token = json_response["access_token"].get<string>();
     }
-    catch (const json::exception &e)
+
+    return results;
+}
+
+void SpotifyAPI::enable_response_cache(filesystem::path directory, uintmax_t max_bytes)
+{
+    this->response_cache = make_unique<ResponseCache>(move(directory), max_bytes);
+}
+
+optional<ResponseCacheStats> SpotifyAPI::response_cache_stats() const
+{
+    if (!this->response_cache)
+        return nullopt;
+    return this->response_cache->stats();
+}
+
+string SpotifyAPI::get_playlist_snapshot_id(const string &url, const Deadline &deadline) const
+{
+    SpotifyItem item = parse_url(url);
+    if (item.type != DownloadType::Playlist)
     {
-        string msg = "Failed to parse response when fetching Spotify oauth token.";
-        string verbose_msg = msg + string(e.what());
-        THROW_AND_LOG(CurlException, msg, verbose_msg);
+        string log = "Only playlists have a snapshot_id";
+        THROW_AND_LOG(runtime_error, log, log + ", got " + url);
     }
+
+    json response = this->fetch_spotify_item_json("/playlists", item.id, deadline, "fields=snapshot_id");
+    if (!response.contains("snapshot_id") || !response["snapshot_id"].is_string())
+    {
+        string log = "Spotify API response has no snapshot_id";
+        THROW_AND_LOG(runtime_error, log, log + " for playlist " + item.id);
+    }
+    return response["snapshot_id"].get<string>();
 }
 
-AnyMetadata SpotifyAPI::get_metadata(string url)
+vector<string> SpotifyAPI::multi_id_urls(const string &endpoint, const vector<string> &ids, size_t ids_per_request)
 {
-    this->spotify_url = url;
-    this->parse_url();
+    vector<string> urls;
+    for (size_t first = 0; first < ids.size(); first += ids_per_request)
+    {
+        string url = "https://api.spotify.com/v1" + endpoint + "?ids=";
+        size_t last = min(first + ids_per_request, ids.size());
+        for (size_t i = first; i < last; i++)
+        {
+            if (i != first)
+                url += ',';
+            url += ids[i];
+        }
+        urls.push_back(move(url));
+    }
+    return urls;
+}
 
-    switch (download_type)
+vector<SpotifyAPI::ItemLookup> SpotifyAPI::parse_multi_id_response(const string &body, const string &key, size_t count)
+{
+    vector<ItemLookup> lookups(count);
+    auto fail_all = [&](const string &error)
     {
-    case DownloadType::Track:
-        return this->fetch_track_metadata();
-    case DownloadType::Album:
-        return this->fetch_album_metadata();
-    case DownloadType::Playlist:
-        return this->fetch_playlist_metadata();
+        for (auto &lookup : lookups)
+            lookup.error = error;
+    };
+
+    json response = json::parse(body, nullptr, false);
+    if (response.is_discarded() || !response.is_object())
+    {
+        fail_all("Spotify API returned a malformed response");
+        return lookups;
+    }
+    if (response.contains("error"))
+    {
+        const json &error = response["error"];
+        fail_all("Spotify API returned an error: " + (error.is_object() ? error.value("message", error.dump()) : error.dump()));
+        return lookups;
     }
+    if (!response.contains(key) || !response[key].is_array() || response[key].size() != count)
+    {
+        fail_all("Spotify API response does not list every requested " + key);
+        return lookups;
+    }
+
+    // items come back in request order, null for ids Spotify does not know
+    for (size_t i = 0; i < count; i++)
+    {
+        json &item = response[key][i];
+        if (item.is_object())
+            lookups[i].item = move(item);
+        else
+            lookups[i].error = "not found on Spotify";
+    }
+    return lookups;
 }
 
-TrackMetadata SpotifyAPI::fetch_track_metadata()
+vector<vector<SpotifyAPI::ItemLookup>> SpotifyAPI::fetch_items_by_ids(const vector<MultiIdQuery> &queries, const Deadline &deadline) const
 {
-    json response = this->fetch_spotify_item_json("/tracks");
+    struct Chunk
+    {
+        size_t query;
+        size_t first; // index of its first id in the query
+        size_t count;
+    };
+
+    vector<vector<ItemLookup>> lookups(queries.size());
+    vector<Chunk> chunks;
+    vector<HttpRequest> requests;
+    for (size_t q = 0; q < queries.size(); q++)
+    {
+        const MultiIdQuery &query = queries[q];
+        lookups[q].resize(query.ids.size());
+        vector<string> urls = multi_id_urls(query.endpoint, query.ids, query.ids_per_request);
+        for (size_t c = 0; c < urls.size(); c++)
+        {
+            size_t first = c * query.ids_per_request;
+            chunks.push_back({q, first, min(query.ids_per_request, query.ids.size() - first)});
+            requests.push_back(HttpRequest{
+                .url = move(urls[c]),
+                .headers = {"Authorization: Bearer " + this->token_manager.get_token()}});
+        }
+    }
+
+    if (requests.empty())
+        return lookups;
+
+    CurlMulti multi(MAX_CONCURRENT_PAGE_REQUESTS);
+    multi.on_admission([this](size_t)
+                       { return this->rate_governor.reserve(); });
+    multi.perform(requests, [&](size_t index, const HttpResponse &response, int attempt) -> RetryDelay
+                  {
+        if (RetryDelay retry = this->rate_governor.on_response(response, attempt))
+        {
+            return retry;
+        }
+
+        const Chunk &chunk = chunks[index];
+        const string key = queries[chunk.query].endpoint.substr(1);
+        vector<ItemLookup> items;
+        if (response.code != CURLE_OK)
+        {
+            items.resize(chunk.count);
+            for (auto &item : items)
+                item.error = string("Request failed: ") + curl_easy_strerror(response.code);
+        }
+        else
+        {
+            items = parse_multi_id_response(response.body, key, chunk.count);
+        }
+
+        move(items.begin(), items.end(), lookups[chunk.query].begin() + chunk.first);
+        return nullopt; }, deadline);
+
+    return lookups;
+}
+
+TrackMetadata SpotifyAPI::fetch_track_metadata(const string &id, const Deadline &deadline) const
+{
+    json response = this->fetch_spotify_item_json("/tracks", id, deadline);
     return TrackMetadata::serialize(response);
 }
 
-AlbumMetadata SpotifyAPI::fetch_album_metadata()
+AlbumMetadata SpotifyAPI::fetch_album_metadata(const string &id, const Deadline &deadline) const
 {
-    json response = this->fetch_spotify_item_json("/albums");
+    json response = this->fetch_spotify_item_json("/albums", id, deadline);
+    this->fetch_remaining_track_pages(response["tracks"], "/albums/" + id + "/tracks", ALBUM_TRACKS_PAGE_LIMIT, deadline);
 
     return AlbumMetadata::serialize(response);
 }
 
-PlaylistMetadata SpotifyAPI::fetch_playlist_metadata()
+PlaylistMetadata SpotifyAPI::fetch_playlist_metadata(const string &id, const Deadline &deadline) const
 {
-    json response = this->fetch_spotify_item_json("/playlists");
+    json response = this->fetch_spotify_item_json("/playlists", id, deadline);
+    this->fetch_remaining_track_pages(response["tracks"], "/playlists/" + id + "/tracks", PLAYLIST_TRACKS_PAGE_LIMIT, deadline);
 
     return PlaylistMetadata::serialize(response);
 }
 
-json SpotifyAPI::fetch_spotify_item_json(string endpoint)
+vector<int> SpotifyAPI::remaining_page_offsets(int total, int fetched, int page_limit)
+{
+    vector<int> offsets;
+    for (int offset = fetched; offset < total; offset += page_limit)
+    {
+        offsets.push_back(offset);
+    }
+    return offsets;
+}
+
+void SpotifyAPI::fetch_remaining_track_pages(json &tracks, const string &endpoint, int page_limit, const Deadline &deadline) const
+{
+    if (!tracks.is_object() || !tracks.contains("items") || !tracks["items"].is_array())
+        return;
+
+    int total = tracks.value("total", 0);
+    int fetched = static_cast<int>(tracks["items"].size());
+    if (!tracks.contains("next") || tracks["next"].is_null() || fetched >= total)
+        return;
+
+    vector<int> offsets = remaining_page_offsets(total, fetched, page_limit);
+    LOG_INFO("Fetching remaining track pages", "Fetching " + to_string(offsets.size()) + " more pages from " + endpoint + " (" + to_string(total) + " tracks total)");
+
+    vector<HttpRequest> requests;
+    requests.reserve(offsets.size());
+    for (int offset : offsets)
+    {
+        requests.push_back(HttpRequest{
+            .url = "https://api.spotify.com/v1" + endpoint + "?offset=" + to_string(offset) + "&limit=" + to_string(page_limit),
+            .headers = {"Authorization: Bearer " + this->token_manager.get_token()}});
+    }
+
+    vector<json> pages(requests.size());
+    vector<string> errors;
+
+    CurlMulti multi(MAX_CONCURRENT_PAGE_REQUESTS);
+    multi.on_admission([this](size_t)
+                       { return this->rate_governor.reserve(); });
+    multi.perform(requests, [&](size_t index, const HttpResponse &response, int attempt) -> RetryDelay
+                  {
+        if (RetryDelay retry = this->rate_governor.on_response(response, attempt))
+        {
+            return retry;
+        }
+
+        if (response.code != CURLE_OK)
+        {
+            errors.push_back(requests[index].url + ": " + curl_easy_strerror(response.code));
+            return nullopt;
+        }
+
+        try
+        {
+            json page = json::parse(response.body);
+            if (page.contains("error") || !page.contains("items"))
+            {
+                errors.push_back(requests[index].url + ": " + page.value("error", json()).dump());
+                return nullopt;
+            }
+            pages[index] = move(page);
+        }
+        catch (const json::exception &e)
+        {
+            errors.push_back(requests[index].url + ": " + e.what());
+        }
+        return nullopt; }, deadline);
+
+    if (!errors.empty())
+    {
+        string base_log = "Failed to fetch every page of tracks from Spotify API!";
+        THROW_AND_LOG(runtime_error, base_log, base_log + " First error: " + errors.front());
+    }
+
+    append_track_pages(tracks, pages);
+}
+
+void SpotifyAPI::append_track_pages(json &tracks, vector<json> &pages)
 {
-    string response;
-    string url = "https://api.spotify.com/v1" + endpoint + "/" + this->item_id;
+    json &items = tracks["items"];
+    for (auto &page : pages)
+    {
+        for (auto &item : page["items"])
+        {
+            items.push_back(move(item));
+        }
+    }
+    tracks["next"] = nullptr;
+}
 
-    string auth_header = "Authorization: Bearer " + this->token;
-    curl_slist *headers = curl_slist_append(nullptr, auth_header.c_str());
-    this->curl_guard.set_headers(headers);
+json SpotifyAPI::fetch_spotify_item_json(const string &endpoint, const string &id, const Deadline &deadline, const string &query) const
+{
+    string url = "https://api.spotify.com/v1" + endpoint + "/" + id;
+    if (!query.empty())
+        url += "?" + query;
 
-    CURL *curl = this->curl_guard.get();
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    optional<CachedResponse> cached;
+    json cached_json;
+    if (this->response_cache)
+    {
+        cached = this->response_cache->lookup(url);
+        if (cached.has_value())
+        {
+            cached_json = json::parse(cached->body, nullptr, false);
+            if (cached_json.is_discarded())
+            {
+                // corrupt or truncated on disk, fetch it again rather than fail or revalidate a body we cannot use
+                LOG_WARN("Dropping unreadable cached Spotify response", "Dropping unreadable cached response for " + url);
+                this->response_cache->remove(url);
+                cached.reset();
+            }
+            else if (cached->is_fresh())
+            {
+                return cached_json;
+            }
+        }
+    }
+
+    HttpResponse response{};
+    RetryDelay retry;
+    string etag, cache_control;
+
+    for (int attempt = 0;; attempt++)
+    {
+        this->rate_governor.acquire(deadline, retry.value_or(chrono::milliseconds(0)));
+
+        string auth_header = "Authorization: Bearer " + this->token_manager.get_token();
+        curl_slist *headers = curl_slist_append(nullptr, auth_header.c_str());
+        if (cached.has_value() && !cached->etag.empty())
+            headers = curl_slist_append(headers, ("If-None-Match: " + cached->etag).c_str());
+
+        PooledCurl curl_handle;
+        curl_handle.set_headers(headers);
+
+        response = HttpResponse{};
+        CURL *curl = curl_handle.get();
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+        apply_deadline(curl, deadline);
+
+        response.code = curl_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+        response.retry_after = retry_after_of(curl);
+        etag = response_header(curl, "ETag").value_or("");
+        cache_control = response_header(curl, "Cache-Control").value_or("");
+
+        if (response.code != CURLE_OK)
+            deadline.check("Spotify metadata request");
+
+        retry = this->rate_governor.on_response(response, attempt);
+        if (!retry.has_value())
+            break;
+        LOG_DEBUG("Retrying Spotify metadata request", "Retrying " + url + " in " + to_string(retry->count()) + "ms (HTTP " + to_string(response.status) + ", attempt " + to_string(attempt + 1) + ")");
+    }
 
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK)
+    if (response.code != CURLE_OK)
     {
         string base_log = "Failed to make request to request metadata from Spotify API!";
-        THROW_AND_LOG(runtime_error, base_log, base_log + curl_easy_strerror(res));
+        THROW_AND_LOG(runtime_error, base_log, base_log + curl_easy_strerror(response.code));
+    }
+
+    if (response.status == 304 && cached.has_value())
+    {
+        this->response_cache->revalidated(*cached, cache_control);
+        return cached_json;
     }
 
-    json json_response = json::parse(response);
-    if (json_response.contains("error"))
+    json json_response = json::parse(response.body, nullptr, false);
+    if (json_response.is_discarded() || json_response.contains("error") || response.status >= 300)
     {
         string base_log = "Spotify API returned an error when attempting to request metadata!";
-        string response_err = json_response["error"].get<string>();
+        string response_err = " HTTP " + to_string(response.status) + ": " + response.body;
         THROW_AND_LOG(runtime_error, base_log, base_log + response_err);
     }
 
+    if (this->response_cache)
+        this->response_cache->store(url, response.body, etag, cache_control);
     return json_response;
 }
 
-void SpotifyAPI::parse_url()
+SpotifyAPI::SpotifyItem SpotifyAPI::parse_url(const string &url)
 {
-    string cleaned_url = validate_and_clean_url(this->spotify_url);
+    string cleaned_url = validate_and_clean_url(url);
     auto [type, id] = extract_type_and_id(cleaned_url);
 
-    this->download_type = determine_content_type(type);
-    this->item_id = id;
+    return SpotifyItem{determine_content_type(type), id};
 }
 
 string SpotifyAPI::validate_and_clean_url(const string &url)
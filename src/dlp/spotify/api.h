@@ -2,11 +2,19 @@
 #ifndef API_H
 #define API_H
 
+#include <filesystem>
+#include <memory>
+#include <optional>
 #include <string>
 #include <variant>
+#include <vector>
 #include <nlohmann/json.hpp>
 #include "../../utils/curl_utils.h"
+#include "../../utils/deadline.h"
 #include "metadata.h"
+#include "rate_governor.h"
+#include "response_cache.h"
+#include "token_manager.h"
 
 #ifdef BUILD_TEST
 #include <gtest/gtest.h>
@@ -14,32 +22,88 @@
 
 using AnyMetadata = std::variant<TrackMetadata, AlbumMetadata, PlaylistMetadata>;
 
+struct MetadataResult
+{
+    std::string url;
+    std::optional<AnyMetadata> metadata; // std::nullopt when this item failed
+    std::string error;                   // why it failed, empty on success
+};
+
+// Safe to share between threads: calls keep their state on the stack, curl handles come from HttpPool and only
+// a token refresh makes callers wait on each other, so one instance and one OAuth handshake serve every worker.
 class SpotifyAPI
 {
 public:
+    struct SpotifyItem
+    {
+        DownloadType type;
+        std::string id;
+    };
+
     SpotifyAPI(std::string client_id, std::string client_secret);
-    AnyMetadata get_metadata(std::string url);
+    // throws DeadlineExceeded when the deadline passes or is cancelled before every request completed
+    AnyMetadata get_metadata(const std::string &url, const Deadline &deadline = Deadline()) const;
+    // For many urls at once. Tracks and albums are deduplicated and looked up through /tracks?ids= and /albums?ids=
+    // (50 and 20 ids per request), several requests in flight; playlists have no multi-id endpoint and are fetched
+    // one at a time. Never throws for a single item, results are in input order. Throws DeadlineExceeded when the
+    // deadline passes first.
+    std::vector<MetadataResult> get_metadata_batch(const std::vector<std::string> &urls, const Deadline &deadline = Deadline()) const;
+    // only the playlist's current snapshot_id (/playlists/{id}?fields=snapshot_id), cheap enough to ask before
+    // deciding whether the playlist needs fetching at all. Throws runtime_error when the url is not a playlist
+    std::string get_playlist_snapshot_id(const std::string &url, const Deadline &deadline = Deadline()) const;
+    // Keeps item responses (tracks, albums, playlists) on disk under directory, fresh ones are served without a
+    // request and stale ones revalidated with If-None-Match. Off until called; call it before sharing the instance.
+    void enable_response_cache(std::filesystem::path directory, uintmax_t max_bytes = ResponseCache::DEFAULT_MAX_BYTES);
+    std::optional<ResponseCacheStats> response_cache_stats() const; // std::nullopt while the cache is off
+    // type and id of a share url or "type/id", throws runtime_error for anything but a track, album or playlist
+    static SpotifyItem parse_url(const std::string &url); // tested
 
 private:
-    std::string validate_and_clean_url(const std::string &url);                      // tested
-    std::pair<std::string, std::string> extract_type_and_id(const std::string &url); // tested
-    DownloadType determine_content_type(const std::string &type);                    // tested
-
-    void parse_url();                                             // tested
-    void fetch_oauth_token();                                     // tested
-    TrackMetadata fetch_track_metadata();                         // tested
-    AlbumMetadata fetch_album_metadata();                         // tested
-    PlaylistMetadata fetch_playlist_metadata();                   // tested
-    nlohmann::json fetch_spotify_item_json(std::string endpoint); // tested
-
-    std::string spotify_url;
-    std::string token;
+    struct ItemLookup
+    {
+        std::optional<nlohmann::json> item; // std::nullopt when the lookup failed
+        std::string error;
+    };
+
+    struct MultiIdQuery
+    {
+        std::string endpoint; // "/tracks" or "/albums", the response lists the items under the same name
+        std::vector<std::string> ids;
+        size_t ids_per_request;
+    };
+
+    static constexpr int PLAYLIST_TRACKS_PAGE_LIMIT = 100; // maximum allowed by /playlists/{id}/tracks
+    static constexpr int ALBUM_TRACKS_PAGE_LIMIT = 50;     // maximum allowed by /albums/{id}/tracks
+    static constexpr size_t MAX_CONCURRENT_PAGE_REQUESTS = 4;
+    static constexpr size_t TRACKS_PER_REQUEST = 50; // maximum allowed by /tracks?ids=
+    static constexpr size_t ALBUMS_PER_REQUEST = 20; // maximum allowed by /albums?ids=
+
+    static std::string validate_and_clean_url(const std::string &url);                      // tested
+    static std::pair<std::string, std::string> extract_type_and_id(const std::string &url); // tested
+    static DownloadType determine_content_type(const std::string &type);                    // tested
+
+    TrackMetadata fetch_track_metadata(const std::string &id, const Deadline &deadline = Deadline()) const;       // tested
+    AlbumMetadata fetch_album_metadata(const std::string &id, const Deadline &deadline = Deadline()) const;       // tested
+    PlaylistMetadata fetch_playlist_metadata(const std::string &id, const Deadline &deadline = Deadline()) const; // tested
+    // query is appended after "?" when not empty, e.g. "fields=snapshot_id"
+    nlohmann::json fetch_spotify_item_json(const std::string &endpoint, const std::string &id, const Deadline &deadline = Deadline(),
+                                           const std::string &query = "") const; // tested
+
+    // follows tracks.total/tracks.next and appends every remaining page to tracks.items in order
+    void fetch_remaining_track_pages(nlohmann::json &tracks, const std::string &endpoint, int page_limit, const Deadline &deadline) const;
+    static std::vector<int> remaining_page_offsets(int total, int fetched, int page_limit); // tested
+    static void append_track_pages(nlohmann::json &tracks, std::vector<nlohmann::json> &pages); // in offset order, clears tracks.next; tested
+
+    // one result list per query, in the order of its ids
+    std::vector<std::vector<ItemLookup>> fetch_items_by_ids(const std::vector<MultiIdQuery> &queries, const Deadline &deadline) const;
+    static std::vector<std::string> multi_id_urls(const std::string &endpoint, const std::vector<std::string> &ids, size_t ids_per_request); // tested
+    static std::vector<ItemLookup> parse_multi_id_response(const std::string &body, const std::string &key, size_t count);            // tested
+
     std::string client_id;
     std::string client_secret;
-    std::string item_id;
-    DownloadType download_type;
-
-    CurlGuard curl_guard;
+    mutable SpotifyTokenManager token_manager; // get_token() locks on its own
+    RateGovernor &rate_governor;               // shared by every SpotifyAPI in the process
+    std::unique_ptr<ResponseCache> response_cache; // nullptr until enable_response_cache()
 
 #ifdef BUILD_TEST
     friend class SpotifyAPITest;
@@ -49,10 +113,16 @@ private:
     FRIEND_TEST(SpotifyAPITest, ValidateAndCleanUrlThrowsOnSpotifyUri);
     FRIEND_TEST(SpotifyAPITest, SplitUrlParsesCorrectly);
     FRIEND_TEST(SpotifyAPITest, DetermineContentTypeReturnsCorrectType);
+    FRIEND_TEST(SpotifyAPITest, ParseUrlReturnsTypeAndId);
     FRIEND_TEST(SpotifyAPITest, ValidateFetchToken);
     FRIEND_TEST(SpotifyAPITest, FetchTrackMetadataReturnsCorrectData);
     FRIEND_TEST(SpotifyAPITest, FetchAlbumMetadataReturnsCorrectData);
     FRIEND_TEST(SpotifyAPITest, FetchPlaylistMetadataReturnsCorrectData);
+    FRIEND_TEST(SpotifyAPITest, RemainingPageOffsetsCoverEveryTrack);
+    FRIEND_TEST(SpotifyAPITest, AppendTrackPagesKeepsOffsetOrder);
+    FRIEND_TEST(SpotifyAPITest, MultiIdUrlsGroupIds);
+    FRIEND_TEST(SpotifyAPITest, ParseMultiIdResponseMatchesItemsToIds);
+    FRIEND_TEST(SpotifyAPITest, ParseMultiIdResponseFailsEveryIdOnError);
 #endif
 };
 
@@ -67,6 +67,11 @@ TrackMetadata TrackMetadata::serialize(const nlohmann::json &data)
     }
     track.external_urls = external_urls;
 
+    if (data.contains("external_ids") && data["external_ids"].contains("isrc") && data["external_ids"]["isrc"].is_string())
+    {
+        track.isrc = data["external_ids"]["isrc"].get<string>();
+    }
+
     return track;
 }
 
@@ -133,6 +138,7 @@ PlaylistMetadata PlaylistMetadata::serialize(const nlohmann::json &data)
 
     playlist.name = data["name"].get<string>();
     playlist.id = data["id"].get<string>();
+    playlist.snapshot_id = data.value("snapshot_id", "");
     playlist.total_tracks = data["tracks"].value("total", 0);
 
     if (playlist.total_tracks == 0)
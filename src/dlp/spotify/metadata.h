@@ -45,6 +45,7 @@ struct TrackMetadata
                artists == other.artists &&
                album_id == other.album_id &&
                album_name == other.album_name &&
+               isrc == other.isrc &&
                external_urls == other.external_urls;
     }
 
@@ -55,6 +56,7 @@ struct TrackMetadata
     std::string id;
     std::optional<std::string> album_name;
     std::optional<std::string> album_id;
+    std::optional<std::string> isrc; // only present on full track objects (external_ids.isrc)
     std::vector<std::string> external_urls;
     int track_number;
 };
@@ -88,6 +90,7 @@ struct PlaylistMetadata
 {
     std::string name;
     std::string id;
+    std::string snapshot_id; // changes with every edit of the playlist, empty when Spotify did not send one
     std::vector<TrackMetadata> tracks;
     int total_tracks;
 
@@ -101,6 +104,7 @@ struct PlaylistMetadata
         return total_tracks == other.total_tracks &&
                id == other.id &&
                name == other.name &&
+               snapshot_id == other.snapshot_id &&
                tracks == other.tracks;
     };
 };
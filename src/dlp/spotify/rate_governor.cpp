@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "rate_governor.h"
+#include "../../utils/logger.h"
+
+using namespace std;
+
+RateGovernor &RateGovernor::instance()
+{
+    static RateGovernor governor;
+    return governor;
+}
+
+RateGovernor::RateGovernor(double rate, double burst)
+    : rate(clamp(rate, MIN_RATE, MAX_RATE)), burst(max(burst, 1.0)), tokens(this->burst),
+      refilled_at(Clock::now()), paused_until(Clock::now()), random(random_device{}())
+{
+}
+
+chrono::milliseconds RateGovernor::reserve()
+{
+    return this->reserve(Clock::now());
+}
+
+chrono::milliseconds RateGovernor::reserve(Clock::time_point now)
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    this->refill(now);
+    this->tokens -= 1;
+
+    Clock::time_point start = now;
+    if (this->tokens < 0)
+    {
+        start += chrono::duration_cast<Clock::duration>(chrono::duration<double>(-this->tokens / this->rate));
+    }
+    start = max(start, this->paused_until);
+
+    auto wait = chrono::ceil<chrono::milliseconds>(start - now);
+    this->counters.requests++;
+    this->counters.waited += wait;
+    return wait;
+}
+
+void RateGovernor::acquire(const Deadline &deadline, chrono::milliseconds retry_delay)
+{
+    deadline.check("Spotify rate limit");
+
+    chrono::milliseconds reserved = this->reserve();
+    chrono::milliseconds wait = max(reserved, retry_delay);
+    try
+    {
+        optional<chrono::milliseconds> remaining = deadline.remaining();
+        if (remaining.has_value() && remaining.value() < wait)
+        {
+            throw DeadlineExceeded("Deadline exceeded while waiting out the Spotify rate limit");
+        }
+
+        Clock::time_point until = Clock::now() + wait;
+        for (Clock::time_point now = Clock::now(); now < until; now = Clock::now())
+        {
+            deadline.check("Spotify rate limit");
+            this_thread::sleep_for(min<Clock::duration>(until - now, WAIT_SLICE));
+        }
+        deadline.check("Spotify rate limit");
+    }
+    catch (const DeadlineExceeded &)
+    {
+        // the request is never sent, so its token goes back to the others
+        this->give_back(reserved);
+        throw;
+    }
+}
+
+void RateGovernor::give_back(chrono::milliseconds reserved_wait)
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    this->tokens = min(this->burst, this->tokens + 1);
+    this->counters.requests--;
+    this->counters.waited -= reserved_wait;
+}
+
+RetryDelay RateGovernor::on_response(const HttpResponse &response, int attempt)
+{
+    return this->on_response(response, attempt, Clock::now());
+}
+
+RetryDelay RateGovernor::on_response(const HttpResponse &response, int attempt, Clock::time_point now)
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    bool last_attempt = attempt + 1 >= MAX_ATTEMPTS;
+
+    if (response.code == CURLE_OK && response.status == 429)
+    {
+        this->counters.throttled_responses++;
+        this->refill(now);
+        this->rate = max(MIN_RATE, this->rate / 2);
+        this->tokens = min(this->tokens, 0.0);
+
+        chrono::milliseconds pause = response.retry_after.has_value()
+                                         ? chrono::duration_cast<chrono::milliseconds>(response.retry_after.value())
+                                         : this->backoff(attempt);
+        Clock::time_point until = now + pause;
+        if (until > this->paused_until)
+        {
+            this->counters.paused += chrono::ceil<chrono::milliseconds>(until - max(now, this->paused_until));
+            this->paused_until = until;
+        }
+        LOG_WARN("Spotify API rate limit hit, pausing requests", "Spotify API rate limit hit, pausing requests for " + to_string(pause.count()) + "ms and lowering the rate to " + to_string(this->rate) + " requests/s");
+
+        if (last_attempt)
+            return nullopt;
+        this->counters.retries++;
+        return pause;
+    }
+
+    bool failed = response.code != CURLE_OK || response.status >= 500;
+    if (!failed)
+    {
+        if (response.status < 400)
+        {
+            // tokens accrued so far are counted at the old rate, only the time from now on earns the new one
+            this->refill(now);
+            this->rate = min(MAX_RATE, this->rate + RATE_STEP);
+        }
+        return nullopt;
+    }
+
+    if (last_attempt)
+        return nullopt;
+    this->counters.retries++;
+    return this->backoff(attempt);
+}
+
+RateGovernorStats RateGovernor::stats() const
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    RateGovernorStats stats = this->counters;
+    stats.requests_per_second = this->rate;
+    return stats;
+}
+
+chrono::milliseconds RateGovernor::backoff(int attempt)
+{
+    double full = min<double>(MAX_BACKOFF.count(), BASE_BACKOFF.count() * pow(2.0, attempt));
+    uniform_real_distribution<double> jitter(full / 2, full);
+    return chrono::milliseconds(static_cast<long long>(jitter(this->random)));
+}
+
+void RateGovernor::refill(Clock::time_point now)
+{
+    if (now <= this->refilled_at)
+        return;
+    double elapsed = chrono::duration<double>(now - this->refilled_at).count();
+    this->tokens = min(this->burst, this->tokens + elapsed * this->rate);
+    this->refilled_at = now;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef RATE_GOVERNOR_H
+#define RATE_GOVERNOR_H
+
+#ifdef BUILD_TEST
+#include <gtest/gtest.h>
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include "../../utils/curl_multi.h"
+#include "../../utils/deadline.h"
+
+struct RateGovernorStats
+{
+    uint64_t requests = 0;                   // admitted through reserve()
+    uint64_t throttled_responses = 0;        // 429s seen
+    uint64_t retries = 0;                    // attempts asked for again, 429s included
+    std::chrono::milliseconds paused{0};     // wall time every request was held by Retry-After pauses
+    std::chrono::milliseconds waited{0};     // summed over requests: time held back for a token or a pause
+    double requests_per_second = 0;          // the bucket's current rate
+};
+
+// Paces every Spotify Web API request of the process. A token bucket starts at INITIAL_RATE, halves its rate on
+// each 429 and creeps back up with every success, so it settles just under what Spotify tolerates. A 429 also
+// pauses all requests for its Retry-After, as Spotify's limit is per app and not per connection. Failed attempts
+// are retried with jittered exponential backoff.
+class RateGovernor
+{
+#ifdef BUILD_TEST
+    FRIEND_TEST(RateGovernorTest, BurstIsAdmittedThenPaced);
+    FRIEND_TEST(RateGovernorTest, RetryAfterPausesEveryRequest);
+    FRIEND_TEST(RateGovernorTest, SuccessRaisesTheRate);
+    FRIEND_TEST(RateGovernorTest, RaisedRateOnlyAppliesFromNowOn);
+    FRIEND_TEST(RateGovernorTest, FailuresBackOffWithJitter);
+#endif
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double INITIAL_RATE = 10.0; // requests per second
+    static constexpr double MIN_RATE = 0.5;
+    static constexpr double MAX_RATE = 50.0;
+    static constexpr double RATE_STEP = 0.1; // added per successful response
+    static constexpr double BURST = 10.0;
+    static constexpr int MAX_ATTEMPTS = 6;
+    static constexpr std::chrono::milliseconds BASE_BACKOFF{500};
+    static constexpr std::chrono::milliseconds MAX_BACKOFF{30000};
+
+    static RateGovernor &instance();
+
+    explicit RateGovernor(double rate = INITIAL_RATE, double burst = BURST);
+
+    RateGovernor(const RateGovernor &) = delete;
+    RateGovernor &operator=(const RateGovernor &) = delete;
+
+    // Takes a token for one request and returns how long to hold it back, until the bucket has refilled and any
+    // pause is over. Never blocks, suits CurlMulti::on_admission.
+    std::chrono::milliseconds reserve();
+    // reserve() and sleep it off, at least retry_delay. Throws DeadlineExceeded when the deadline ends first.
+    void acquire(const Deadline &deadline, std::chrono::milliseconds retry_delay = std::chrono::milliseconds(0));
+    // Feeds back how an attempt went. Returns the delay before trying it again, std::nullopt when it is settled:
+    // succeeded, failed for good (4xx other than 429) or out of attempts.
+    RetryDelay on_response(const HttpResponse &response, int attempt);
+
+    RateGovernorStats stats() const;
+
+private:
+    static constexpr std::chrono::milliseconds WAIT_SLICE{100}; // how often a sleeping acquire() checks for cancellation
+
+    std::chrono::milliseconds reserve(Clock::time_point now);
+    RetryDelay on_response(const HttpResponse &response, int attempt, Clock::time_point now);
+    std::chrono::milliseconds backoff(int attempt); // random in [half, full] of BASE_BACKOFF * 2^attempt, capped
+    void refill(Clock::time_point now);
+    void give_back(std::chrono::milliseconds reserved_wait); // undoes a reserve() whose request was never sent
+
+    mutable std::mutex mutex;
+    double rate;
+    double burst;
+    double tokens; // negative while requests are queued up for tokens that have not refilled yet
+    Clock::time_point refilled_at;
+    Clock::time_point paused_until;
+    std::minstd_rand random;
+    RateGovernorStats counters;
+};
+
+#endif
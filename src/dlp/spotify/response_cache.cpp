@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <nlohmann/json.hpp>
+#include "response_cache.h"
+#include "../../utils/hash.h"
+#include "../../utils/logger.h"
+
+using namespace std;
+using namespace nlohmann;
+
+namespace
+{
+    constexpr const char *ENTRY_EXTENSION = ".response";
+}
+
+ResponseCache::ResponseCache(filesystem::path directory, uintmax_t max_bytes)
+    : directory(move(directory)), max_bytes(max_bytes)
+{
+    filesystem::create_directories(this->directory);
+
+    error_code ec;
+    for (const auto &file : filesystem::directory_iterator(this->directory, ec))
+    {
+        if (file.path().extension() != ENTRY_EXTENSION || !file.is_regular_file(ec))
+            continue;
+        Entry entry{file.file_size(ec), file.last_write_time(ec)};
+        if (ec)
+            continue;
+        this->entries[file.path().stem().string()] = entry;
+        this->counters.bytes += entry.size;
+    }
+    this->counters.entries = this->entries.size();
+    this->evict_over_budget();
+}
+
+optional<CachedResponse> ResponseCache::lookup(const string &url)
+{
+    string key = key_for(url);
+
+    lock_guard<std::mutex> lock(this->mutex);
+    auto found = this->entries.find(key);
+    if (found == this->entries.end())
+        return nullopt;
+
+    ifstream in(this->path_for(key), ios::binary);
+    string header;
+    if (!in || !getline(in, header))
+        return nullopt;
+
+    CachedResponse response;
+    try
+    {
+        json fields = json::parse(header);
+        response.url = fields.at("url").get<string>();
+        response.etag = fields.value("etag", "");
+        response.fresh_until = chrono::system_clock::time_point(chrono::seconds(fields.value("fresh_until", int64_t(0))));
+    }
+    catch (const json::exception &e)
+    {
+        LOG_WARN("Ignoring unreadable cached response", "Ignoring unreadable cached response " + this->path_for(key).string() + ": " + e.what());
+        return nullopt;
+    }
+    if (response.url != url) // hash collision
+        return nullopt;
+    response.body.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+
+    error_code ec;
+    found->second.last_used = filesystem::file_time_type::clock::now();
+    filesystem::last_write_time(this->path_for(key), found->second.last_used, ec);
+
+    if (response.is_fresh())
+        this->counters.hits++;
+    return response;
+}
+
+void ResponseCache::store(const string &url, const string &body, const string &etag, const string &cache_control)
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    this->counters.misses++;
+
+    optional<chrono::seconds> fresh_for = max_age(cache_control);
+    if (!fresh_for.has_value() || (etag.empty() && fresh_for->count() == 0) || body.size() > this->max_bytes)
+    {
+        this->erase(key_for(url));
+        return;
+    }
+
+    this->write(CachedResponse{url, body, etag, chrono::system_clock::now() + fresh_for.value()});
+    this->evict_over_budget();
+}
+
+void ResponseCache::revalidated(CachedResponse entry, const string &cache_control)
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    this->counters.revalidated++;
+
+    // a 304 may omit Cache-Control, the stored response is then simply revalidated again next time
+    optional<chrono::seconds> fresh_for = max_age(cache_control);
+    if (!fresh_for.has_value() || fresh_for->count() == 0)
+        return;
+
+    entry.fresh_until = chrono::system_clock::now() + fresh_for.value();
+    this->write(entry);
+}
+
+void ResponseCache::remove(const string &url)
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    this->erase(key_for(url));
+}
+
+ResponseCacheStats ResponseCache::stats() const
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    return this->counters;
+}
+
+optional<chrono::seconds> ResponseCache::max_age(const string &cache_control)
+{
+    string directives = cache_control;
+    transform(directives.begin(), directives.end(), directives.begin(), [](unsigned char c)
+              { return static_cast<char>(tolower(c)); });
+
+    chrono::seconds age(0);
+    stringstream stream(directives);
+    string directive;
+    while (getline(stream, directive, ','))
+    {
+        directive.erase(remove_if(directive.begin(), directive.end(), [](unsigned char c)
+                                  { return isspace(c); }),
+                        directive.end());
+        if (directive == "no-store")
+            return nullopt;
+        if (directive == "no-cache")
+            return chrono::seconds(0);
+        if (directive.starts_with("max-age="))
+        {
+            try
+            {
+                age = chrono::seconds(max(0LL, stoll(directive.substr(8))));
+            }
+            catch (const exception &)
+            {
+                age = chrono::seconds(0);
+            }
+        }
+    }
+    return age;
+}
+
+string ResponseCache::key_for(const string &url)
+{
+    return to_hex(fnv1a_64(url));
+}
+
+filesystem::path ResponseCache::path_for(const string &key) const
+{
+    return this->directory / (key + ENTRY_EXTENSION);
+}
+
+void ResponseCache::write(const CachedResponse &response)
+{
+    string key = key_for(response.url);
+    filesystem::path destination = this->path_for(key);
+    filesystem::path temp_path = destination;
+    temp_path += ".tmp";
+
+    json header = {
+        {"url", response.url},
+        {"etag", response.etag},
+        {"fresh_until", chrono::duration_cast<chrono::seconds>(response.fresh_until.time_since_epoch()).count()}};
+    {
+        ofstream out(temp_path, ios::binary | ios::trunc);
+        if (!(out << header.dump() << '\n'
+                  << response.body))
+        {
+            LOG_WARN("Could not write response cache", "Could not write cached response to " + temp_path.string());
+            return;
+        }
+    }
+
+    error_code ec;
+    filesystem::rename(temp_path, destination, ec);
+    if (ec)
+    {
+        filesystem::remove(temp_path, ec);
+        LOG_WARN("Could not write response cache", "Could not move cached response into place at " + destination.string() + ": " + ec.message());
+        return;
+    }
+
+    Entry entry{filesystem::file_size(destination, ec), filesystem::file_time_type::clock::now()};
+    auto [existing, inserted] = this->entries.try_emplace(key, entry);
+    if (!inserted)
+    {
+        this->counters.bytes -= existing->second.size;
+        existing->second = entry;
+    }
+    this->counters.bytes += entry.size;
+    this->counters.entries = this->entries.size();
+}
+
+void ResponseCache::erase(const string &key)
+{
+    auto found = this->entries.find(key);
+    if (found == this->entries.end())
+        return;
+
+    error_code ec;
+    filesystem::remove(this->path_for(key), ec);
+    this->counters.bytes -= found->second.size;
+    this->entries.erase(found);
+    this->counters.entries = this->entries.size();
+}
+
+void ResponseCache::evict_over_budget()
+{
+    while (this->counters.bytes > this->max_bytes && !this->entries.empty())
+    {
+        auto oldest = min_element(this->entries.begin(), this->entries.end(), [](const auto &a, const auto &b)
+                                  { return a.second.last_used < b.second.last_used; });
+        this->counters.evictions++;
+        this->erase(oldest->first);
+    }
+    this->counters.entries = this->entries.size();
+}
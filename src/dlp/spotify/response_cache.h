@@ -0,0 +1,85 @@
+#pragma once
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#ifdef BUILD_TEST
+#include <gtest/gtest.h>
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+struct CachedResponse
+{
+    std::string url;
+    std::string body;
+    std::string etag; // empty when the server sent none, the entry then cannot be revalidated
+    std::chrono::system_clock::time_point fresh_until;
+
+    bool is_fresh() const { return std::chrono::system_clock::now() < fresh_until; }
+};
+
+struct ResponseCacheStats
+{
+    uint64_t hits = 0;        // served fresh, no request made
+    uint64_t revalidated = 0; // 304 Not Modified, served from disk
+    uint64_t misses = 0;      // full body downloaded
+    uint64_t evictions = 0;
+    uintmax_t bytes = 0;
+    size_t entries = 0;
+};
+
+// On-disk HTTP cache for GET responses, keyed by url. Entries are fresh for the response's Cache-Control max-age,
+// after that they are revalidated with If-None-Match and a 304 serves the stored body again. Least recently used
+// entries are evicted to stay under max_bytes. One file per entry: a JSON header line, then the body.
+class ResponseCache
+{
+#ifdef BUILD_TEST
+    FRIEND_TEST(ResponseCacheTest, ParsesCacheControl);
+#endif
+
+public:
+    static constexpr uintmax_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+    explicit ResponseCache(std::filesystem::path directory, uintmax_t max_bytes = DEFAULT_MAX_BYTES);
+
+    // the stored response, fresh or not, std::nullopt when there is none; a fresh one counts as a hit
+    std::optional<CachedResponse> lookup(const std::string &url);
+    // after a 200: stores the body unless Cache-Control forbids it or there is neither an ETag nor a max-age,
+    // in which case any entry stored earlier is removed, its body and ETag are out of date
+    void store(const std::string &url, const std::string &body, const std::string &etag, const std::string &cache_control);
+    // after a 304 for an entry from lookup(): renews its freshness from the new Cache-Control
+    void revalidated(CachedResponse entry, const std::string &cache_control);
+    void remove(const std::string &url); // e.g. when the stored body turns out to be unreadable
+
+    ResponseCacheStats stats() const;
+
+private:
+    struct Entry
+    {
+        uintmax_t size;
+        std::filesystem::file_time_type last_used;
+    };
+
+    // std::nullopt for no-store, 0 for no-cache or when max-age is missing
+    static std::optional<std::chrono::seconds> max_age(const std::string &cache_control);
+    static std::string key_for(const std::string &url);
+    std::filesystem::path path_for(const std::string &key) const;
+    void write(const CachedResponse &response); // callers hold the mutex
+    void erase(const std::string &key);         // callers hold the mutex
+    void evict_over_budget();
+
+    std::filesystem::path directory;
+    uintmax_t max_bytes;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries; // by key_for(url)
+    ResponseCacheStats counters;
+};
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include <fstream>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+#include "token_manager.h"
+#include "../../utils/curl_utils.h"
+#include "../../utils/file_lock.h"
+#include "../../utils/hash.h"
+#include "../../utils/http_pool.h"
+#include "../../utils/logger.h"
+#include "../../utils/paths.h"
+
+using namespace std;
+using namespace nlohmann;
+
+namespace
+{
+    // the token is a credential, so a directory created for it is private to the user; an existing one is left alone
+    void create_private_directory(const filesystem::path &directory)
+    {
+        error_code ec;
+        if (directory.empty() || filesystem::exists(directory, ec))
+            return;
+#ifdef _WIN32
+        filesystem::create_directories(directory, ec);
+#else
+        filesystem::create_directories(directory.parent_path(), ec);
+        if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST)
+        {
+            LOG_WARN("Could not create token cache directory", "Could not create token cache directory " + directory.string() + ": " + strerror(errno));
+        }
+#endif
+    }
+}
+
+bool OAuthToken::valid_for(chrono::seconds margin) const
+{
+    return !access_token.empty() && chrono::system_clock::now() + margin < expires_at;
+}
+
+SpotifyTokenManager::SpotifyTokenManager(string client_id, string client_secret)
+    : SpotifyTokenManager(client_id, move(client_secret), default_cache_path(client_id)) {}
+
+SpotifyTokenManager::SpotifyTokenManager(string client_id, string client_secret, filesystem::path cache_path)
+    : client_id(move(client_id)), client_secret(move(client_secret)), cache_path(move(cache_path)) {}
+
+SpotifyTokenManager::~SpotifyTokenManager()
+{
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->refresh_cv.notify_all();
+
+    if (this->refresher.joinable())
+        this->refresher.join();
+}
+
+filesystem::path SpotifyTokenManager::default_cache_path(const string &client_id)
+{
+    return user_cache_dir() / ("token-" + to_hex(fnv1a_64(client_id)) + ".json");
+}
+
+string SpotifyTokenManager::get_token()
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    if (this->token.has_value() && this->token->valid_for(REFRESH_MARGIN))
+        return this->token->access_token;
+
+    this->token = this->refresh_token();
+    this->start_refresher();
+    return this->token->access_token;
+}
+
+void SpotifyTokenManager::start_refresher()
+{
+    if (!this->refresher.joinable())
+        this->refresher = thread(&SpotifyTokenManager::refresh_loop, this);
+}
+
+void SpotifyTokenManager::refresh_loop()
+{
+    unique_lock<std::mutex> lock(this->mutex);
+    auto next_refresh = this->token->expires_at - REFRESH_MARGIN;
+
+    while (!this->stopping)
+    {
+        if (this->refresh_cv.wait_until(lock, next_refresh, [this]
+                                        { return this->stopping; }))
+            break;
+
+        if (this->token.has_value() && this->token->valid_for(REFRESH_MARGIN))
+        {
+            next_refresh = this->token->expires_at - REFRESH_MARGIN;
+            continue;
+        }
+
+        // refresh without holding the mutex so get_token() callers are not stuck behind the request
+        lock.unlock();
+        optional<OAuthToken> fresh;
+        try
+        {
+            fresh = this->refresh_token();
+        }
+        catch (const exception &e)
+        {
+            LOG_WARN("Background token refresh failed, retrying shortly", string("Background token refresh failed: ") + e.what());
+        }
+        lock.lock();
+
+        if (fresh.has_value())
+        {
+            this->token = fresh;
+            next_refresh = fresh->expires_at - REFRESH_MARGIN;
+        }
+        else
+        {
+            next_refresh = chrono::system_clock::now() + FAILED_REFRESH_DELAY;
+        }
+    }
+}
+
+OAuthToken SpotifyTokenManager::refresh_token()
+{
+    create_private_directory(this->cache_path.parent_path());
+    // processes sharing the cache take turns, the later ones pick up the token the first one wrote
+    FileLock file_lock(filesystem::path(this->cache_path).concat(".lock"));
+
+    optional<OAuthToken> cached = this->load_cached_token();
+    if (cached.has_value() && cached->valid_for(REFRESH_MARGIN))
+    {
+        LOG_DEBUG("Using cached spotify access token", "Using cached spotify access token from " + this->cache_path.string());
+        return cached.value();
+    }
+
+    OAuthToken fresh = this->request_token();
+    this->store_cached_token(fresh);
+    return fresh;
+}
+
+OAuthToken SpotifyTokenManager::request_token()
+{
+    LOG_DEBUG("Fetching token for client ID: ", this->client_id);
+
+    string response;
+    PooledCurl curl_handle;
+    struct curl_slist *headers = nullptr;
+    headers = curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
+    curl_handle.set_headers(headers);
+
+    string data = "grant_type=client_credentials&client_id=" + this->client_id +
+                  "&client_secret=" + this->client_secret;
+
+    CURL *curl = curl_handle.get();
+    curl_easy_setopt(curl, CURLOPT_URL, "https://accounts.spotify.com/api/token");
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+    CURLcode res = curl_easy_perform(curl);
+    if (res != CURLE_OK)
+    {
+        string base_msg = "Failed to send request to fetch authorization token for spotify.";
+        string verbose_msg = base_msg + curl_easy_strerror(res) + " (" + to_string(res) + ")";
+        THROW_AND_LOG(CurlException, base_msg, verbose_msg);
+    }
+
+    try
+    {
+        json json_response = json::parse(response);
+        if (json_response.contains("error"))
+        {
+            string error = json_response["error"].get<string>();
+            string base_log = "Spotify API Error.";
+            THROW_AND_LOG(CurlException, base_log, base_log + error);
+        }
+
+        OAuthToken token;
+        token.access_token = json_response["access_token"].get<string>();
+        token.expires_at = chrono::system_clock::now() + chrono::seconds(json_response.value("expires_in", 3600));
+
+        string obtain_msg = "Successfully obtained spotify access token";
+        LOG_INFO(obtain_msg, obtain_msg);
+        return token;
+    }
+    catch (const json::exception &e)
+    {
+        string msg = "Failed to parse response when fetching Spotify oauth token.";
+        string verbose_msg = msg + string(e.what());
+        THROW_AND_LOG(CurlException, msg, verbose_msg);
+    }
+}
+
+optional<OAuthToken> SpotifyTokenManager::load_cached_token() const
+{
+    ifstream file(this->cache_path);
+    if (!file)
+        return nullopt;
+
+    try
+    {
+        json cached = json::parse(file);
+        OAuthToken token;
+        token.access_token = cached.at("access_token").get<string>();
+        token.expires_at = chrono::system_clock::time_point(chrono::seconds(cached.at("expires_at").get<int64_t>()));
+        return token;
+    }
+    catch (const json::exception &e)
+    {
+        LOG_WARN("Ignoring unreadable token cache", "Ignoring unreadable token cache at " + this->cache_path.string() + ": " + e.what());
+        return nullopt;
+    }
+}
+
+void SpotifyTokenManager::store_cached_token(const OAuthToken &token) const
+{
+    json cached = {
+        {"access_token", token.access_token},
+        {"expires_at", chrono::duration_cast<chrono::seconds>(token.expires_at.time_since_epoch()).count()}};
+
+    // write next to the cache and rename over it, readers never see a half written file
+    create_private_directory(this->cache_path.parent_path());
+    string contents = cached.dump();
+    error_code ec;
+#ifdef _WIN32
+    filesystem::path temp_path = filesystem::path(this->cache_path).concat(".tmp");
+    {
+        ofstream file(temp_path, ios::trunc);
+        if (!file)
+        {
+            LOG_WARN("Could not write token cache", "Could not write token cache to " + temp_path.string());
+            return;
+        }
+        file << contents;
+    }
+#else
+    // created 0600 before the token is written, so it is never readable by others, not even for a moment
+    string temp_template = this->cache_path.string() + ".XXXXXX";
+    int fd = mkostemp(temp_template.data(), O_CLOEXEC);
+    if (fd == -1)
+    {
+        LOG_WARN("Could not write token cache", "Could not create a temporary token cache next to " + this->cache_path.string() + ": " + strerror(errno));
+        return;
+    }
+
+    bool written = fchmod(fd, 0600) == 0;
+    for (size_t offset = 0; written && offset < contents.size();)
+    {
+        ssize_t n = write(fd, contents.data() + offset, contents.size() - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        written = n > 0;
+        if (written)
+            offset += static_cast<size_t>(n);
+    }
+    if (close(fd) != 0 || !written)
+    {
+        unlink(temp_template.c_str());
+        LOG_WARN("Could not write token cache", "Could not write token cache to " + temp_template);
+        return;
+    }
+    filesystem::path temp_path = temp_template;
+#endif
+
+    filesystem::rename(temp_path, this->cache_path, ec);
+    if (ec)
+    {
+        LOG_WARN("Could not write token cache", "Could not move token cache into place at " + this->cache_path.string() + ": " + ec.message());
+        filesystem::remove(temp_path, ec);
+    }
+}
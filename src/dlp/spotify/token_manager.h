@@ -0,0 +1,73 @@
+#pragma once
+#ifndef TOKEN_MANAGER_H
+#define TOKEN_MANAGER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#ifdef BUILD_TEST
+#include <gtest/gtest.h>
+#endif
+
+struct OAuthToken
+{
+    std::string access_token;
+    std::chrono::system_clock::time_point expires_at;
+
+    bool valid_for(std::chrono::seconds margin) const;
+};
+
+// Owns the client-credentials token for one Spotify app.
+// The token is shared with other processes on the host through a cache file guarded by a lock file,
+// and a background thread replaces it shortly before it expires so requests never see a stale token.
+class SpotifyTokenManager
+{
+#ifdef BUILD_TEST
+    friend class SpotifyTokenManagerTest;
+    FRIEND_TEST(SpotifyTokenManagerTest, StoresAndLoadsCachedToken);
+    FRIEND_TEST(SpotifyTokenManagerTest, IgnoresExpiredCachedToken);
+    FRIEND_TEST(SpotifyTokenManagerTest, UsesValidCachedTokenWithoutRequest);
+    FRIEND_TEST(SpotifyTokenManagerTest, CacheIsPrivateToTheUser);
+#endif
+
+public:
+    SpotifyTokenManager(std::string client_id, std::string client_secret);
+    SpotifyTokenManager(std::string client_id, std::string client_secret, std::filesystem::path cache_path);
+    ~SpotifyTokenManager();
+
+    SpotifyTokenManager(const SpotifyTokenManager &) = delete;
+    SpotifyTokenManager &operator=(const SpotifyTokenManager &) = delete;
+
+    // returns a token that is valid for at least REFRESH_MARGIN, fetching one if needed
+    std::string get_token();
+
+    static std::filesystem::path default_cache_path(const std::string &client_id);
+
+private:
+    static constexpr std::chrono::seconds REFRESH_MARGIN{300};
+    static constexpr std::chrono::seconds FAILED_REFRESH_DELAY{30};
+
+    OAuthToken refresh_token();  // takes the file lock, reuses a token another process just wrote or requests a new one
+    OAuthToken request_token();  // tested
+    std::optional<OAuthToken> load_cached_token() const;
+    void store_cached_token(const OAuthToken &token) const;
+    void start_refresher();
+    void refresh_loop();
+
+    std::string client_id;
+    std::string client_secret;
+    std::filesystem::path cache_path;
+
+    std::mutex mutex;
+    std::condition_variable refresh_cv;
+    std::optional<OAuthToken> token;
+    std::thread refresher;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,55 @@
+// Build-time helper: compresses the raw embedded yt-dlp into a single zstd frame for yt-dlp-data-compressed.cpp.
+// usage: yt-dlp-pack <output> [level]
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <zstd.h>
+#include "yt-dlp-data.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s <output> [level]\n", argv[0]);
+        return 2;
+    }
+    int level = argc == 3 ? atoi(argv[2]) : 19;
+
+#ifdef _WIN32
+    const unsigned char *data = YtDLPData::yt_dlp_windows;
+    size_t size = YtDLPData::yt_dlp_windows_size;
+#else
+    const unsigned char *data = YtDLPData::yt_dlp_linux;
+    size_t size = YtDLPData::yt_dlp_linux_size;
+#endif
+
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+
+    // one-shot compression records the content size in the frame header, YtDLP reads it back for its size checks
+    vector<char> packed(ZSTD_compressBound(size));
+    size_t packed_size = ZSTD_compress2(cctx, packed.data(), packed.size(), data, size);
+    ZSTD_freeCCtx(cctx);
+
+    if (ZSTD_isError(packed_size))
+    {
+        fprintf(stderr, "failed to compress yt-dlp: %s\n", ZSTD_getErrorName(packed_size));
+        return 1;
+    }
+
+    ofstream out(argv[1], ios::binary | ios::trunc);
+    out.write(packed.data(), static_cast<streamsize>(packed_size));
+    if (!out)
+    {
+        fprintf(stderr, "failed to write %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("packed yt-dlp: %zu -> %zu bytes (level %d)\n", size, packed_size, level);
+    return 0;
+}
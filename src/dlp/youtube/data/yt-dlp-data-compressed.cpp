@@ -0,0 +1,33 @@
+#include "yt-dlp-data.h"
+
+// The packed payload is assembled straight into read-only data with .incbin, so the compiler never sees it
+// as an array literal. YT_DLP_PAYLOAD_PATH is set by CMake to the output of yt-dlp-pack.
+#ifndef YT_DLP_PAYLOAD_PATH
+#error "YT_DLP_PAYLOAD_PATH must point to the zstd-compressed yt-dlp"
+#endif
+
+#ifdef __APPLE__
+#define YT_DLP_SYMBOL(name) "_" #name
+#define YT_DLP_RODATA_BEGIN ".const_data\n"
+#define YT_DLP_RODATA_END ".text\n"
+#else
+#define YT_DLP_SYMBOL(name) #name
+#define YT_DLP_RODATA_BEGIN ".pushsection .rodata, \"a\"\n"
+#define YT_DLP_RODATA_END ".popsection\n"
+#endif
+
+__asm__(YT_DLP_RODATA_BEGIN
+        ".balign 16\n"
+        ".globl " YT_DLP_SYMBOL(yt_dlp_zstd_begin) "\n" YT_DLP_SYMBOL(yt_dlp_zstd_begin) ":\n"
+        ".incbin \"" YT_DLP_PAYLOAD_PATH "\"\n"
+        ".globl " YT_DLP_SYMBOL(yt_dlp_zstd_end) "\n" YT_DLP_SYMBOL(yt_dlp_zstd_end) ":\n"
+        ".byte 0\n" YT_DLP_RODATA_END);
+
+extern "C" const unsigned char yt_dlp_zstd_begin[];
+extern "C" const unsigned char yt_dlp_zstd_end[];
+
+namespace YtDLPData
+{
+    extern const unsigned char *const yt_dlp_zstd = yt_dlp_zstd_begin;
+    extern const size_t yt_dlp_zstd_size = static_cast<size_t>(yt_dlp_zstd_end - yt_dlp_zstd_begin);
+}
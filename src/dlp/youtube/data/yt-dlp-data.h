@@ -2,9 +2,15 @@
 #ifndef YT_DLP_DATA_H
 #define YT_DLP_DATA_H
 
+#include <cstddef>
+
 namespace YtDLPData
 {
-#ifdef _WIN32
+#ifdef YT_DLP_COMPRESSED
+    // a single zstd frame with the uncompressed size in its header, packed at build time (see yt-dlp-data-compressed.cpp)
+    extern const unsigned char *const yt_dlp_zstd;
+    extern const size_t yt_dlp_zstd_size;
+#elif defined(_WIN32)
     extern const unsigned char yt_dlp_windows[];
     extern const size_t yt_dlp_windows_size;
 #else
@@ -13,4 +19,4 @@ namespace YtDLPData
 #endif
 }
 
-#endif
\ No newline at end of file
+#endif
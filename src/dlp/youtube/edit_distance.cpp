@@ -0,0 +1,189 @@
+#include <algorithm>
+#include "edit_distance.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define EDIT_DISTANCE_AVX2 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace EditDistance
+{
+    MyersPattern::MyersPattern(string_view pattern)
+        : length(pattern.size()), blocks(max<size_t>((pattern.size() + 63) / 64, 1)), peq(256 * blocks, 0)
+    {
+        for (size_t i = 0; i < pattern.size(); i++)
+        {
+            unsigned char c = static_cast<unsigned char>(pattern[i]);
+            peq[c * blocks + i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+
+    int MyersPattern::distance(string_view text) const
+    {
+        if (this->length == 0)
+            return static_cast<int>(text.size());
+        if (text.empty())
+            return static_cast<int>(this->length);
+
+        return this->blocks == 1 ? this->distance_single_word(text) : this->distance_blocked(text);
+    }
+
+    int MyersPattern::distance_single_word(string_view text) const
+    {
+        const uint64_t last = uint64_t(1) << (this->length - 1);
+        uint64_t vp = ~uint64_t(0);
+        uint64_t vn = 0;
+        int score = static_cast<int>(this->length);
+
+        for (unsigned char c : text)
+        {
+            uint64_t eq = this->peq[c];
+            uint64_t d0 = (((eq & vp) + vp) ^ vp) | eq | vn;
+            uint64_t hp = vn | ~(d0 | vp);
+            uint64_t hn = d0 & vp;
+
+            score += (hp & last) ? 1 : 0;
+            score -= (hn & last) ? 1 : 0;
+
+            // the top row of the table grows by one per text character, hence the 1 shifted in
+            hp = (hp << 1) | 1;
+            hn = hn << 1;
+            vp = hn | ~(d0 | hp);
+            vn = hp & d0;
+        }
+        return score;
+    }
+
+    int MyersPattern::distance_blocked(string_view text) const
+    {
+        vector<uint64_t> vp(this->blocks, ~uint64_t(0));
+        vector<uint64_t> vn(this->blocks, 0);
+        const size_t last_block = this->blocks - 1;
+        const uint64_t last = uint64_t(1) << ((this->length - 1) % 64);
+        int score = static_cast<int>(this->length);
+
+        for (unsigned char c : text)
+        {
+            uint64_t hp_carry = 1;
+            uint64_t hn_carry = 0;
+
+            for (size_t b = 0; b < this->blocks; b++)
+            {
+                uint64_t eq = this->match_mask(c, b);
+                uint64_t x = eq | hn_carry;
+                uint64_t d0 = (((x & vp[b]) + vp[b]) ^ vp[b]) | x | vn[b];
+                uint64_t hp = vn[b] | ~(d0 | vp[b]);
+                uint64_t hn = d0 & vp[b];
+
+                if (b == last_block)
+                {
+                    score += (hp & last) ? 1 : 0;
+                    score -= (hn & last) ? 1 : 0;
+                }
+
+                uint64_t hp_out = hp >> 63;
+                uint64_t hn_out = hn >> 63;
+                hp = (hp << 1) | hp_carry;
+                hn = (hn << 1) | hn_carry;
+                hp_carry = hp_out;
+                hn_carry = hn_out;
+
+                vp[b] = hn | ~(d0 | hp);
+                vn[b] = hp & d0;
+            }
+        }
+        return score;
+    }
+
+    int levenshtein(string_view a, string_view b)
+    {
+        // distance is symmetric, so the shorter string becomes the pattern to keep the block count low
+        if (a.size() > b.size())
+            swap(a, b);
+        return MyersPattern(a).distance(b);
+    }
+
+#ifdef EDIT_DISTANCE_AVX2
+    namespace
+    {
+        // Four texts against one single-word pattern, lane i runs the scalar recurrence for texts[i].
+        // Lanes whose text has ended keep their state through a blend on the active mask.
+        __attribute__((target("avx2"))) void distance_x4(const MyersPattern &pattern, const uint64_t *peq,
+                                                         const string_view *texts, int *out)
+        {
+            size_t longest = 0;
+            for (int lane = 0; lane < 4; lane++)
+                longest = max(longest, texts[lane].size());
+
+            const __m256i ones = _mm256_set1_epi64x(-1);
+            const __m256i one = _mm256_set1_epi64x(1);
+            const __m128i last_shift = _mm_cvtsi32_si128(static_cast<int>(pattern.size() - 1));
+
+            __m256i vp = ones;
+            __m256i vn = _mm256_setzero_si256();
+            __m256i score = _mm256_set1_epi64x(static_cast<long long>(pattern.size()));
+
+            for (size_t j = 0; j < longest; j++)
+            {
+                alignas(32) uint64_t eq_lanes[4];
+                alignas(32) int64_t active_lanes[4];
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    bool active = j < texts[lane].size();
+                    eq_lanes[lane] = active ? peq[static_cast<unsigned char>(texts[lane][j])] : 0;
+                    active_lanes[lane] = active ? -1 : 0;
+                }
+                __m256i eq = _mm256_load_si256(reinterpret_cast<const __m256i *>(eq_lanes));
+                __m256i active = _mm256_load_si256(reinterpret_cast<const __m256i *>(active_lanes));
+
+                __m256i sum = _mm256_add_epi64(_mm256_and_si256(eq, vp), vp);
+                __m256i d0 = _mm256_or_si256(_mm256_or_si256(_mm256_xor_si256(sum, vp), eq), vn);
+                __m256i hp = _mm256_or_si256(vn, _mm256_xor_si256(_mm256_or_si256(d0, vp), ones));
+                __m256i hn = _mm256_and_si256(d0, vp);
+
+                __m256i hp_bit = _mm256_and_si256(_mm256_srl_epi64(hp, last_shift), one);
+                __m256i hn_bit = _mm256_and_si256(_mm256_srl_epi64(hn, last_shift), one);
+                __m256i delta = _mm256_and_si256(_mm256_sub_epi64(hp_bit, hn_bit), active);
+                score = _mm256_add_epi64(score, delta);
+
+                hp = _mm256_or_si256(_mm256_slli_epi64(hp, 1), one);
+                hn = _mm256_slli_epi64(hn, 1);
+                __m256i next_vp = _mm256_or_si256(hn, _mm256_xor_si256(_mm256_or_si256(d0, hp), ones));
+                __m256i next_vn = _mm256_and_si256(hp, d0);
+
+                vp = _mm256_blendv_epi8(vp, next_vp, active);
+                vn = _mm256_blendv_epi8(vn, next_vn, active);
+            }
+
+            alignas(32) int64_t scores[4];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(scores), score);
+            for (int lane = 0; lane < 4; lane++)
+                out[lane] = static_cast<int>(scores[lane]);
+        }
+    }
+#endif
+
+    vector<int> levenshtein_many(const MyersPattern &pattern, const vector<string_view> &texts)
+    {
+        vector<int> distances(texts.size());
+        size_t i = 0;
+
+#ifdef EDIT_DISTANCE_AVX2
+        if (pattern.length > 0 && pattern.blocks == 1 && __builtin_cpu_supports("avx2"))
+        {
+            for (; i + 4 <= texts.size(); i += 4)
+            {
+                distance_x4(pattern, pattern.peq.data(), &texts[i], &distances[i]);
+            }
+        }
+#endif
+
+        for (; i < texts.size(); i++)
+        {
+            distances[i] = pattern.distance(texts[i]);
+        }
+        return distances;
+    }
+}
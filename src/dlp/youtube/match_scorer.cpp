@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <numeric>
+#include "match_scorer.h"
+
+using namespace std;
+
+namespace
+{
+    // normalized candidate fields, views stay valid while the batch is alive
+    struct CandidateBatch
+    {
+        vector<string> titles;
+        vector<string> artists;
+        vector<string_view> title_views;
+        vector<string_view> artist_views;
+
+        CandidateBatch(const vector<SearchResult> &candidates, NormalizerCache &normalizer)
+        {
+            titles.reserve(candidates.size());
+            artists.reserve(candidates.size());
+            for (const auto &candidate : candidates)
+            {
+                titles.push_back(normalizer.normalize(candidate.title));
+                artists.push_back(normalizer.normalize(candidate.artist));
+            }
+            title_views.assign(titles.begin(), titles.end());
+            artist_views.assign(artists.begin(), artists.end());
+        }
+    };
+
+    void score_batch(const TrackMatchContext &track, const CandidateBatch &batch, vector<SearchResult> &candidates)
+    {
+        vector<double> title_scores = track.title.similarities(batch.title_views);
+        vector<double> artist_scores = track.artists.similarities(batch.artist_views);
+        vector<double> album_scores;
+        if (track.album.has_value())
+            album_scores = track.album->similarities(batch.title_views);
+
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            double score = 0.0;
+            score += title_scores[i] * 0.45;  // title match (45%)
+            score += artist_scores[i] * 0.45; // artist match (45%)
+            if (track.album.has_value())
+                score += album_scores[i] * 0.10; // album match bonus (10%)
+            candidates[i].score = score;
+        }
+    }
+
+    void score_batch(const AlbumMatchContext &album, const CandidateBatch &batch, vector<SearchResult> &candidates)
+    {
+        vector<double> title_scores = album.name.similarities(batch.title_views);
+        vector<double> artist_scores = album.artists.similarities(batch.artist_views);
+
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            double score = 0.0;
+            score += title_scores[i] * 0.50;  // album title match (50%)
+            score += artist_scores[i] * 0.40; // artist match (40%)
+            if (batch.titles[i].find("album") != string::npos)
+                score += 0.10; // keywords suggesting it's an album (10%)
+            candidates[i].score = score;
+        }
+    }
+}
+
+MatchField::MatchField(string normalized) : normalized(move(normalized)), pattern(this->normalized)
+{
+}
+
+vector<double> MatchField::similarities(const vector<string_view> &texts) const
+{
+    vector<int> distances = EditDistance::levenshtein_many(this->pattern, texts);
+
+    vector<double> similarities(texts.size());
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        size_t max_len = max(this->normalized.size(), texts[i].size());
+        similarities[i] = max_len == 0 ? 0.0 : 1.0 - (static_cast<double>(distances[i]) / max_len);
+    }
+    return similarities;
+}
+
+namespace MatchScorer
+{
+    void score(const MatchContext &context, vector<SearchResult> &candidates, NormalizerCache &normalizer)
+    {
+        if (candidates.empty())
+            return;
+
+        CandidateBatch batch(candidates, normalizer);
+        visit([&](const auto &typed_context)
+              { score_batch(typed_context, batch, candidates); },
+              context);
+    }
+
+    void rank(vector<SearchResult> &candidates, size_t top_k)
+    {
+        top_k = min(top_k, candidates.size());
+        if (top_k == 0)
+            return;
+
+        vector<size_t> order(candidates.size());
+        iota(order.begin(), order.end(), 0);
+
+        auto better = [&](size_t a, size_t b)
+        {
+            if (candidates[a].score != candidates[b].score)
+                return candidates[a].score > candidates[b].score;
+            return a < b;
+        };
+        partial_sort(order.begin(), order.begin() + top_k, order.end(), better);
+        sort(order.begin() + top_k, order.end());
+
+        vector<SearchResult> ranked;
+        ranked.reserve(candidates.size());
+        for (size_t index : order)
+            ranked.push_back(move(candidates[index]));
+        candidates = move(ranked);
+    }
+}
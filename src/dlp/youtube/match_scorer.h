@@ -0,0 +1,60 @@
+#pragma once
+#ifndef MATCH_SCORER_H
+#define MATCH_SCORER_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include "edit_distance.h"
+#include "normalizer.h"
+
+struct SearchResult
+{
+    std::string video_id;
+    std::string title;
+    std::string artist;
+    int duration_seconds;
+    double score;
+};
+
+// One normalized Spotify-side string with its edit distance pattern, compiled once per query
+// and compared against every candidate of the response.
+struct MatchField
+{
+    explicit MatchField(std::string normalized);
+
+    // 1 - distance / longer length for each text, 0 when both strings are empty
+    std::vector<double> similarities(const std::vector<std::string_view> &texts) const;
+
+    std::string normalized;
+    EditDistance::MyersPattern pattern;
+};
+
+struct TrackMatchContext
+{
+    MatchField title;
+    MatchField artists;
+    std::optional<MatchField> album;
+};
+
+struct AlbumMatchContext
+{
+    MatchField name;
+    MatchField artists;
+};
+
+using MatchContext = std::variant<TrackMatchContext, AlbumMatchContext>;
+
+namespace MatchScorer
+{
+    // sets SearchResult::score for every candidate, the scorer is picked by the context type
+    void score(const MatchContext &context, std::vector<SearchResult> &candidates, NormalizerCache &normalizer);
+
+    // moves the best top_k candidates to the front in descending score order, ties keep response order
+    // and the remaining candidates keep their relative order
+    void rank(std::vector<SearchResult> &candidates, size_t top_k);
+}
+
+#endif
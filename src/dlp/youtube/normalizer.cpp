@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <array>
+#include "normalizer.h"
+
+using namespace std;
+
+namespace
+{
+    // ASCII byte -> lowercase letter or digit, 0 for separators (and for every byte >= 0x80)
+    constexpr array<char, 256> make_ascii_table()
+    {
+        array<char, 256> table{};
+        for (int c = '0'; c <= '9'; c++)
+            table[c] = static_cast<char>(c);
+        for (int c = 'a'; c <= 'z'; c++)
+            table[c] = static_cast<char>(c);
+        for (int c = 'A'; c <= 'Z'; c++)
+            table[c] = static_cast<char>(c - 'A' + 'a');
+        return table;
+    }
+
+    constexpr array<char, 256> ASCII_TABLE = make_ascii_table();
+
+    // two byte UTF-8 sequences indexed by the continuation byte & 0x3F, nullptr for separators
+
+    // 0xC3: U+00C0 - U+00FF
+    constexpr const char *LATIN_1_SUPPLEMENT[64] = {
+        "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+        "d", "n", "o", "o", "o", "o", "o", nullptr, "o", "u", "u", "u", "u", "y", "th", "ss",
+        "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+        "d", "n", "o", "o", "o", "o", "o", nullptr, "o", "u", "u", "u", "u", "y", "th", "y"};
+
+    // 0xC4: U+0100 - U+013F
+    constexpr const char *LATIN_EXTENDED_A_LOW[64] = {
+        "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d",
+        "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g",
+        "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i",
+        "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l"};
+
+    // 0xC5: U+0140 - U+017F
+    constexpr const char *LATIN_EXTENDED_A_HIGH[64] = {
+        "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o",
+        "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s",
+        "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u",
+        "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s"};
+
+    const char *const *fold_table(unsigned char lead)
+    {
+        switch (lead)
+        {
+        case 0xC3:
+            return LATIN_1_SUPPLEMENT;
+        case 0xC4:
+            return LATIN_EXTENDED_A_LOW;
+        case 0xC5:
+            return LATIN_EXTENDED_A_HIGH;
+        default:
+            return nullptr;
+        }
+    }
+
+    bool is_continuation(unsigned char c)
+    {
+        return (c & 0xC0) == 0x80;
+    }
+}
+
+namespace TextNormalizer
+{
+    string normalize(string_view input)
+    {
+        string result;
+        result.reserve(input.size());
+        bool pending_space = false;
+
+        auto emit = [&](const char *folded)
+        {
+            if (pending_space && !result.empty())
+                result.push_back(' ');
+            pending_space = false;
+            result.append(folded);
+        };
+
+        for (size_t i = 0; i < input.size(); i++)
+        {
+            unsigned char c = static_cast<unsigned char>(input[i]);
+
+            if (char mapped = ASCII_TABLE[c]; mapped != 0)
+            {
+                const char folded[2] = {mapped, '\0'};
+                emit(folded);
+                continue;
+            }
+
+            const char *const *table = fold_table(c);
+            if (table != nullptr && i + 1 < input.size() && is_continuation(static_cast<unsigned char>(input[i + 1])))
+            {
+                const char *folded = table[static_cast<unsigned char>(input[i + 1]) & 0x3F];
+                i++;
+                if (folded != nullptr)
+                {
+                    emit(folded);
+                    continue;
+                }
+            }
+
+            pending_space = true;
+        }
+        return result;
+    }
+}
+
+NormalizerCache::NormalizerCache(size_t capacity) : capacity(max(capacity, size_t(1)))
+{
+}
+
+string NormalizerCache::normalize(string_view input)
+{
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        auto found = this->entries.find(input);
+        if (found != this->entries.end())
+        {
+            this->recency.splice(this->recency.begin(), this->recency, found->second);
+            return found->second->second;
+        }
+    }
+
+    // normalize outside the lock, a racing thread computing the same value is harmless
+    string normalized = TextNormalizer::normalize(input);
+
+    lock_guard<std::mutex> lock(this->mutex);
+    if (this->entries.find(input) == this->entries.end())
+    {
+        this->recency.emplace_front(string(input), normalized);
+        this->entries.emplace(this->recency.front().first, this->recency.begin());
+
+        if (this->entries.size() > this->capacity)
+        {
+            this->entries.erase(this->recency.back().first);
+            this->recency.pop_back();
+        }
+    }
+    return normalized;
+}
+
+size_t NormalizerCache::size() const
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    return this->entries.size();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef NORMALIZER_H
+#define NORMALIZER_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Single pass, table driven title normalization used for match scoring:
+// ASCII is lowercased, Latin-1 Supplement and Latin Extended-A letters are folded to their ASCII base
+// ("Beyoncé" -> "beyonce", "Straße" -> "strasse"), every other run of bytes collapses to one space and
+// the result is trimmed.
+namespace TextNormalizer
+{
+    std::string normalize(std::string_view input);
+}
+
+// Bounded LRU memo around TextNormalizer::normalize, safe to share between threads.
+class NormalizerCache
+{
+public:
+    explicit NormalizerCache(size_t capacity);
+
+    std::string normalize(std::string_view input);
+    size_t size() const;
+
+private:
+    using Entry = std::pair<std::string, std::string>; // input, normalized
+
+    size_t capacity;
+    mutable std::mutex mutex;
+    std::list<Entry> recency; // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> entries; // keys view into recency
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include <charconv>
+#include <nlohmann/json.hpp>
+#include "output_parser.h"
+
+using namespace std;
+
+namespace
+{
+    // splits off the next tab separated field, the last field takes the rest of the line
+    string_view next_field(string_view &fields)
+    {
+        size_t tab = fields.find('\t');
+        string_view field = fields.substr(0, tab);
+        fields = tab == string_view::npos ? string_view() : fields.substr(tab + 1);
+        return field;
+    }
+
+    // yt-dlp prints "NA" for fields it does not know
+    optional<double> parse_number(string_view field)
+    {
+        double value;
+        auto [end, error] = from_chars(field.data(), field.data() + field.size(), value);
+        if (error != errc() || end != field.data() + field.size())
+            return nullopt;
+        return value;
+    }
+}
+
+vector<string> YtDLPOutputParser::arguments()
+{
+    string info = string("video:") + string(INFO_RECORD) + "%(original_url)s\t%(.{id,title,duration,acodec})j";
+    string progress = string("download:") + string(PROGRESS_RECORD) +
+                      "%(progress.status)s\t%(progress.downloaded_bytes)s\t%(progress.total_bytes,progress.total_bytes_estimate)s\t"
+                      "%(progress.speed)s\t%(progress.eta)s\t%(info.original_url)s";
+    string postprocess = string("postprocess:") + string(POSTPROCESS_RECORD) +
+                         "%(progress.status)s\t%(progress.postprocessor)s\t%(info.original_url)s";
+    string file_ready = string("after_move:") + string(FILE_RECORD) + "%(original_url)s\t%(filepath)s";
+
+    // a video stage --print would otherwise imply --simulate, and --quiet would hide the progress records
+    return {"--no-simulate", "--progress", "--newline",
+            "--print", info,
+            "--progress-template", progress,
+            "--progress-template", postprocess,
+            "--print", file_ready};
+}
+
+void YtDLPOutputParser::on_info(function<void(const YtDLPVideoInfo &)> callback)
+{
+    this->info_callback = move(callback);
+}
+
+void YtDLPOutputParser::on_progress(function<void(const YtDLPProgress &)> callback)
+{
+    this->progress_callback = move(callback);
+}
+
+void YtDLPOutputParser::on_postprocess(function<void(const YtDLPPostprocess &)> callback)
+{
+    this->postprocess_callback = move(callback);
+}
+
+void YtDLPOutputParser::on_file_ready(function<void(const YtDLPFileReady &)> callback)
+{
+    this->file_ready_callback = move(callback);
+}
+
+void YtDLPOutputParser::on_log(LineCallback callback)
+{
+    this->log_callback = move(callback);
+}
+
+void YtDLPOutputParser::feed(string_view line)
+{
+    if (line.substr(0, FILE_RECORD.size()) == FILE_RECORD)
+        this->parse_file_ready(line.substr(FILE_RECORD.size()));
+    else if (line.substr(0, PROGRESS_RECORD.size()) == PROGRESS_RECORD)
+        this->parse_progress(line.substr(PROGRESS_RECORD.size()));
+    else if (line.substr(0, POSTPROCESS_RECORD.size()) == POSTPROCESS_RECORD)
+        this->parse_postprocess(line.substr(POSTPROCESS_RECORD.size()));
+    else if (line.substr(0, INFO_RECORD.size()) == INFO_RECORD)
+        this->parse_info(line.substr(INFO_RECORD.size()));
+    else if (this->log_callback)
+        this->log_callback(line);
+}
+
+void YtDLPOutputParser::parse_info(string_view fields)
+{
+    YtDLPVideoInfo info;
+    info.original_url = string(next_field(fields));
+
+    auto json = nlohmann::json::parse(fields.begin(), fields.end(), nullptr, false);
+    if (json.is_discarded() || !json.is_object())
+    {
+        if (this->log_callback)
+            this->log_callback(fields);
+        return;
+    }
+
+    // missing fields come through as null
+    if (json.contains("id") && json["id"].is_string())
+        info.id = json["id"].get<string>();
+    if (json.contains("title") && json["title"].is_string())
+        info.title = json["title"].get<string>();
+    if (json.contains("duration") && json["duration"].is_number())
+        info.duration_seconds = json["duration"].get<double>();
+    if (json.contains("acodec") && json["acodec"].is_string() && json["acodec"] != "none")
+        info.acodec = json["acodec"].get<string>();
+    if (this->info_callback)
+        this->info_callback(info);
+}
+
+void YtDLPOutputParser::parse_progress(string_view fields)
+{
+    if (!this->progress_callback)
+        return;
+
+    YtDLPProgress progress;
+    progress.status = string(next_field(fields));
+    progress.downloaded_bytes = static_cast<uint64_t>(parse_number(next_field(fields)).value_or(0));
+    if (optional<double> total = parse_number(next_field(fields)))
+        progress.total_bytes = static_cast<uint64_t>(*total);
+    progress.speed = parse_number(next_field(fields));
+    progress.eta_seconds = parse_number(next_field(fields));
+    progress.original_url = string(next_field(fields));
+    this->progress_callback(progress);
+}
+
+void YtDLPOutputParser::parse_postprocess(string_view fields)
+{
+    if (!this->postprocess_callback)
+        return;
+
+    YtDLPPostprocess postprocess;
+    postprocess.status = string(next_field(fields));
+    postprocess.postprocessor = string(next_field(fields));
+    postprocess.original_url = string(next_field(fields));
+    this->postprocess_callback(postprocess);
+}
+
+void YtDLPOutputParser::parse_file_ready(string_view fields)
+{
+    YtDLPFileReady ready;
+    ready.original_url = string(next_field(fields));
+    if (fields.empty())
+    {
+        if (this->log_callback)
+            this->log_callback(ready.original_url);
+        return;
+    }
+    ready.path = filesystem::absolute(filesystem::path(fields));
+    if (this->file_ready_callback)
+        this->file_ready_callback(ready);
+}
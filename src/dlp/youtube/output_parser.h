@@ -0,0 +1,80 @@
+#pragma once
+#ifndef OUTPUT_PARSER_H
+#define OUTPUT_PARSER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../../utils/process_runner.h"
+
+struct YtDLPVideoInfo
+{
+    std::string original_url;
+    std::string id;
+    std::string title;
+    std::optional<double> duration_seconds;
+    std::optional<std::string> acodec; // of the selected format, e.g. "opus" or "mp4a.40.2"
+};
+
+struct YtDLPProgress
+{
+    std::string original_url;
+    std::string status; // "downloading", "finished" or "error"
+    uint64_t downloaded_bytes = 0;
+    std::optional<uint64_t> total_bytes; // exact when known, yt-dlp's estimate otherwise
+    std::optional<double> speed;         // bytes per second
+    std::optional<double> eta_seconds;
+};
+
+struct YtDLPPostprocess
+{
+    std::string original_url;
+    std::string status;        // "started", "processing" or "finished"
+    std::string postprocessor; // e.g. "ExtractAudio", "MoveFiles"
+};
+
+struct YtDLPFileReady
+{
+    std::string original_url;
+    std::filesystem::path path; // final file, after post-processing and moving
+};
+
+// Asks yt-dlp for one tab separated record per stdout line (through --print and --progress-template) and
+// decodes them as they stream in, so nothing depends on yt-dlp's human readable log and no output is kept.
+class YtDLPOutputParser
+{
+public:
+    // appended to the yt-dlp arguments, they imply --quiet so stdout carries little besides the records
+    static std::vector<std::string> arguments();
+
+    void on_info(std::function<void(const YtDLPVideoInfo &)> callback);
+    void on_progress(std::function<void(const YtDLPProgress &)> callback);
+    void on_postprocess(std::function<void(const YtDLPPostprocess &)> callback);
+    void on_file_ready(std::function<void(const YtDLPFileReady &)> callback);
+    void on_log(LineCallback callback); // stdout lines that are not records
+
+    void feed(std::string_view line); // one stdout line without its newline
+
+private:
+    static constexpr std::string_view INFO_RECORD = "spotify-dlp:info\t";               // url, {id, title, duration, acodec} as JSON
+    static constexpr std::string_view PROGRESS_RECORD = "spotify-dlp:progress\t";       // status, bytes, total, speed, eta, url
+    static constexpr std::string_view POSTPROCESS_RECORD = "spotify-dlp:postprocess\t"; // status, postprocessor, url
+    static constexpr std::string_view FILE_RECORD = "spotify-dlp:done\t";               // url, path
+
+    void parse_info(std::string_view fields);
+    void parse_progress(std::string_view fields);
+    void parse_postprocess(std::string_view fields);
+    void parse_file_ready(std::string_view fields);
+
+    std::function<void(const YtDLPVideoInfo &)> info_callback;
+    std::function<void(const YtDLPProgress &)> progress_callback;
+    std::function<void(const YtDLPPostprocess &)> postprocess_callback;
+    std::function<void(const YtDLPFileReady &)> file_ready_callback;
+    LineCallback log_callback;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+#include "playlist_sync.h"
+#include "../../utils/logger.h"
+
+using namespace std;
+using namespace nlohmann;
+
+string PlaylistSyncReport::summary() const
+{
+    string title = this->name.empty() ? this->playlist_id : this->name + " (" + this->playlist_id + ")";
+    if (this->unchanged)
+        return "Playlist " + title + " unchanged since snapshot " + this->snapshot_id +
+               (this->pending.empty() ? "" : ", " + to_string(this->pending.size()) + " pending") + "\n";
+
+    string report = "Playlist " + title + ": " + to_string(this->diff.added.size()) + " added, " +
+                    to_string(this->diff.removed.size()) + " removed, " + to_string(this->downloaded.size()) +
+                    " downloaded, " + to_string(this->failures.size()) + " failed, " + to_string(this->pending.size()) +
+                    " pending, " + to_string(this->abandoned.size()) + " given up\n";
+    for (const auto &track : this->diff.added)
+    {
+        string artists;
+        for (const auto &artist : track.artists)
+            artists += (artists.empty() ? "" : ", ") + artist.name;
+        report += "+ " + track.name + (artists.empty() ? "" : " - " + artists) + " (" + track.id + ")\n";
+    }
+    for (const auto &track_id : this->diff.removed)
+        report += "- " + track_id + "\n";
+    for (const auto &failure : this->failures)
+        report += "! " + failure.url + ": " + failure.reason + "\n";
+    for (const auto &track_id : this->pending)
+        report += "? " + track_id + "\n";
+    for (const auto &track_id : this->abandoned)
+        report += "x " + track_id + "\n";
+    return report;
+}
+
+PlaylistSnapshotStore::PlaylistSnapshotStore(filesystem::path directory) : directory(move(directory))
+{
+    filesystem::create_directories(this->directory);
+}
+
+filesystem::path PlaylistSnapshotStore::path_for(const string &playlist_id) const
+{
+    return this->directory / (playlist_id + ".json");
+}
+
+optional<PlaylistSnapshot> PlaylistSnapshotStore::load(const string &playlist_id) const
+{
+    ifstream in(this->path_for(playlist_id));
+    if (!in)
+        return nullopt;
+
+    try
+    {
+        json entry = json::parse(in);
+        PlaylistSnapshot snapshot;
+        snapshot.playlist_id = entry.at("playlist_id").get<string>();
+        snapshot.snapshot_id = entry.at("snapshot_id").get<string>();
+        snapshot.track_ids = entry.at("track_ids").get<vector<string>>();
+        snapshot.synced_at = chrono::system_clock::time_point(chrono::seconds(entry.value("synced_at", int64_t(0))));
+        for (const auto &pending : entry.value("pending", json::array()))
+        {
+            snapshot.pending.push_back(PendingTrack{
+                .track_id = pending.at("track_id").get<string>(),
+                .attempts = pending.value("attempts", 1),
+                .last_attempt = chrono::system_clock::time_point(chrono::seconds(pending.value("last_attempt", int64_t(0))))});
+        }
+        return snapshot;
+    }
+    catch (const json::exception &e)
+    {
+        LOG_WARN("Ignoring unreadable playlist snapshot", "Ignoring unreadable snapshot " + this->path_for(playlist_id).string() + ": " + e.what());
+        return nullopt;
+    }
+}
+
+void PlaylistSnapshotStore::save(const PlaylistSnapshot &snapshot) const
+{
+    json pending = json::array();
+    for (const auto &track : snapshot.pending)
+    {
+        pending.push_back({{"track_id", track.track_id},
+                           {"attempts", track.attempts},
+                           {"last_attempt", chrono::duration_cast<chrono::seconds>(track.last_attempt.time_since_epoch()).count()}});
+    }
+    json entry = {
+        {"playlist_id", snapshot.playlist_id},
+        {"snapshot_id", snapshot.snapshot_id},
+        {"track_ids", snapshot.track_ids},
+        {"synced_at", chrono::duration_cast<chrono::seconds>(snapshot.synced_at.time_since_epoch()).count()},
+        {"pending", pending}};
+
+    filesystem::path destination = this->path_for(snapshot.playlist_id);
+    filesystem::path temp_path = destination;
+    temp_path.replace_extension("json.tmp");
+    {
+        ofstream out(temp_path, ios::trunc);
+        if (!(out << entry.dump() << '\n'))
+        {
+            string log = "Failed to write playlist snapshot.";
+            THROW_AND_LOG(runtime_error, log, log + " Path: " + temp_path.string());
+        }
+    }
+
+    error_code ec;
+    filesystem::rename(temp_path, destination, ec);
+    if (ec)
+    {
+        filesystem::remove(temp_path, ec);
+        string log = "Failed to move playlist snapshot into place.";
+        THROW_AND_LOG(runtime_error, log, log + " Path: " + destination.string());
+    }
+}
+
+PlaylistSnapshot PlaylistSnapshotStore::snapshot_of(const PlaylistMetadata &playlist, vector<PendingTrack> pending)
+{
+    PlaylistSnapshot snapshot{playlist.id, playlist.snapshot_id, {}, chrono::system_clock::now(), move(pending)};
+    unordered_map<string, size_t> pending_count;
+    for (const auto &track : snapshot.pending)
+        pending_count[track.track_id]++;
+
+    snapshot.track_ids.reserve(playlist.tracks.size());
+    for (const auto &track : playlist.tracks)
+    {
+        auto found = pending_count.find(track.id);
+        if (found != pending_count.end() && found->second > 0)
+            found->second--;
+        else
+            snapshot.track_ids.push_back(track.id);
+    }
+    return snapshot;
+}
+
+PlaylistDiff PlaylistSnapshotStore::diff(const optional<PlaylistSnapshot> &previous, const PlaylistMetadata &current)
+{
+    PlaylistDiff diff;
+
+    // how often each id was in the previous list and is still unclaimed by the current one
+    unordered_map<string, size_t> previous_count;
+    if (previous.has_value())
+    {
+        for (const auto &id : previous->track_ids)
+            previous_count[id]++;
+    }
+
+    unordered_map<string, size_t> current_count;
+    for (const auto &track : current.tracks)
+    {
+        current_count[track.id]++;
+        auto found = previous_count.find(track.id);
+        if (found != previous_count.end() && found->second > 0)
+            found->second--;
+        else
+            diff.added.push_back(track);
+    }
+
+    if (previous.has_value())
+    {
+        for (const auto &id : previous->track_ids)
+        {
+            auto found = current_count.find(id);
+            if (found != current_count.end() && found->second > 0)
+                found->second--;
+            else
+                diff.removed.push_back(id);
+        }
+    }
+    return diff;
+}
+
+PlaylistSync::PlaylistSync(const SpotifyAPI &api, Youtube &youtube, filesystem::path state_directory)
+    : api(api), youtube(youtube), store(move(state_directory))
+{
+}
+
+bool PlaylistSync::retry_due(const PlaylistSnapshot &previous, chrono::seconds retry_after)
+{
+    auto now = chrono::system_clock::now();
+    return any_of(previous.pending.begin(), previous.pending.end(), [&](const PendingTrack &track)
+                  { return now - track.last_attempt >= retry_after; });
+}
+
+vector<PendingTrack> PlaylistSync::next_pending(const vector<PendingTrack> &previous, const vector<string> &failed_ids,
+                                                vector<string> &abandoned)
+{
+    unordered_map<string, int> previous_attempts;
+    for (const auto &track : previous)
+        previous_attempts[track.track_id] = max(previous_attempts[track.track_id], track.attempts);
+
+    vector<PendingTrack> pending;
+    auto now = chrono::system_clock::now();
+    for (const auto &id : failed_ids)
+    {
+        auto found = previous_attempts.find(id);
+        int attempts = (found != previous_attempts.end() ? found->second : 0) + 1;
+        if (attempts >= MAX_PENDING_ATTEMPTS)
+            abandoned.push_back(id);
+        else
+            pending.push_back(PendingTrack{.track_id = id, .attempts = attempts, .last_attempt = now});
+    }
+    return pending;
+}
+
+PlaylistSyncReport PlaylistSync::sync(const string &playlist_url, const Deadline &deadline)
+{
+    SpotifyAPI::SpotifyItem item = SpotifyAPI::parse_url(playlist_url);
+    if (item.type != DownloadType::Playlist)
+    {
+        string log = "Only playlists can be synced";
+        THROW_AND_LOG(runtime_error, log, log + ", got " + playlist_url);
+    }
+
+    PlaylistSyncReport report;
+    report.playlist_id = item.id;
+
+    optional<PlaylistSnapshot> previous = this->store.load(report.playlist_id);
+    if (previous.has_value())
+        report.previous_snapshot_id = previous->snapshot_id;
+
+    if (previous.has_value() && !previous->snapshot_id.empty())
+    {
+        report.snapshot_id = this->api.get_playlist_snapshot_id(playlist_url, deadline);
+        // retrying before the no-match TTL passes would mostly get the cached answer again
+        if (report.snapshot_id == previous->snapshot_id && !retry_due(previous.value(), this->youtube.get_no_match_ttl()))
+        {
+            report.unchanged = true;
+            for (const auto &track : previous->pending)
+                report.pending.push_back(track.track_id);
+            LOG_INFO("Playlist unchanged, nothing to sync", "Playlist " + report.playlist_id + " is still at snapshot " + report.snapshot_id + ", skipping");
+            return report;
+        }
+    }
+
+    PlaylistMetadata playlist = get<PlaylistMetadata>(this->api.get_metadata(playlist_url, deadline));
+    report.name = playlist.name;
+    report.snapshot_id = playlist.snapshot_id;
+    report.diff = PlaylistSnapshotStore::diff(previous, playlist);
+    LOG_INFO("Syncing playlist {}", "Syncing playlist {}: {} added, {} removed since {}", playlist.name,
+             report.diff.added.size(), report.diff.removed.size(), report.previous_snapshot_id.value_or("the first sync"));
+
+    if (!report.diff.added.empty())
+    {
+        PlaylistMetadata additions = playlist;
+        additions.tracks = report.diff.added;
+        additions.total_tracks = static_cast<int>(additions.tracks.size());
+
+        report.downloaded = this->youtube.download(additions, deadline);
+        report.failures = this->youtube.get_failures();
+
+    }
+
+    vector<string> failed_ids;
+    const vector<TrackResult> &results = this->youtube.get_track_results();
+    for (size_t i = 0; i < report.diff.added.size(); i++)
+    {
+        if (i >= results.size() || !results[i].path.has_value())
+            failed_ids.push_back(report.diff.added[i].id);
+    }
+
+    vector<PendingTrack> pending = next_pending(previous.has_value() ? previous->pending : vector<PendingTrack>{}, failed_ids, report.abandoned);
+    for (const auto &track : pending)
+        report.pending.push_back(track.track_id);
+    this->store.save(PlaylistSnapshotStore::snapshot_of(playlist, move(pending)));
+
+    if (!failed_ids.empty())
+    {
+        LOG_WARN("Playlist sync incomplete, the missing tracks are tried again later", "Playlist " + playlist.id + " synced " + to_string(report.diff.added.size() - failed_ids.size()) + " of " + to_string(report.diff.added.size()) + " added tracks, " + to_string(report.pending.size()) + " stay pending, " + to_string(report.abandoned.size()) + " given up after " + to_string(MAX_PENDING_ATTEMPTS) + " attempts");
+    }
+    return report;
+}
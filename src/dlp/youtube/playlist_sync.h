@@ -0,0 +1,115 @@
+#pragma once
+#ifndef PLAYLIST_SYNC_H
+#define PLAYLIST_SYNC_H
+
+#ifdef BUILD_TEST
+#include <gtest/gtest.h>
+#endif
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include "../spotify/api.h"
+#include "../spotify/metadata.h"
+#include "../../utils/deadline.h"
+#include "youtube.h"
+
+// an added track that found no match or failed to download, tried again by later syncs
+struct PendingTrack
+{
+    std::string track_id;
+    int attempts = 1; // syncs in a row that tried it
+    std::chrono::system_clock::time_point last_attempt;
+};
+
+// what a playlist looked like after the last sync
+struct PlaylistSnapshot
+{
+    std::string playlist_id;
+    std::string snapshot_id;
+    std::vector<std::string> track_ids; // in playlist order, repeats kept, without the pending ones
+    std::chrono::system_clock::time_point synced_at;
+    // left out of track_ids, so the next full sync sees them as added again
+    std::vector<PendingTrack> pending = {};
+};
+
+struct PlaylistDiff
+{
+    std::vector<TrackMetadata> added;  // in playlist order
+    std::vector<std::string> removed;  // track ids, in the previous order
+
+    bool empty() const { return added.empty() && removed.empty(); }
+};
+
+struct PlaylistSyncReport
+{
+    std::string playlist_id;
+    std::string name;                                // empty when the playlist was unchanged and never fetched
+    std::optional<std::string> previous_snapshot_id; // std::nullopt on the first sync
+    std::string snapshot_id;
+    bool unchanged = false; // snapshot_id matched and no pending track was due, nothing was fetched or downloaded
+    PlaylistDiff diff;
+    DownloadPaths downloaded;
+    std::vector<DownloadFailure> failures;
+    std::vector<std::string> pending;   // ids of the added tracks that were not downloaded, tried again later
+    std::vector<std::string> abandoned; // ids of the tracks that stayed pending for MAX_PENDING_ATTEMPTS syncs, no longer tried
+
+    std::string summary() const; // human readable, one line per added or removed track
+};
+
+// One JSON file per playlist under a state directory, written to a temporary file and renamed into place.
+class PlaylistSnapshotStore
+{
+public:
+    explicit PlaylistSnapshotStore(std::filesystem::path directory);
+
+    std::optional<PlaylistSnapshot> load(const std::string &playlist_id) const; // std::nullopt when missing or unreadable
+    void save(const PlaylistSnapshot &snapshot) const;                          // throws runtime_error when it cannot be written
+
+    // every pending track takes one occurrence of its id out of track_ids
+    static PlaylistSnapshot snapshot_of(const PlaylistMetadata &playlist, std::vector<PendingTrack> pending = {});
+    // counts repeats, so a track added a second time shows up as added once more
+    static PlaylistDiff diff(const std::optional<PlaylistSnapshot> &previous, const PlaylistMetadata &current);
+
+private:
+    std::filesystem::path path_for(const std::string &playlist_id) const;
+
+    std::filesystem::path directory;
+};
+
+// Mirrors playlists incrementally. The playlist's snapshot_id is asked for first and, when it matches the one stored
+// by the last sync, nothing else is done. Otherwise the full playlist is fetched and only the tracks added since then,
+// plus the pending ones, go through Youtube::download; removed tracks are reported, their files are left alone.
+// The snapshot is stored even when some tracks fail, only those stay pending. Pending tracks are retried with the next
+// full sync, and force one of their own only once the no-match TTL has passed since their last try, when a search
+// could give a different answer. After MAX_PENDING_ATTEMPTS tries a track is given up.
+class PlaylistSync
+{
+#ifdef BUILD_TEST
+    FRIEND_TEST(PlaylistSyncTest, PendingTracksAreRetriedOnceDue);
+    FRIEND_TEST(PlaylistSyncTest, PendingTracksAreGivenUpAfterMaxAttempts);
+#endif
+
+public:
+    static constexpr int MAX_PENDING_ATTEMPTS = 3;
+
+    PlaylistSync(const SpotifyAPI &api, Youtube &youtube, std::filesystem::path state_directory);
+
+    // throws DeadlineExceeded and, when Spotify cannot be reached, runtime_error; download failures end up in the report
+    PlaylistSyncReport sync(const std::string &playlist_url, const Deadline &deadline = Deadline());
+
+private:
+    static bool retry_due(const PlaylistSnapshot &previous, std::chrono::seconds retry_after);
+    // the pending list after a sync in which failed_ids were not downloaded, counting on from the previous attempts;
+    // the ones out of attempts are added to abandoned instead
+    static std::vector<PendingTrack> next_pending(const std::vector<PendingTrack> &previous, const std::vector<std::string> &failed_ids,
+                                                  std::vector<std::string> &abandoned);
+
+    const SpotifyAPI &api;
+    Youtube &youtube;
+    PlaylistSnapshotStore store;
+};
+
+#endif
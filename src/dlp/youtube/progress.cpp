@@ -0,0 +1,23 @@
+#include "progress.h"
+
+using namespace std;
+
+ProgressThrottle::ProgressThrottle(chrono::milliseconds interval) : interval(interval)
+{
+}
+
+bool ProgressThrottle::admit(const DownloadProgressEvent &event, chrono::steady_clock::time_point now)
+{
+    // only yt-dlp's own "finished", total_bytes may be an estimate that the transfer passes long before it ends
+    bool always = event.phase != DownloadPhase::Downloading || event.transfer_finished;
+    bool changed = event.url != this->last_url || event.phase != this->last_phase;
+
+    if (!always && !changed && now - this->last_emitted < this->interval)
+        return false;
+
+    if (event.url != this->last_url)
+        this->last_url = event.url;
+    this->last_phase = event.phase;
+    this->last_emitted = now;
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include "../../utils/lock_free_queue.h"
+
+enum class DownloadPhase
+{
+    Downloading,
+    PostProcessing, // ffmpeg extraction/conversion after the transfer
+    Finished,
+    Failed,
+};
+
+struct DownloadProgressEvent
+{
+    std::string url;
+    DownloadPhase phase = DownloadPhase::Downloading;
+    uint64_t downloaded_bytes = 0;
+    std::optional<uint64_t> total_bytes; // exact when known, yt-dlp's estimate otherwise
+    std::optional<double> speed;         // bytes per second
+    std::optional<double> eta_seconds;
+    bool transfer_finished = false; // yt-dlp reported the transfer as finished, the last Downloading event of a url
+    std::string postprocessor; // yt-dlp post-processor name while post-processing, e.g. "ExtractAudio"
+};
+
+// Called from the download threads, possibly several at once, so it should be cheap and thread-safe.
+// To hand events to another thread without locking, push them into a ProgressQueue from the callback.
+using ProgressCallback = std::function<void(const DownloadProgressEvent &event)>;
+using ProgressQueue = LockFreeQueue<DownloadProgressEvent>;
+
+// Rate limits the progress of one job (one yt-dlp process): Downloading events pass at most once per interval,
+// while the first event of a url, every phase change, the finished transfer and Finished/Failed always pass.
+class ProgressThrottle
+{
+public:
+    explicit ProgressThrottle(std::chrono::milliseconds interval);
+
+    bool admit(const DownloadProgressEvent &event, std::chrono::steady_clock::time_point now);
+
+private:
+    std::chrono::milliseconds interval;
+    std::string last_url;
+    std::optional<DownloadPhase> last_phase;
+    std::chrono::steady_clock::time_point last_emitted;
+};
+
+#endif
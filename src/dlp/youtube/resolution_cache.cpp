@@ -0,0 +1,308 @@
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include "resolution_cache.h"
+#include "../../utils/file_lock.h"
+#include "../../utils/logger.h"
+
+using namespace std;
+using namespace nlohmann;
+
+ResolutionCache::ResolutionCache(filesystem::path path, chrono::seconds no_match_ttl)
+    : path(move(path)), lock_path(filesystem::path(this->path).concat(".lock")), no_match_ttl(no_match_ttl)
+{
+    if (this->path.has_parent_path())
+    {
+        filesystem::create_directories(this->path.parent_path());
+    }
+
+    // other processes append nothing while the log is read and compacted, so none of their lines are lost
+    FileLock file_lock(this->lock_path);
+    size_t lines_read = 0;
+    size_t loaded = this->load(this->path, false, &lines_read);
+    LOG_INFO("Loaded resolution cache", "Loaded " + to_string(loaded) + " cached resolutions from " + this->path.string());
+
+    lock_guard<std::mutex> lock(this->mutex);
+    // superseded lines, expired misses and malformed lines only make the next load slower
+    if (lines_read > this->by_track_id.size() || any_of(this->by_track_id.begin(), this->by_track_id.end(), [this](const auto &entry)
+                                                         { return !this->is_live(entry.second); }))
+    {
+        this->compact();
+    }
+    this->open_log();
+}
+
+bool ResolutionCache::is_live(const Resolution &resolution) const
+{
+    if (resolution.video_id.has_value())
+        return true;
+    return chrono::system_clock::now() - resolution.resolved_at < this->no_match_ttl;
+}
+
+optional<Resolution> ResolutionCache::lookup(const TrackMetadata &track) const
+{
+    lock_guard<std::mutex> lock(this->mutex);
+
+    auto found = this->by_track_id.find(track.id);
+    if (found == this->by_track_id.end() && track.isrc.has_value())
+    {
+        auto by_isrc = this->track_id_by_isrc.find(track.isrc.value());
+        if (by_isrc != this->track_id_by_isrc.end())
+            found = this->by_track_id.find(by_isrc->second);
+    }
+
+    if (found == this->by_track_id.end() || !this->is_live(found->second))
+        return nullopt;
+
+    return found->second;
+}
+
+void ResolutionCache::store(const Resolution &resolution)
+{
+    string line = to_jsonl(resolution);
+
+    FileLock file_lock(this->lock_path);
+    lock_guard<std::mutex> lock(this->mutex);
+    this->index(resolution);
+    this->append_to_log(line);
+}
+
+size_t ResolutionCache::import_jsonl(const filesystem::path &source)
+{
+    FileLock file_lock(this->lock_path);
+    size_t imported = this->load(source, true);
+    LOG_INFO("Imported resolutions", "Imported " + to_string(imported) + " resolutions from " + source.string());
+    return imported;
+}
+
+size_t ResolutionCache::export_jsonl(const filesystem::path &destination) const
+{
+    lock_guard<std::mutex> lock(this->mutex);
+
+    ofstream out(destination, ios::trunc);
+    if (!out)
+    {
+        string log = "Failed to open resolution export file.";
+        THROW_AND_LOG(runtime_error, log, log + " Path: " + destination.string());
+    }
+
+    size_t exported = 0;
+    for (const auto &[track_id, resolution] : this->by_track_id)
+    {
+        if (!this->is_live(resolution))
+            continue;
+        out << to_jsonl(resolution) << '\n';
+        exported++;
+    }
+    return exported;
+}
+
+size_t ResolutionCache::size() const
+{
+    lock_guard<std::mutex> lock(this->mutex);
+    return this->by_track_id.size();
+}
+
+void ResolutionCache::index(const Resolution &resolution)
+{
+    this->by_track_id[resolution.track_id] = resolution;
+    if (resolution.isrc.has_value())
+        this->track_id_by_isrc[resolution.isrc.value()] = resolution.track_id;
+}
+
+size_t ResolutionCache::load(const filesystem::path &source, bool append_to_log, size_t *lines_read)
+{
+    ifstream in(source);
+    if (!in)
+        return 0;
+
+    lock_guard<std::mutex> lock(this->mutex);
+
+    size_t loaded = 0;
+    string line;
+    while (getline(in, line))
+    {
+        if (line.empty())
+            continue;
+        if (lines_read)
+            (*lines_read)++;
+
+        optional<Resolution> resolution = from_jsonl(line);
+        if (!resolution.has_value())
+        {
+            LOG_WARN("Skipping malformed resolution cache line", "Skipping malformed line in " + source.string() + ": " + line);
+            continue;
+        }
+
+        this->index(resolution.value());
+        if (append_to_log)
+            this->append_to_log(line);
+        loaded++;
+    }
+    return loaded;
+}
+
+void ResolutionCache::compact()
+{
+    for (auto it = this->by_track_id.begin(); it != this->by_track_id.end();)
+    {
+        if (this->is_live(it->second))
+        {
+            ++it;
+            continue;
+        }
+        if (it->second.isrc.has_value())
+        {
+            auto by_isrc = this->track_id_by_isrc.find(it->second.isrc.value());
+            if (by_isrc != this->track_id_by_isrc.end() && by_isrc->second == it->first)
+                this->track_id_by_isrc.erase(by_isrc);
+        }
+        it = this->by_track_id.erase(it);
+    }
+
+    string contents;
+    for (const auto &[track_id, resolution] : this->by_track_id)
+        contents += to_jsonl(resolution) + '\n';
+
+#ifdef _WIN32
+    filesystem::path temp_path = this->path;
+    temp_path += ".tmp";
+    {
+        ofstream out(temp_path, ios::trunc);
+        out << contents;
+        if (!out)
+        {
+            LOG_WARN("Could not compact resolution cache", "Could not write compacted resolution cache to " + temp_path.string());
+            return;
+        }
+    }
+#else
+    // unique per writer, so processes opening the cache together never write into each other's temp file
+    string temp_template = this->path.string() + ".XXXXXX";
+    int fd = mkostemp(temp_template.data(), O_CLOEXEC);
+    if (fd == -1)
+    {
+        LOG_WARN("Could not compact resolution cache", "Could not create a temporary file next to " + this->path.string() + ": " + strerror(errno));
+        return;
+    }
+
+    // mkostemp creates it 0600, the compacted log keeps the permissions of the one it replaces
+    struct stat current;
+    bool written = stat(this->path.c_str(), &current) != 0 || fchmod(fd, current.st_mode & 07777) == 0;
+    for (size_t offset = 0; written && offset < contents.size();)
+    {
+        ssize_t n = write(fd, contents.data() + offset, contents.size() - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        written = n > 0;
+        if (written)
+            offset += static_cast<size_t>(n);
+    }
+    if (close(fd) != 0 || !written)
+    {
+        unlink(temp_template.c_str());
+        LOG_WARN("Could not compact resolution cache", "Could not write compacted resolution cache to " + temp_template);
+        return;
+    }
+    filesystem::path temp_path = temp_template;
+#endif
+
+    error_code ec;
+    filesystem::rename(temp_path, this->path, ec);
+    if (ec)
+    {
+        filesystem::remove(temp_path, ec);
+        LOG_WARN("Could not compact resolution cache", "Could not move compacted resolution cache into place at " + this->path.string() + ": " + ec.message());
+        return;
+    }
+    LOG_DEBUG("Compacted resolution cache", "Compacted resolution cache at " + this->path.string() + " to " + to_string(this->by_track_id.size()) + " entries");
+}
+
+void ResolutionCache::open_log()
+{
+    this->log.close();
+    this->log.clear();
+    this->log.open(this->path, ios::app);
+    if (!this->log)
+    {
+        LOG_WARN("Could not open resolution cache", "Could not open resolution cache at " + this->path.string() + " for appending, resolutions will not be persisted");
+        return;
+    }
+#ifndef _WIN32
+    struct stat opened;
+    if (stat(this->path.c_str(), &opened) == 0)
+    {
+        this->log_device = static_cast<uint64_t>(opened.st_dev);
+        this->log_inode = static_cast<uint64_t>(opened.st_ino);
+    }
+#endif
+}
+
+bool ResolutionCache::log_replaced() const
+{
+#ifdef _WIN32
+    return false; // a file that is open cannot be renamed over
+#else
+    struct stat current;
+    return stat(this->path.c_str(), &current) != 0 || static_cast<uint64_t>(current.st_dev) != this->log_device ||
+           static_cast<uint64_t>(current.st_ino) != this->log_inode;
+#endif
+}
+
+void ResolutionCache::append_to_log(const string &line)
+{
+    // after another process compacted the log, lines written to the old file would be lost with it
+    if (this->log.is_open() && this->log_replaced())
+        this->open_log();
+    if (!this->log)
+        return;
+
+    // one write per line so concurrent appenders never interleave inside an entry
+    this->log << line + '\n';
+    this->log.flush();
+    if (!this->log)
+    {
+        LOG_WARN("Could not write resolution cache", "Could not append to resolution cache at " + this->path.string());
+    }
+}
+
+string ResolutionCache::to_jsonl(const Resolution &resolution)
+{
+    json entry = {
+        {"track_id", resolution.track_id},
+        {"isrc", resolution.isrc.has_value() ? json(resolution.isrc.value()) : json(nullptr)},
+        {"video_id", resolution.video_id.has_value() ? json(resolution.video_id.value()) : json(nullptr)},
+        {"score", resolution.score},
+        {"resolved_at", chrono::duration_cast<chrono::seconds>(resolution.resolved_at.time_since_epoch()).count()}};
+    return entry.dump();
+}
+
+optional<Resolution> ResolutionCache::from_jsonl(const string &line)
+{
+    try
+    {
+        json entry = json::parse(line);
+
+        Resolution resolution;
+        resolution.track_id = entry.at("track_id").get<string>();
+        if (entry.contains("isrc") && entry["isrc"].is_string())
+            resolution.isrc = entry["isrc"].get<string>();
+        if (entry.contains("video_id") && entry["video_id"].is_string())
+            resolution.video_id = entry["video_id"].get<string>();
+        resolution.score = entry.value("score", 0.0);
+        resolution.resolved_at = chrono::system_clock::time_point(chrono::seconds(entry.value("resolved_at", int64_t(0))));
+        return resolution;
+    }
+    catch (const json::exception &)
+    {
+        return nullopt;
+    }
+}
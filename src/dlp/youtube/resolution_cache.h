@@ -0,0 +1,70 @@
+#pragma once
+#ifndef RESOLUTION_CACHE_H
+#define RESOLUTION_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "../spotify/metadata.h"
+
+struct Resolution
+{
+    std::string track_id;
+    std::optional<std::string> isrc;
+    std::optional<std::string> video_id; // std::nullopt when no acceptable match was found
+    double score;
+    std::chrono::system_clock::time_point resolved_at;
+};
+
+// Persistent map from Spotify track to the YouTube video we picked for it, so popular tracks
+// are only searched once across playlists and runs. Tracks are keyed by Spotify ID with the ISRC as a
+// secondary key, matches never expire while "no match" entries are only trusted for no_match_ttl.
+//
+// The file is an append-only JSONL log (one Resolution per line, later lines win) which doubles as
+// the import/export format for seeding other nodes. It is compacted to the live entries when opened.
+// Several processes may share the file: reading and compacting it, and every append, happen under an flock on
+// <path>.lock, and an instance whose log was compacted by another one reopens it before its next append.
+class ResolutionCache
+{
+public:
+    ResolutionCache(std::filesystem::path path, std::chrono::seconds no_match_ttl);
+
+    std::optional<Resolution> lookup(const TrackMetadata &track) const;
+    void store(const Resolution &resolution);
+
+    // both return the number of entries read/written
+    size_t import_jsonl(const std::filesystem::path &source);
+    size_t export_jsonl(const std::filesystem::path &destination) const;
+
+    size_t size() const;
+
+private:
+    bool is_live(const Resolution &resolution) const;
+    void index(const Resolution &resolution);
+    size_t load(const std::filesystem::path &source, bool append_to_log, size_t *lines_read = nullptr);
+    void compact(); // callers hold the mutex and the file lock, before the log is opened
+    void open_log();
+    bool log_replaced() const; // the file at path is no longer the one log writes to
+    void append_to_log(const std::string &line); // callers hold the file lock
+
+    static std::string to_jsonl(const Resolution &resolution);
+    static std::optional<Resolution> from_jsonl(const std::string &line);
+
+    std::filesystem::path path;
+    std::filesystem::path lock_path;
+    std::chrono::seconds no_match_ttl;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Resolution> by_track_id;
+    std::unordered_map<std::string, std::string> track_id_by_isrc;
+    std::ofstream log; // kept open for appending, every line is flushed as it is written
+    uint64_t log_device = 0; // identity of the opened file, POSIX only
+    uint64_t log_inode = 0;
+};
+
+#endif
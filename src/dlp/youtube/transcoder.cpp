@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cctype>
+#include "transcoder.h"
+#include "../../utils/logger.h"
+#include "../../utils/process_runner.h"
+
+using namespace std;
+
+namespace
+{
+    string lowercase_extension(const filesystem::path &path)
+    {
+        string extension = path.extension().string();
+        if (!extension.empty() && extension[0] == '.')
+            extension.erase(0, 1);
+        transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                  { return static_cast<char>(tolower(c)); });
+        return extension;
+    }
+}
+
+Transcoder::Transcoder(filesystem::path ffmpeg_path) : ffmpeg_path(move(ffmpeg_path)) {}
+
+optional<TranscodeTarget> Transcoder::target_for(DownloadFileType type)
+{
+    // codecs and quality scales follow yt-dlp's FFmpegExtractAudioPP so files match what -x produced
+    switch (type)
+    {
+    case DownloadFileType::MP3:
+        return TranscodeTarget{"mp3", "mp3", "libmp3lame", true, pair(10.0, 0.0), "mp3"};
+    case DownloadFileType::M4A:
+        return TranscodeTarget{"m4a", "ipod", "aac", true, pair(0.1, 4.0), "mp4a"};
+    case DownloadFileType::AAC:
+        return TranscodeTarget{"aac", "adts", "aac", true, pair(0.1, 4.0), "mp4a"};
+    case DownloadFileType::OPUS:
+        return TranscodeTarget{"opus", "opus", "libopus", true, nullopt, "opus"};
+    case DownloadFileType::VORBIS:
+        return TranscodeTarget{"ogg", "ogg", "libvorbis", true, pair(0.0, 10.0), "vorbis"};
+    case DownloadFileType::WAV:
+        return TranscodeTarget{"wav", "wav", "", true, nullopt, ""};
+    case DownloadFileType::ALAC:
+        return TranscodeTarget{"m4a", "ipod", "alac", false, nullopt, ""};
+    case DownloadFileType::FLAC:
+        return TranscodeTarget{"flac", "flac", "flac", true, nullopt, ""};
+    case DownloadFileType::BEST:
+    default:
+        return nullopt;
+    }
+}
+
+filesystem::path Transcoder::destination_for(const filesystem::path &source, const TranscodeTarget &target)
+{
+    filesystem::path destination = source;
+    destination.replace_extension(target.extension);
+    return destination;
+}
+
+string Transcoder::format_selector(const TranscodeTarget &target)
+{
+    if (target.native_codec.empty())
+        return "bestaudio/best";
+    return "bestaudio[acodec^=" + target.native_codec + "]/bestaudio/best";
+}
+
+TranscodeMode Transcoder::mode_for(const FetchedAudio &fetched, const TranscodeTarget &target)
+{
+    bool target_extension = lowercase_extension(fetched.path) == target.extension;
+    if (!fetched.acodec.has_value())
+        return target_extension && target.extension_implies_codec ? TranscodeMode::Keep : TranscodeMode::Encode;
+
+    bool target_codec = !target.native_codec.empty() && fetched.acodec->rfind(target.native_codec, 0) == 0;
+    if (!target_codec)
+        return TranscodeMode::Encode;
+    return target_extension ? TranscodeMode::Keep : TranscodeMode::Remux;
+}
+
+vector<string> Transcoder::arguments(const filesystem::path &source, const filesystem::path &output,
+                                     const TranscodeTarget &target, TranscodeMode mode, int audio_quality) const
+{
+    vector<string> args = {this->ffmpeg_path.string(), "-nostdin", "-hide_banner", "-loglevel", "error", "-y",
+                           "-i", source.string(), "-vn"};
+
+    if (mode == TranscodeMode::Remux)
+    {
+        args.insert(args.end(), {"-c:a", "copy"});
+    }
+    else if (!target.codec.empty())
+    {
+        args.insert(args.end(), {"-c:a", target.codec});
+    }
+
+    if (mode == TranscodeMode::Encode && audio_quality >= 0 && target.quality_range.has_value())
+    {
+        auto [worst, best] = target.quality_range.value();
+        double quality = best + (worst - best) * (min(audio_quality, 10) / 10.0);
+        args.insert(args.end(), {"-q:a", fmt::format("{:g}", quality)});
+    }
+
+    args.insert(args.end(), {"-f", target.muxer, output.string()});
+    return args;
+}
+
+filesystem::path Transcoder::transcode(const FetchedAudio &fetched, const TranscodeTarget &target, int audio_quality,
+                                       const Deadline &deadline) const
+{
+    TranscodeMode mode = mode_for(fetched, target);
+    const filesystem::path &source = fetched.path;
+    if (mode == TranscodeMode::Keep)
+        return source;
+
+    filesystem::path destination = destination_for(source, target);
+    filesystem::path temp_path = destination;
+    temp_path.replace_extension("temp." + target.extension);
+
+    string error; // ffmpeg only prints errors at this log level
+    ProcessRunner runner(this->arguments(source, temp_path, target, mode, audio_quality));
+    runner.capture_output(false);
+    runner.set_deadline(deadline);
+    runner.on_stderr_line([&error](string_view line)
+                          {
+        LOG_DEBUG("{}", "{}", line);
+        if (error.empty())
+            error = string(line); });
+
+    ProcessResult process = runner.run();
+
+    error_code ec;
+    if (process.deadline_exceeded)
+    {
+        filesystem::remove(temp_path, ec);
+        deadline.check("Transcode of " + source.string());
+    }
+
+    if (process.exit_code != 0)
+    {
+        filesystem::remove(temp_path, ec);
+        string log = "Failed to transcode " + source.filename().string() + " to " + target.extension;
+        if (error.empty())
+            error = "ffmpeg exited with code " + to_string(process.exit_code);
+        THROW_AND_LOG(runtime_error, log, log + ": " + error);
+    }
+
+    error_code rename_error;
+    filesystem::rename(temp_path, destination, rename_error);
+    if (rename_error)
+    {
+        filesystem::remove(temp_path, ec);
+        string log = "Failed to move transcoded file into place";
+        THROW_AND_LOG(runtime_error, log, log + ": " + destination.string() + " " + rename_error.message());
+    }
+
+    if (destination != source)
+        filesystem::remove(source, ec);
+    return destination;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#ifndef TRANSCODER_H
+#define TRANSCODER_H
+
+#ifdef BUILD_TEST
+#include <gtest/gtest.h>
+#endif
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include "../../../include/spotify-dlp.h"
+#include "../../utils/deadline.h"
+
+struct TranscodeTarget
+{
+    std::string extension;        // of the converted file, without the dot
+    std::string muxer;            // ffmpeg -f, the temporary output name says nothing about the container
+    std::string codec;            // ffmpeg -c:a, empty leaves the muxer's default
+    bool extension_implies_codec; // false when the container holds other codecs too (ALAC in .m4a)
+    // ffmpeg -q:a at audio quality 10 and at 0, as yt-dlp maps --audio-quality; std::nullopt when the codec has no VBR scale
+    std::optional<std::pair<double, double>> quality_range;
+    // prefix of yt-dlp's acodec for streams already in the target codec ("mp4a" matches "mp4a.40.2"),
+    // empty when YouTube never serves it
+    std::string native_codec;
+};
+
+struct FetchedAudio
+{
+    std::filesystem::path path;
+    std::optional<std::string> acodec; // as yt-dlp reports the downloaded format, std::nullopt when it did not say
+};
+
+enum class TranscodeMode
+{
+    Keep,   // already the target format
+    Remux,  // right codec in another container, the stream is copied (-c:a copy)
+    Encode, // decoded and encoded again, the only CPU-heavy case
+};
+
+// Converts a downloaded audio stream to a DownloadFileType with ffmpeg, the CPU-bound half of what yt-dlp's -x
+// does inline. Kept separate so downloads never wait on a conversion; see YtDLP::transcode for the pool.
+class Transcoder
+{
+#ifdef BUILD_TEST
+    FRIEND_TEST(TranscoderTest, ArgumentsFollowYtDLPQualityScale);
+#endif
+
+public:
+    explicit Transcoder(std::filesystem::path ffmpeg_path = "ffmpeg");
+
+    // std::nullopt for BEST, whatever stream was downloaded is kept
+    static std::optional<TranscodeTarget> target_for(DownloadFileType type);
+    // yt-dlp -f expression preferring a stream already in the target codec, so most downloads need no encode
+    static std::string format_selector(const TranscodeTarget &target);
+    static std::filesystem::path destination_for(const std::filesystem::path &source, const TranscodeTarget &target);
+    // decided from the reported codec, or from the extension alone when yt-dlp did not report one
+    static TranscodeMode mode_for(const FetchedAudio &fetched, const TranscodeTarget &target);
+
+    // Writes the converted file next to the fetched one under a temporary name, renames it into place and removes
+    // the fetched file; Keep returns it untouched. audio_quality is DownloadConfig::audio_quality, -1 for ffmpeg's
+    // default. Throws runtime_error when ffmpeg fails (the fetched file is left alone) and DeadlineExceeded when it
+    // was stopped for the deadline.
+    std::filesystem::path transcode(const FetchedAudio &fetched, const TranscodeTarget &target, int audio_quality,
+                                    const Deadline &deadline = Deadline()) const;
+
+private:
+    std::vector<std::string> arguments(const std::filesystem::path &source, const std::filesystem::path &output,
+                                       const TranscodeTarget &target, TranscodeMode mode, int audio_quality) const;
+
+    std::filesystem::path ffmpeg_path;
+};
+
+#endif
@@ -1,12 +1,37 @@
+#include <future>
 #include <stdexcept>
+#include <optional>
 #include "youtube.h"
+#include "edit_distance.h"
 #include "../../utils/curl_utils.h"
 #include "../../utils/logger.h"
+#include "../../utils/worker_pool.h"
 
 using namespace std;
 
 Youtube::Youtube(string yt_api_key, DownloadConfig config)
-    : query_builder(), queries(), api_key(yt_api_key), config(config), downloader() {};
+    : query_builder(), queries(), api_key(yt_api_key), normalizer(NORMALIZER_CACHE_CAPACITY), config(config), downloader(config.yt_dlp_in_memory ? YtDLPExecutionMode::Memory : YtDLPExecutionMode::Disk)
+{
+    if (config.resolution_cache_path != nullptr && strlen(config.resolution_cache_path) > 0)
+    {
+        this->resolution_cache = make_unique<ResolutionCache>(config.resolution_cache_path, this->get_no_match_ttl());
+    }
+}
+
+void Youtube::on_progress(ProgressCallback callback)
+{
+    this->downloader.on_progress(move(callback));
+}
+
+chrono::seconds Youtube::get_no_match_ttl() const
+{
+    return chrono::seconds(this->config.no_match_ttl_seconds > 0 ? this->config.no_match_ttl_seconds : DEFAULT_NO_MATCH_TTL_SECONDS);
+}
+
+ResolutionCache *Youtube::get_resolution_cache()
+{
+    return this->resolution_cache.get();
+}
 
 bool Youtube::is_track()
 {
@@ -23,20 +48,8 @@ bool Youtube::is_playlist()
     return holds_alternative<PlaylistMetadata>(this->metadata);
 }
 
-string Youtube::make_search_request(Query query)
+HttpRequest Youtube::build_search_request(const Query &query)
 {
-    LOG_INFO("Making search request", "Making search request for query" + query);
-    string response;
-
-    CurlGuard curl;
-
-    struct curl_slist *headers = nullptr;
-    headers = curl_slist_append(headers, "Accept: application/json");
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl.set_headers(headers);
-    string header_log = "Created search request headers";
-    LOG_INFO(header_log, header_log);
-
     string url = "https://youtube.googleapis.com/youtube/v3/search"
                  "?part=snippet"
                  "&q=" +
@@ -46,31 +59,9 @@ string Youtube::make_search_request(Query query)
                  "&key=" +
                  api_key;
 
-    curl_easy_setopt(curl.get(), CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &response);
-    string body_log = "Created search request body, making request!";
-    LOG_INFO(body_log, body_log);
-
-    CURLcode res = curl_easy_perform(curl.get());
-    if (res != CURLE_OK)
-    {
-        long http_code = 0;
-        curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &http_code);
-
-        if (http_code == 429)
-        {
-            THROW_AND_LOG(RateLimitException,
-                          "YouTube API rate limit exceeded",
-                          "Received 429 Too Many Requests from YouTube API");
-        }
-
-        THROW_AND_LOG(CurlException,
-                      "CURL request failed: " + string(curl_easy_strerror(res)),
-                      "YouTube API request failed with code: " + to_string(res));
-    }
-
-    return response;
+    return HttpRequest{
+        .url = url,
+        .headers = {"Accept: application/json", "Content-Type: application/json"}};
 }
 
 string Youtube::url_encode(const string &decoded)
@@ -81,7 +72,7 @@ string Youtube::url_encode(const string &decoded)
     return result;
 }
 
-vector<SearchResult> Youtube::parse_response(const string &response)
+vector<SearchResult> Youtube::parse_response(const string &response, const MatchContext &context)
 {
     vector<SearchResult> results;
     auto json = nlohmann::json::parse(response);
@@ -97,21 +88,16 @@ vector<SearchResult> Youtube::parse_response(const string &response)
         result.video_id = item["id"]["videoId"];
         result.title = item["snippet"]["title"];
         result.artist = item["snippet"]["channelTitle"];
-        result.score = calculate_match_score(result);
+        result.score = 0.0;
         results.push_back(result);
     }
 
-    // Sort results by score in descending order
-    sort(results.begin(), results.end(),
-         [](const SearchResult &a, const SearchResult &b)
-         {
-             return a.score > b.score;
-         });
-
+    MatchScorer::score(context, results, this->normalizer);
+    MatchScorer::rank(results, RANKED_CANDIDATES);
     return results;
 }
 
-vector<SearchResult> Youtube::try_parse_response(const string &response) {
+optional<vector<SearchResult>> Youtube::try_parse_response(const string &response, const MatchContext &context) {
     vector<SearchResult> results;
     try {
         auto json = nlohmann::json::parse(response);
@@ -122,7 +108,7 @@ vector<SearchResult> Youtube::try_parse_response(const string &response) {
                 LOG_ERROR("YouTube API error", 
                     "Error details: " + json["error"].dump());
             }
-            return results; // Return empty results to trigger retry
+            return nullopt; // triggers a retry, and is never cached as a miss
         }
 
         for (const auto &item : json["items"]) {
@@ -130,101 +116,57 @@ vector<SearchResult> Youtube::try_parse_response(const string &response) {
             result.video_id = item["id"]["videoId"];
             result.title = item["snippet"]["title"];
             result.artist = item["snippet"]["channelTitle"];
-            result.score = calculate_match_score(result);
+            result.score = 0.0;
             results.push_back(result);
         }
-
-        sort(results.begin(), results.end(),
-             [](const SearchResult &a, const SearchResult &b) {
-                 return a.score > b.score;
-             });
     } 
     catch (const nlohmann::json::exception& e) {
         LOG_ERROR("JSON parsing error", 
             "Failed to parse response: " + string(e.what()) + "\nResponse: " + response);
+        return nullopt;
     }
+
+    MatchScorer::score(context, results, this->normalizer);
+    MatchScorer::rank(results, RANKED_CANDIDATES);
     return results;
 }
 
-void Youtube::sleep_between_retries(int retry_count) const {
-    std::this_thread::sleep_for(
-        std::chrono::milliseconds(RETRY_DELAY_MS * retry_count));
+chrono::milliseconds Youtube::retry_delay(int retry_count) const {
+    return chrono::milliseconds(RETRY_DELAY_MS * retry_count);
 }
 
-double Youtube::calculate_match_score(const SearchResult &result)
+MatchContext Youtube::make_match_context(const TrackMetadata &track)
 {
-    if (this->is_track())
-    {
-        return calculate_track_score(result, get<TrackMetadata>(metadata));
-    }
-    else if (this->is_album())
-    {
-        return calculate_album_score(result, get<AlbumMetadata>(metadata));
-    }
-    return calculate_playlist_score(result);
-}
-
-double Youtube::calculate_track_score(const SearchResult &result, const TrackMetadata &track)
-{
-    double score = 0.0;
-
-    // Title match (45%)
-    double title_score = calculate_title_similarity(
-        normalize_string(result.title),
-        normalize_string(track.name));
-    score += title_score * 0.45;
-
-    // Artist match (45%)
-    string track_artists = normalize_string(query_builder.join_artists(track.artists));
-    string result_artists = normalize_string(result.artist);
-    double artist_score = calculate_title_similarity(track_artists, result_artists);
-    score += artist_score * 0.45;
-
-    // Album match bonus (10%)
+    optional<MatchField> album;
     if (track.album_name.has_value())
-    {
-        double album_score = calculate_title_similarity(
-            normalize_string(result.title),
-            normalize_string(track.album_name.value()));
-        score += album_score * 0.10;
-    }
+        album.emplace(normalize_string(track.album_name.value()));
 
-    return score;
+    return TrackMatchContext{
+        .title = MatchField(normalize_string(track.name)),
+        .artists = MatchField(normalize_string(query_builder.join_artists(track.artists))),
+        .album = move(album)};
 }
 
-double Youtube::calculate_album_score(const SearchResult &result, const AlbumMetadata &album)
+MatchContext Youtube::make_match_context(const AlbumMetadata &album)
 {
-    double score = 0.0;
-
-    // Album title match (50%)
-    double title_score = calculate_title_similarity(
-        normalize_string(result.title),
-        normalize_string(album.name));
-    score += title_score * 0.50;
-
-    // Artist match (40%)
-    string album_artists = normalize_string(query_builder.join_artists(album.artists));
-    string result_artists = normalize_string(result.artist);
-    double artist_score = calculate_title_similarity(album_artists, result_artists);
-    score += artist_score * 0.40;
-
-    // Additional scoring for keywords suggesting it's an album (10%)
-    string normalized_title = normalize_string(result.title);
-    if (normalized_title.find("album") != string::npos ||
-        normalized_title.find("full album") != string::npos)
-    {
-        score += 0.10;
-    }
-
-    return score;
+    return AlbumMatchContext{
+        .name = MatchField(normalize_string(album.name)),
+        .artists = MatchField(normalize_string(query_builder.join_artists(album.artists)))};
 }
 
-double Youtube::calculate_playlist_score(const SearchResult &result)
+double Youtube::calculate_match_score(const SearchResult &result)
 {
-    return 0.0; // Playlists are handled as individual tracks
+    if (this->is_playlist())
+        return 0.0; // playlist tracks are scored against their own track in search()
+
+    vector<SearchResult> candidates{result};
+    MatchContext context = this->is_track() ? make_match_context(get<TrackMetadata>(metadata))
+                                            : make_match_context(get<AlbumMetadata>(metadata));
+    MatchScorer::score(context, candidates, this->normalizer);
+    return candidates[0].score;
 }
 
-double Youtube::calculate_title_similarity(const string &a, const string &b)
+double Youtube::calculate_title_similarity(string_view a, string_view b)
 {
     const auto max_len = max(a.length(), b.length());
     if (max_len == 0)
@@ -234,49 +176,14 @@ double Youtube::calculate_title_similarity(const string &a, const string &b)
     return 1.0 - (static_cast<double>(distance) / max_len);
 }
 
-int Youtube::levenshtein_distance(string a, string b)
+int Youtube::levenshtein_distance(string_view a, string_view b)
 {
-    int size1 = a.size();
-    int size2 = b.size();
-    int verif[size1 + 1][size2 + 1];
-
-    if (size1 == 0)
-        return size2;
-    if (size2 == 0)
-        return size1;
-
-    for (int i = 0; i <= size1; i++)
-        verif[i][0] = i;
-    for (int j = 0; j <= size2; j++)
-        verif[0][j] = j;
-
-    for (int i = 1; i <= size1; i++)
-    {
-        for (int j = 1; j <= size2; j++)
-        {
-            int cost = (a[j - 1] == b[i - 1]) ? 0 : 1;
-            verif[i][j] = min(
-                min(verif[i - 1][j] + 1, verif[i][j - 1] + 1),
-                verif[i - 1][j - 1] + cost);
-        }
-    }
-
-    return verif[size1][size2];
+    return EditDistance::levenshtein(a, b);
 }
 
-string Youtube::normalize_string(const string &input)
+string Youtube::normalize_string(string_view input)
 {
-    string result = input;
-    // convert to lowercase
-    transform(result.begin(), result.end(), result.begin(), ::tolower);
-
-    // remove special characters and extra whitespace
-    static const regex cleanup_regex("[^a-z0-9]+");
-    result = regex_replace(result, cleanup_regex, " ");
-
-    // trim whitespace
-    result = regex_replace(result, regex("^\\s+|\\s+$"), "");
-    return result;
+    return this->normalizer.normalize(input);
 }
 
 URL Youtube::get_music_url(SearchResult search_result)
@@ -284,64 +191,147 @@ URL Youtube::get_music_url(SearchResult search_result)
     return "https://music.youtube.com/watch?v=" + search_result.video_id;
 }
 
-vector<URL> Youtube::search()
+vector<optional<URL>> Youtube::search(const Deadline &deadline)
 {
     LOG_INFO("Creating youtube search query.", "Creating youtube search query");
+    this->queries.clear();
+    vector<const TrackMetadata *> query_tracks; // track behind each query, nullptr for album queries
+
     if (this->is_track())
     {
-        TrackMetadata track = get<TrackMetadata>(metadata);
+        const TrackMetadata &track = get<TrackMetadata>(metadata);
         Query track_query = this->query_builder.create_track_search_query(track);
         this->queries.push_back(track_query);
+        query_tracks.push_back(&track);
     }
     else if (this->is_album())
     {
         AlbumMetadata album_metadata = get<AlbumMetadata>(metadata);
         Query album_query = this->query_builder.create_album_search_query(album_metadata);
         this->queries.push_back(album_query);
+        query_tracks.push_back(nullptr);
     }
     else if (this->is_playlist())
     {
-        PlaylistMetadata playlist = get<PlaylistMetadata>(metadata);
+        const PlaylistMetadata &playlist = get<PlaylistMetadata>(metadata);
 
         for (const auto &track : playlist.tracks)
         {
             Query track_url = this->query_builder.create_track_search_query(track);
             this->queries.push_back(track_url);
+            query_tracks.push_back(&track);
         }
     }
 
-    vector<URL> urls;
+    vector<optional<SearchResult>> best_matches(this->queries.size());
+    vector<bool> completed(this->queries.size(), false); // got a result list, possibly empty, rather than an error
+    vector<size_t> to_search; // indexes into queries that still need a search request
+    for (size_t i = 0; i < this->queries.size(); i++)
+    {
+        optional<Resolution> cached;
+        if (this->resolution_cache && query_tracks[i])
+            cached = this->resolution_cache->lookup(*query_tracks[i]);
+
+        if (!cached.has_value())
+        {
+            to_search.push_back(i);
+            continue;
+        }
 
-    for (const auto &query : this->queries)
+        LOG_DEBUG("Resolution cache hit", "Resolution cache hit for track " + query_tracks[i]->id);
+        if (cached->video_id.has_value())
+        {
+            best_matches[i] = SearchResult{
+                .video_id = cached->video_id.value(),
+                .title = query_tracks[i]->name,
+                .artist = "",
+                .duration_seconds = 0,
+                .score = cached->score};
+        }
+    }
+
+    vector<HttpRequest> requests;
+    vector<MatchContext> contexts; // built once per query, every candidate of its response is scored against it
+    requests.reserve(to_search.size());
+    contexts.reserve(to_search.size());
+    for (size_t query_index : to_search)
     {
-        vector<SearchResult> search_results;
-        string response;
-        
-        for (int retry = 0; retry < MAX_RETRIES; retry++) {
-            if (retry > 0) {
-                LOG_INFO("Retrying search", 
-                    "Attempt " + to_string(retry + 1) + " of " + to_string(MAX_RETRIES));
-                sleep_between_retries(retry);
-            }
+        requests.push_back(this->build_search_request(this->queries[query_index]));
 
-            response = this->make_search_request(query);
-            search_results = this->try_parse_response(response);
-            
-            if (!search_results.empty()) {
-                break;
-            }
+        const TrackMetadata *track = query_tracks[query_index];
+        contexts.push_back(track ? this->make_match_context(*track)
+                                 : this->make_match_context(get<AlbumMetadata>(metadata)));
+    }
+
+    int max_in_flight = this->config.max_concurrent_searches > 0 ? this->config.max_concurrent_searches : DEFAULT_CONCURRENT_SEARCHES;
+    CurlMulti multi(static_cast<size_t>(max_in_flight));
+    LOG_INFO("Searching youtube.", "Searching youtube for " + to_string(requests.size()) + " queries (" + to_string(this->queries.size() - requests.size()) + " cached), " + to_string(max_in_flight) + " at a time");
+
+    multi.perform(requests, [&](size_t index, const HttpResponse &response, int attempt) -> RetryDelay
+                  {
+        size_t query_index = to_search[index];
+        const Query &query = this->queries[query_index];
+        optional<vector<SearchResult>> search_results;
+
+        if (response.code != CURLE_OK) {
+            LOG_ERROR("Search request failed",
+                "YouTube API request failed for query " + query + ": " + curl_easy_strerror(response.code));
+        } else if (response.status == 429) {
+            LOG_WARN("YouTube API rate limit exceeded", "Received 429 Too Many Requests from YouTube API for query: " + query);
+        } else {
+            search_results = this->try_parse_response(response.body, contexts[index]);
+        }
+
+        if (search_results.has_value()) {
+            completed[query_index] = true;
+        }
+        if (search_results.has_value() && !search_results->empty()) {
+            best_matches[query_index] = search_results->front();
+            return nullopt;
         }
 
-        if (search_results.empty()) {
+        int retry = attempt + 1;
+        if (retry >= MAX_RETRIES) {
             LOG_INFO("No results found", 
                 "No valid results after " + to_string(MAX_RETRIES) + " attempts for query: " + query);
-            continue;
+            return nullopt;
+        }
+
+        LOG_INFO("Retrying search", 
+            "Attempt " + to_string(retry + 1) + " of " + to_string(MAX_RETRIES) + " for query: " + query);
+        return this->retry_delay(retry); }, deadline);
+
+    if (this->resolution_cache)
+    {
+        for (size_t query_index : to_search)
+        {
+            // a failed search (transport error, 429, API error) says nothing about the track, it is searched again next time
+            const TrackMetadata *track = query_tracks[query_index];
+            if (!track || !completed[query_index])
+                continue;
+
+            const optional<SearchResult> &best_match = best_matches[query_index];
+            bool accepted = best_match.has_value() && best_match->score >= this->config.minimum_match_score;
+            this->resolution_cache->store(Resolution{
+                .track_id = track->id,
+                .isrc = track->isrc,
+                .video_id = accepted ? optional<string>(best_match->video_id) : nullopt,
+                .score = best_match.has_value() ? best_match->score : 0.0,
+                .resolved_at = chrono::system_clock::now()});
         }
+    }
+
+    vector<optional<URL>> urls(this->queries.size());
+    for (size_t i = 0; i < this->queries.size(); i++)
+    {
+        if (!best_matches[i].has_value())
+            continue;
 
-        const auto &best_match = search_results[0];
+        const Query &query = this->queries[i];
+        const auto &best_match = best_matches[i].value();
         if (best_match.score >= this->config.minimum_match_score)
         {
-            urls.push_back(this->get_music_url(best_match));
+            urls[i] = this->get_music_url(best_match);
             LOG_INFO("Found match.", "Found match for query" + query);
         }
         else
@@ -354,21 +344,127 @@ vector<URL> Youtube::search()
     return urls;
 }
 
-DownloadPaths Youtube::download(AnyMetadata metadata) {
+DownloadPaths Youtube::download(AnyMetadata metadata, const Deadline &deadline) {
     this->metadata = metadata;
-    vector<URL> urls = this->search();
-    vector<filesystem::path> downloaded_paths;
-    
-    for (const auto &url : urls) {
-        std::string log = "URL " + url + " at path (in output) " + this->config.output;
-        LOG_INFO("Downloading " + log, "Downloading " + log);
-        
-        filesystem::path downloaded_path = this->downloader.download(this->config, url);
-        downloaded_paths.push_back(downloaded_path);
-        
-        LOG_INFO("Downloaded to " + downloaded_path.string(), 
-                "Downloaded " + log + " to " + downloaded_path.string());
+    this->track_results.clear();
+    vector<optional<URL>> matches = this->search(deadline);
+
+    vector<URL> urls;
+    vector<size_t> match_of; // query index behind each url
+    for (size_t i = 0; i < matches.size(); i++) {
+        if (matches[i].has_value()) {
+            urls.push_back(matches[i].value());
+            match_of.push_back(i);
+        }
+    }
+
+    vector<optional<filesystem::path>> results(urls.size());
+    vector<optional<DownloadFailure>> failed(urls.size());
+    size_t jobs = this->config.jobs > 0 ? this->config.jobs : DEFAULT_DOWNLOAD_JOBS;
+
+    if (this->config.batch_downloads) {
+        // one long-lived yt-dlp per job, dealt round-robin so every worker gets a similar mix of the list
+        size_t workers = min(jobs, urls.size());
+        vector<vector<size_t>> shares(workers);
+        for (size_t i = 0; i < urls.size(); i++) {
+            shares[i % workers].push_back(i);
+        }
+
+        parallel_for(workers, workers, [&](size_t worker) {
+            vector<URL> share;
+            for (size_t index : shares[worker]) {
+                share.push_back(urls[index]);
+            }
+            LOG_INFO("Downloading " + to_string(share.size()) + " URLs in one yt-dlp batch",
+                     "Downloading " + to_string(share.size()) + " URLs in yt-dlp batch worker " + to_string(worker));
+
+            vector<BatchDownloadResult> batch;
+            try {
+                batch = this->downloader.download_batch(this->config, share, deadline);
+            } catch (const exception &e) {
+                // spawning, polling or the deadline can still throw, that takes down this worker's share only
+                LOG_ERROR("yt-dlp batch worker failed", "yt-dlp batch worker " + to_string(worker) + " failed: " + e.what());
+                for (size_t index : shares[worker]) {
+                    failed[index] = DownloadFailure{.url = urls[index], .reason = e.what()};
+                }
+                return;
+            }
+            for (size_t i = 0; i < batch.size(); i++) {
+                size_t index = shares[worker][i];
+                if (batch[i].path.has_value()) {
+                    LOG_INFO("Downloaded to " + batch[i].path->string(), "Downloaded URL " + urls[index] + " to " + batch[i].path->string());
+                    results[index] = move(batch[i].path);
+                } else {
+                    LOG_ERROR("Failed to download " + urls[index], "Failed to download URL " + urls[index] + ": " + batch[i].error);
+                    failed[index] = DownloadFailure{.url = urls[index], .reason = batch[i].error};
+                }
+            }
+        });
+    } else {
+        // download threads only fetch, conversions queue on the downloader's transcode pool and are collected below
+        vector<optional<future<filesystem::path>>> transcodes(urls.size());
+        parallel_for(urls.size(), jobs, [&](size_t index) {
+            const URL &url = urls[index];
+            std::string log = "URL " + url + " at path (in output) " + (this->config.output ? this->config.output : "default");
+            if (deadline.expired()) {
+                failed[index] = DownloadFailure{.url = url, .reason = "not started, the download deadline was exceeded"};
+                return;
+            }
+            LOG_INFO("Downloading " + log, "Downloading " + log);
+
+            try {
+                FetchedAudio fetched = this->downloader.fetch(this->config, url, deadline);
+                transcodes[index] = this->downloader.transcode(this->config, url, move(fetched), deadline);
+            } catch (const exception &e) {
+                LOG_ERROR("Failed to download " + url, "Failed to download " + log + ": " + e.what());
+                failed[index] = DownloadFailure{.url = url, .reason = e.what()};
+            }
+        });
+
+        for (size_t index = 0; index < urls.size(); index++) {
+            if (!transcodes[index].has_value())
+                continue;
+
+            try {
+                filesystem::path downloaded_path = transcodes[index]->get();
+                LOG_INFO("Downloaded to " + downloaded_path.string(), "Downloaded URL " + urls[index] + " to " + downloaded_path.string());
+                results[index] = move(downloaded_path);
+            } catch (const exception &e) {
+                LOG_ERROR("Failed to convert " + urls[index], "Failed to convert URL " + urls[index] + ": " + e.what());
+                failed[index] = DownloadFailure{.url = urls[index], .reason = e.what()};
+            }
+        }
+    }
+
+    DownloadPaths downloaded_paths;
+    this->failures.clear();
+    this->track_results.resize(matches.size());
+    for (size_t i = 0; i < matches.size(); i++) {
+        this->track_results[i].url = move(matches[i]);
+    }
+    for (size_t i = 0; i < urls.size(); i++) {
+        if (results[i].has_value()) {
+            this->track_results[match_of[i]].path = results[i];
+            downloaded_paths.push_back(move(results[i].value()));
+        } else if (failed[i].has_value()) {
+            this->failures.push_back(move(failed[i].value()));
+        }
+    }
+
+    if (!this->failures.empty()) {
+        string base = to_string(this->failures.size()) + " of " + to_string(urls.size()) + " downloads failed";
+        LOG_WARN(base, base + ", see get_failures() for details");
     }
 
     return downloaded_paths;
-}
\ No newline at end of file
+}
+
+const vector<DownloadFailure> &Youtube::get_failures() const
+{
+    return this->failures;
+}
+
+const vector<TrackResult> &Youtube::get_track_results() const
+{
+    return this->track_results;
+}
@@ -2,24 +2,36 @@
 #ifndef YOUTUBE_H
 #define YOUTUBE_H
 
+#include <chrono>
+#include <memory>
+#include <string_view>
 #include <variant>
 #include <nlohmann/json.hpp>
 #include "../../../include/spotify-dlp.h"
 #include "../spotify/metadata.h"
 #include "../spotify/api.h"
+#include "../../utils/curl_multi.h"
+#include "../../utils/deadline.h"
 #include "yt-dlp.h"
 #include "search_builder.h"
+#include "resolution_cache.h"
+#include "normalizer.h"
+#include "match_scorer.h"
 
 using URL = std::string;
 using DownloadPaths = std::vector<std::filesystem::path>; 
 
-struct SearchResult
+struct DownloadFailure
 {
-    std::string video_id;
-    std::string title;
-    std::string artist;
-    int duration_seconds;
-    double score;
+    URL url;
+    std::string reason;
+};
+
+// what became of one searched item of the last download(): a track, or the whole album when it was matched as one
+struct TrackResult
+{
+    std::optional<URL> url;                    // std::nullopt when no match was found
+    std::optional<std::filesystem::path> path; // std::nullopt when there was no match or the download failed
 };
 
 class RateLimitException : public std::exception
@@ -46,41 +58,58 @@ class Youtube
 
 public:
     Youtube(std::string yt_api_key, DownloadConfig config);
-    DownloadPaths download(AnyMetadata data);
+    // paths of the successful downloads, in input order. Throws DeadlineExceeded if the deadline passes while
+    // searching; during the download stage the tracks it cuts off are recorded as failures instead
+    DownloadPaths download(AnyMetadata data, const Deadline &deadline = Deadline());
+    const std::vector<DownloadFailure> &get_failures() const; // tracks that failed during the last download()
+    // one entry per track of the last download() in metadata order, a single one for an album; empty when the search threw
+    const std::vector<TrackResult> &get_track_results() const;
+    void on_progress(ProgressCallback callback); // progress of every yt-dlp download, see YtDLP::on_progress
+    std::chrono::seconds get_no_match_ttl() const; // how long a search without an acceptable match is trusted
+    ResolutionCache *get_resolution_cache(); // nullptr unless DownloadConfig::resolution_cache_path is set, use for import/export
 
 private:
     static constexpr int MAX_RETRIES = 3;
     static constexpr int RETRY_DELAY_MS = 1000;
+    static constexpr int DEFAULT_CONCURRENT_SEARCHES = 8;
+    static constexpr int DEFAULT_DOWNLOAD_JOBS = 4;
+    static constexpr int DEFAULT_NO_MATCH_TTL_SECONDS = 24 * 60 * 60;
+    static constexpr size_t NORMALIZER_CACHE_CAPACITY = 4096; // enough for every track, artist and album string of a large playlist
+
+    static constexpr size_t RANKED_CANDIDATES = 1; // only the best candidate of a response is used
 
-    std::vector<SearchResult> try_parse_response(const std::string &response);
-    void sleep_between_retries(int retry_count) const;
+    // std::nullopt when the response is not a result list (API or quota error, malformed JSON), empty when nothing was found
+    std::optional<std::vector<SearchResult>> try_parse_response(const std::string &response, const MatchContext &context);
+    std::chrono::milliseconds retry_delay(int retry_count) const;
 
     // searching
-    std::vector<URL> search();
+    std::vector<std::optional<URL>> search(const Deadline &deadline); // one per query, std::nullopt when nothing matched
     bool is_track();
     bool is_album();    // for albums we will try to find an album that exactly matches and download each song from that, if we cannot find an exact match we will just search for all the tracks individually instead.
     bool is_playlist(); // for playlists we will just iterate thru each song and download each like that.
-    std::string make_search_request(Query query);
-    std::vector<SearchResult> parse_response(const std::string &response); // since we may also search for an album
-    double calculate_match_score(const SearchResult &result);
-    double calculate_track_score(const SearchResult &result, const TrackMetadata &track);
-    double calculate_album_score(const SearchResult &result, const AlbumMetadata &album);
-    double calculate_playlist_score(const SearchResult &result); // Currently returns 0
+    HttpRequest build_search_request(const Query &query);
+    std::vector<SearchResult> parse_response(const std::string &response, const MatchContext &context); // since we may also search for an album
+    MatchContext make_match_context(const TrackMetadata &track);
+    MatchContext make_match_context(const AlbumMetadata &album);
+    double calculate_match_score(const SearchResult &result); // scores one result against the current metadata, 0 for playlists
     std::string url_encode(const std::string &decoded);
-    double calculate_title_similarity(const std::string &a, const std::string &b);
-    std::string normalize_string(const std::string &input);
-    // taken from: https://github.com/guilhermeagostinelli/levenshtein/blob/master/levenshtein.cpp
-    int levenshtein_distance(std::string a, std::string b);
+    double calculate_title_similarity(std::string_view a, std::string_view b);
+    std::string normalize_string(std::string_view input);
+    int levenshtein_distance(std::string_view a, std::string_view b);
     URL get_music_url(SearchResult search_result);
 
     YoutubeMusicSearchQueryBuilder query_builder;
     AnyMetadata metadata;
     std::vector<Query> queries;
     std::string api_key;
+    std::unique_ptr<ResolutionCache> resolution_cache;
+    NormalizerCache normalizer;
 
     // downloading
     YtDLP downloader;
     DownloadConfig config;
+    std::vector<DownloadFailure> failures;
+    std::vector<TrackResult> track_results;
 };
 
 #endif
\ No newline at end of file
@@ -1,72 +1,405 @@
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #endif
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#include <nlohmann/json.hpp>
+#ifdef YT_DLP_COMPRESSED
+#include <zstd.h>
+#endif
 #include "yt-dlp.h"
 #include "./data/yt-dlp-data.h"
+#include "../../utils/hash.h"
 #include "../../utils/logger.h"
+#include "../../utils/paths.h"
+#include "../../utils/process_runner.h"
+#include "output_parser.h"
 
 using namespace std;
 
-YtDLP::YtDLP() : program_name(_WIN32 ? "yt_dlp.exe" : "yt_dlp")
+namespace
 {
-    this->get_temp_path();
+    constexpr size_t DECOMPRESS_CHUNK_SIZE = 1 << 20;
+
+    struct EmbeddedBinary
+    {
+        const unsigned char *data; // as stored in the executable, zstd-compressed when YT_DLP_COMPRESSED is set
+        size_t stored_size;
+        size_t size; // of the runnable binary
+    };
+
+    EmbeddedBinary embedded_binary()
+    {
+#ifdef YT_DLP_COMPRESSED
+        static const size_t size = []
+        {
+            unsigned long long content_size = ZSTD_getFrameContentSize(YtDLPData::yt_dlp_zstd, YtDLPData::yt_dlp_zstd_size);
+            if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN)
+            {
+                string log = "Embedded yt-dlp payload is not a sized zstd frame.";
+                THROW_AND_LOG(runtime_error, log, log);
+            }
+            return static_cast<size_t>(content_size);
+        }();
+        return {YtDLPData::yt_dlp_zstd, YtDLPData::yt_dlp_zstd_size, size};
+#elif defined(_WIN32)
+        return {YtDLPData::yt_dlp_windows, YtDLPData::yt_dlp_windows_size, YtDLPData::yt_dlp_windows_size};
+#else
+        return {YtDLPData::yt_dlp_linux, YtDLPData::yt_dlp_linux_size, YtDLPData::yt_dlp_linux_size};
+#endif
+    }
+
+    // Hands the runnable binary to sink in order, decompressing chunk by chunk so it is never fully in memory.
+    // Returns false as soon as sink does, throws if the payload is corrupt.
+    bool stream_embedded_binary(const function<bool(const unsigned char *data, size_t size)> &sink)
+    {
+        EmbeddedBinary binary = embedded_binary();
+#ifdef YT_DLP_COMPRESSED
+        unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        if (!dctx)
+        {
+            string log = "Failed to create zstd decompression context.";
+            THROW_AND_LOG(runtime_error, log, log);
+        }
+        vector<unsigned char> chunk(DECOMPRESS_CHUNK_SIZE);
+        ZSTD_inBuffer input{binary.data, binary.stored_size, 0};
+
+        size_t remaining_hint = 1;
+        while (input.pos < input.size || remaining_hint != 0)
+        {
+            ZSTD_outBuffer output{chunk.data(), chunk.size(), 0};
+            remaining_hint = ZSTD_decompressStream(dctx.get(), &output, &input);
+            if (ZSTD_isError(remaining_hint))
+            {
+                string log = "Failed to decompress the embedded yt-dlp.";
+                THROW_AND_LOG(runtime_error, log, log + " " + ZSTD_getErrorName(remaining_hint));
+            }
+            if (output.pos > 0 && !sink(chunk.data(), output.pos))
+                return false;
+            if (input.pos == input.size && output.pos == 0 && remaining_hint != 0)
+            {
+                string log = "Embedded yt-dlp payload is truncated.";
+                THROW_AND_LOG(runtime_error, log, log);
+            }
+        }
+        return true;
+#else
+        return sink(binary.data, binary.size);
+#endif
+    }
+
+    // "v" query parameter of a watch url, empty when there is none
+    string_view video_id_of(string_view url)
+    {
+        size_t query = url.find('?');
+        if (query == string_view::npos)
+            return {};
+
+        string_view parameters = url.substr(query + 1);
+        while (!parameters.empty())
+        {
+            size_t end = parameters.find('&');
+            string_view parameter = parameters.substr(0, end);
+            if (parameter.substr(0, 2) == "v=")
+                return parameter.substr(2);
+            if (end == string_view::npos)
+                break;
+            parameters.remove_prefix(end + 1);
+        }
+        return {};
+    }
+
+#ifndef _WIN32
+    bool write_all(int fd, const unsigned char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = write(fd, data, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+#endif
+}
+
+YtDLP::YtDLP() : YtDLP(YtDLPExecutionMode::Disk) {}
 
 #ifdef _WIN32
-    this->extract_yt_dlp_windows();
+YtDLP::YtDLP(YtDLPExecutionMode mode) : program_name("yt_dlp.exe")
 #else
-    this->extract_yt_dlp_linux();
+YtDLP::YtDLP(YtDLPExecutionMode mode) : program_name("yt_dlp")
 #endif
+{
+    if (mode == YtDLPExecutionMode::Memory)
+    {
+        optional<filesystem::path> in_memory = in_memory_path();
+        if (in_memory.has_value())
+        {
+            this->yt_dlp_path = in_memory.value();
+            LOG_DEBUG("Running yt-dlp from memory", "Running yt-dlp from memory at " + this->yt_dlp_path.string());
+            return;
+        }
+        LOG_WARN("In-memory yt-dlp unavailable, extracting to disk", "Could not load yt-dlp into a sealed memfd, falling back to extracting it to disk");
+    }
+
+    this->yt_dlp_path = user_cache_dir() / ("yt-dlp-" + embedded_binary_key()) / this->program_name;
+
+    if (is_extracted(this->yt_dlp_path))
+    {
+        LOG_DEBUG("Reusing extracted yt-dlp", "Reusing extracted yt-dlp at " + this->yt_dlp_path.string());
+        return;
+    }
+
+    LOG_INFO("Extracting yt-dlp", "Extracting yt-dlp to " + this->yt_dlp_path.string());
+    extract_yt_dlp(this->yt_dlp_path);
 }
 
-void YtDLP::extract_yt_dlp_linux()
+YtDLP::~YtDLP()
 {
-#ifdef __linux__
-    ofstream outfile(this->yt_dlp_temp_path, ios::binary);
-    if (!outfile)
+    lock_guard<mutex> lock(this->probes_mutex);
+    for (const auto &[video_id, cached] : this->probes)
     {
-        string log = "Failed to create tempfile for YTDlp (linux).";
-        THROW_AND_LOG(runtime_error, log, log);
+        error_code ec;
+        filesystem::remove(cached.probe.info_json, ec);
     }
+}
+
+string YtDLP::embedded_binary_key()
+{
+#ifdef YT_DLP_DATA_HASH
+    return string(YT_DLP_DATA_HASH).substr(0, 16);
+#else
+    static const string key = [] {
+        EmbeddedBinary binary = embedded_binary();
+        return to_hex(fnv1a_64(string_view(reinterpret_cast<const char *>(binary.data), binary.stored_size)));
+    }();
+    return key;
+#endif
+}
 
-    outfile.write(reinterpret_cast<const char *>(YtDLPData::yt_dlp_linux), YtDLPData::yt_dlp_linux_size);
+bool YtDLP::is_extracted(const filesystem::path &path)
+{
+#ifdef _WIN32
+    error_code ec;
+    return filesystem::is_regular_file(path, ec) && filesystem::file_size(path, ec) == embedded_binary().size;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    return S_ISREG(info.st_mode) && static_cast<size_t>(info.st_size) == embedded_binary().size && (info.st_mode & S_IXUSR);
 #endif
 }
 
-void YtDLP::extract_yt_dlp_windows()
+optional<filesystem::path> YtDLP::in_memory_path()
 {
-    ofstream outfile(this->yt_dlp_temp_path, ios::binary);
-    if (!outfile)
+#ifdef __linux__
+    static const int exec_fd = []
     {
-        string log = "Failed to create tempfile for YTDlp (windows).";
-        THROW_AND_LOG(runtime_error, log, log);
-    }
+        // vm.memfd_noexec may require MFD_EXEC, kernels older than 6.3 reject the unknown flag
+        int fd = -1;
+#ifdef MFD_EXEC
+        fd = memfd_create("yt-dlp", MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_EXEC);
+#endif
+        if (fd == -1)
+            fd = memfd_create("yt-dlp", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd == -1)
+            return -1;
 
-    outfile.write(reinterpret_cast<const char *>(YtDLPData::yt_dlp_windows), YtDLPData::yt_dlp_windows_size);
-    outfile.close();
+        bool loaded = false;
+        try
+        {
+            loaded = stream_embedded_binary([fd](const unsigned char *data, size_t size)
+                                            { return write_all(fd, data, size); });
+        }
+        catch (const exception &)
+        {
+        }
+        if (!loaded)
+        {
+            close(fd);
+            return -1;
+        }
+
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        // children run /proc/self/fd/N, so N must be inherited: a read-only descriptor without O_CLOEXEC keeps
+        // working when the payload is a script whose interpreter reopens the path after exec
+        string writable_path = "/proc/self/fd/" + to_string(fd);
+        int read_only = open(writable_path.c_str(), O_RDONLY);
+        close(fd);
+        return read_only;
+    }();
+
+    if (exec_fd == -1)
+        return nullopt;
+
+    filesystem::path path = "/proc/self/fd/" + to_string(exec_fd);
+    if (access(path.c_str(), X_OK) != 0)
+        return nullopt;
+    return path;
+#else
+    return nullopt;
+#endif
 }
 
-void YtDLP::get_temp_path()
+void YtDLP::extract_yt_dlp(const filesystem::path &destination)
 {
+    filesystem::create_directories(destination.parent_path());
+
 #ifdef _WIN32
-    wchar_t temp_dir[MAX_PATH];
-    GetTempPathW(MAX_PATH, temp_dir);
-    this->yt_dlp_temp_path = filesystem::path(temp_dir) / this->program_name;
+    filesystem::path temp_path = destination;
+    temp_path += ".tmp" + to_string(GetCurrentProcessId());
+
+    {
+        ofstream outfile(temp_path, ios::binary | ios::trunc);
+        if (!outfile)
+        {
+            string log = "Failed to create tempfile for YTDlp (windows).";
+            THROW_AND_LOG(runtime_error, log, log + " Path: " + temp_path.string());
+        }
+        stream_embedded_binary([&outfile](const unsigned char *data, size_t size)
+                               { return static_cast<bool>(outfile.write(reinterpret_cast<const char *>(data), size)); });
+        if (!outfile)
+        {
+            filesystem::remove(temp_path);
+            string log = "Failed to write YTDlp (windows).";
+            THROW_AND_LOG(runtime_error, log, log + " Path: " + temp_path.string());
+        }
+    }
+
+    error_code ec;
+    filesystem::rename(temp_path, destination, ec);
+    if (ec)
+    {
+        filesystem::remove(temp_path);
+        string log = "Failed to move extracted YTDlp into place (windows).";
+        THROW_AND_LOG(runtime_error, log, log + " " + ec.message());
+    }
 #else
-    string temp_path = "/tmp/" + this->program_name;
-    h this->yt_dlp_temp_path = filesystem::path(temp_path);
+    // private temp file in the same directory so the rename is atomic, O_CLOEXEC keeps the writable fd out
+    // of children spawned meanwhile (exec fails with ETXTBSY while anyone holds the binary open for writing)
+    string temp_template = destination.string() + ".XXXXXX";
+    int fd = mkostemp(temp_template.data(), O_CLOEXEC);
+    if (fd == -1)
+    {
+        string log = "Failed to create tempfile for YTDlp.";
+        THROW_AND_LOG(runtime_error, log, log + " " + strerror(errno));
+    }
+
+    auto fail = [&](const string &log)
+    {
+        int error = errno;
+        close(fd);
+        unlink(temp_template.c_str());
+        THROW_AND_LOG(runtime_error, log, log + " Path: " + temp_template + " " + strerror(error));
+    };
+
+    bool written = false;
+    try
+    {
+        written = stream_embedded_binary([fd](const unsigned char *data, size_t size)
+                                         { return write_all(fd, data, size); });
+    }
+    catch (const runtime_error &)
+    {
+        close(fd);
+        unlink(temp_template.c_str());
+        throw;
+    }
+    if (!written)
+        fail("Failed to write YTDlp.");
+
+    if (fchmod(fd, 0755) != 0)
+        fail("Failed to mark YTDlp executable.");
+
+    if (close(fd) != 0)
+    {
+        int error = errno;
+        unlink(temp_template.c_str());
+        string log = "Failed to write YTDlp.";
+        THROW_AND_LOG(runtime_error, log, log + " Path: " + temp_template + " " + strerror(error));
+    }
+
+    // concurrent extractions all write identical content, whichever rename lands last wins
+    if (rename(temp_template.c_str(), destination.c_str()) != 0)
+    {
+        int error = errno;
+        unlink(temp_template.c_str());
+        string log = "Failed to move extracted YTDlp into place.";
+        THROW_AND_LOG(runtime_error, log, log + " " + strerror(error));
+    }
 #endif
 }
 
+void YtDLP::on_progress(ProgressCallback callback, chrono::milliseconds min_interval)
+{
+    this->progress_callback = move(callback);
+    this->progress_interval = min_interval;
+}
+
+void YtDLP::track_progress(YtDLPOutputParser &parser, ProgressThrottle &throttle) const
+{
+    if (!this->progress_callback)
+        return;
+
+    parser.on_progress([this, &throttle](const YtDLPProgress &progress)
+                       {
+        if (progress.status == "error")
+            return; // reported as Failed once yt-dlp gives up on the url
+
+        DownloadProgressEvent event;
+        event.url = progress.original_url;
+        event.phase = DownloadPhase::Downloading;
+        event.downloaded_bytes = progress.downloaded_bytes;
+        event.total_bytes = progress.total_bytes;
+        event.speed = progress.speed;
+        event.eta_seconds = progress.eta_seconds;
+        event.transfer_finished = progress.status == "finished";
+        this->report_progress(throttle, move(event)); });
+
+    parser.on_postprocess([this, &throttle](const YtDLPPostprocess &postprocess)
+                          {
+        DownloadProgressEvent event;
+        event.url = postprocess.original_url;
+        event.phase = DownloadPhase::PostProcessing;
+        event.postprocessor = postprocess.postprocessor;
+        this->report_progress(throttle, move(event)); });
+}
+
+void YtDLP::report_progress(ProgressThrottle &throttle, DownloadProgressEvent event) const
+{
+    if (this->progress_callback && throttle.admit(event, chrono::steady_clock::now()))
+        this->progress_callback(event);
+}
+
 string YtDLP::get_path() const
 {
-    return this->yt_dlp_temp_path.string();
+    return this->yt_dlp_path.string();
 }
 
 bool YtDLP::command_return_ok(YtDLPExitCodes code)
@@ -80,147 +413,548 @@ bool YtDLP::command_return_ok(YtDLPExitCodes code)
     }
 }
 
-CommandResult YtDLP::execute_command(const string &command)
+CommandResult YtDLP::execute_command(const vector<string> &args)
 {
-    CommandResult result;
-    array<char, 128> buffer;
+    ProcessRunner runner(args);
+    runner.on_stdout_line([](string_view line)
+                          { LOG_INFO("{}", "{}", line); });
+    runner.on_stderr_line([](string_view line)
+                          { LOG_ERROR("{}", "{}", line); });
 
-#ifdef _WIN32
-    // Windows needs temporary files to handle separate streams
-    string cmd = command + " 1>stdout.tmp 2>stderr.tmp";
-    result.cmd_exit_code = system(cmd.c_str()); // Capture the return value
+    ProcessResult process = runner.run();
 
-    ifstream stdout_file("stdout.tmp");
-    string line;
-    while (getline(stdout_file, line))
+    CommandResult result;
+    result.cmd_exit_code = process.exit_code;
+    result.ytdlp_exit_code = static_cast<YtDLPExitCodes>(process.exit_code);
+    result.out = move(process.out);
+    result.err = move(process.err);
+    return result;
+}
+
+vector<string> YtDLP::download_options(const DownloadConfig &config) const
+{
+    vector<string> args;
+    optional<TranscodeTarget> target = Transcoder::target_for(config.download_file_type);
+    if (target.has_value())
     {
-        LOG_INFO(line, line);
-        result.out += line + "\n";
+        // converted by transcode() on the pool, yt-dlp only fetches and prefers a stream that needs no encode
+        args.insert(args.end(), {"-f", Transcoder::format_selector(target.value())});
+    }
+    else
+    {
+        args.insert(args.end(), {"-x", "--audio-format", this->get_download_file_type(config)});
+        if (config.audio_quality >= 0)
+        {
+            args.insert(args.end(), {"--audio-quality", to_string(config.audio_quality)});
+        }
     }
 
-    ifstream stderr_file("stderr.tmp");
-    while (getline(stderr_file, line))
+    if (config.retries >= 0)
     {
-        LOG_ERROR(line, line);
-        result.err += line + "\n";
+        args.insert(args.end(), {"--retries", to_string(config.retries)});
     }
 
-    stdout_file.close();
-    stderr_file.close();
-    remove("stdout.tmp");
-    remove("stderr.tmp");
+    if (config.output)
+    {
+        args.insert(args.end(), {"-o", config.output});
+    }
 
-    result.cmd_exit_code = result.cmd_exit_code;
-    result.ytdlp_exit_code = static_cast<YtDLPExitCodes>(result.cmd_exit_code);
-#else
-    // On Linux we can use popen twice to read both streams
-    FILE *stdout_pipe = popen((command + " 2>/dev/null").c_str(), "r");
-    FILE *stderr_pipe = popen((command + " 2>&1 1>/dev/null").c_str(), "r");
+    return args;
+}
 
-    if (!stdout_pipe || !stderr_pipe)
+VideoProbe YtDLP::parse_probe(const string &info_json)
+{
+    auto json = nlohmann::json::parse(info_json, nullptr, false);
+    if (json.is_discarded() || !json.is_object() || !json.contains("id") || !json["id"].is_string())
     {
-        string log = "Failed to execute command: " + command;
+        string log = "yt-dlp returned an unexpected info JSON";
         THROW_AND_LOG(runtime_error, log, log);
     }
 
-    // Read stdout
-    while (fgets(buffer.data(), buffer.size(), stdout_pipe) != nullptr)
+    // missing fields come through as null
+    auto string_field = [](const nlohmann::json &object, const char *name) -> string
+    {
+        return object.contains(name) && object[name].is_string() ? object[name].get<string>() : string();
+    };
+
+    VideoProbe probe;
+    probe.video_id = json["id"].get<string>();
+    probe.title = string_field(json, "title");
+    if (json.contains("duration") && json["duration"].is_number())
+        probe.duration_seconds = json["duration"].get<double>();
+    probe.availability = string_field(json, "availability");
+    probe.is_live = json.contains("is_live") && json["is_live"].is_boolean() && json["is_live"].get<bool>();
+
+    if (json.contains("formats") && json["formats"].is_array())
     {
-        string line = buffer.data();
-        if (!line.empty() && line[line.length() - 1] == '\n')
+        for (const auto &format : json["formats"])
         {
-            line.pop_back();
+            string acodec = string_field(format, "acodec");
+            string vcodec = string_field(format, "vcodec");
+            if (acodec.empty() || acodec == "none" || vcodec != "none")
+                continue;
+
+            YtDLPAudioFormat audio{.format_id = string_field(format, "format_id"), .ext = string_field(format, "ext"), .acodec = acodec, .abr = nullopt};
+            if (format.contains("abr") && format["abr"].is_number())
+                audio.abr = format["abr"].get<double>();
+            probe.audio_formats.push_back(move(audio));
         }
-        LOG_INFO(line);
-        result.out += line + "\n";
     }
+    return probe;
+}
 
-    // Read stderr
-    while (fgets(buffer.data(), buffer.size(), stderr_pipe) != nullptr)
+bool YtDLP::is_stale(const CachedProbe &cached) const
+{
+    return chrono::steady_clock::now() - cached.probed_at >= this->probe_ttl || !filesystem::exists(cached.probe.info_json);
+}
+
+optional<VideoProbe> YtDLP::cached_probe(const string &video_id)
+{
+    lock_guard<mutex> lock(this->probes_mutex);
+    auto found = this->probes.find(video_id);
+    if (found == this->probes.end())
+        return nullopt;
+    if (this->is_stale(found->second))
+    {
+        error_code ec;
+        filesystem::remove(found->second.probe.info_json, ec);
+        this->probes.erase(found);
+        return nullopt;
+    }
+    return found->second.probe;
+}
+
+optional<VideoProbe> YtDLP::claim_probe(const string &video_id)
+{
+    lock_guard<mutex> lock(this->probes_mutex);
+    auto found = this->probes.find(video_id);
+    if (found == this->probes.end())
+        return nullopt;
+
+    optional<VideoProbe> claimed;
+    if (this->is_stale(found->second))
+    {
+        error_code ec;
+        filesystem::remove(found->second.probe.info_json, ec);
+    }
+    else
     {
-        string line = buffer.data();
-        if (!line.empty() && line[line.length() - 1] == '\n')
+        claimed = move(found->second.probe);
+    }
+    this->probes.erase(found);
+    return claimed;
+}
+
+VideoProbe YtDLP::probe(const string &url, const Deadline &deadline)
+{
+    string video_id(video_id_of(url));
+    if (!video_id.empty())
+    {
+        if (optional<VideoProbe> cached = this->cached_probe(video_id))
         {
-            line.pop_back();
+            LOG_DEBUG("Reusing probe of {}", "Reusing probe of {} from {}", url, cached->info_json.string());
+            return cached.value();
         }
-        LOG_ERROR(line);
-        result.err += line + "\n";
     }
 
-    result.cmd_exit_code = pclose(stdout_pipe);
-    pclose(stderr_pipe);
-    result.ytdlp_exit_code = static_cast<YtDLPExitCodes>(WEXITSTATUS(result.cmd_exit_code));
+    string error; // first ERROR line
+    ProcessRunner runner({this->get_path(), "-J", "--no-warnings", url});
+    runner.set_deadline(deadline);
+    runner.on_stderr_line([&error](string_view line)
+                          {
+        LOG_ERROR("{}", "{}", line);
+        if (error.empty() && line.substr(0, 6) == "ERROR:")
+            error = string(line); });
+
+    ProcessResult process = runner.run();
+
+    if (process.deadline_exceeded)
+        deadline.check("Probe of " + url);
+
+    if (process.exit_code != 0)
+    {
+        string log = "Failed to probe: " + url;
+        if (error.empty())
+            error = "yt-dlp exited with code " + to_string(process.exit_code);
+        THROW_AND_LOG(runtime_error, log, log + ": " + error);
+    }
+
+    VideoProbe probe = parse_probe(process.out);
+
+    // every probe gets its own file, unique across threads and processes sharing the cache directory, so deleting
+    // one after its fetch never touches a newer probe of the same video. It is only registered once fully written.
+    filesystem::path dir = this->probe_dir.empty() ? user_cache_dir() / "info-json" : this->probe_dir;
+    filesystem::create_directories(dir);
+#ifdef _WIN32
+    static atomic<uint64_t> probe_count{0};
+    probe.info_json = dir / (probe.video_id + "." + to_string(GetCurrentProcessId()) + "-" + to_string(probe_count++) + ".info.json");
+    {
+        ofstream file(probe.info_json, ios::binary | ios::trunc);
+        file << process.out;
+        if (!file)
+        {
+            file.close();
+            filesystem::remove(probe.info_json);
+            string log = "Failed to write info JSON";
+            THROW_AND_LOG(runtime_error, log, log + " to " + probe.info_json.string());
+        }
+    }
+#else
+    const string suffix = ".info.json";
+    string path_template = (dir / (probe.video_id + ".XXXXXX" + suffix)).string();
+    int fd = mkostemps(path_template.data(), static_cast<int>(suffix.size()), O_CLOEXEC);
+    if (fd == -1)
+    {
+        string log = "Failed to create info JSON";
+        THROW_AND_LOG(runtime_error, log, log + " in " + dir.string() + ": " + strerror(errno));
+    }
+    bool written = write_all(fd, reinterpret_cast<const unsigned char *>(process.out.data()), process.out.size());
+    if (close(fd) != 0 || !written)
+    {
+        unlink(path_template.c_str());
+        string log = "Failed to write info JSON";
+        THROW_AND_LOG(runtime_error, log, log + " to " + path_template);
+    }
+    probe.info_json = path_template;
 #endif
 
-    return result;
+    lock_guard<mutex> lock(this->probes_mutex);
+    auto [entry, inserted] = this->probes.try_emplace(probe.video_id);
+    if (!inserted)
+    {
+        // a concurrent probe of the same video got there first; nobody has claimed that one, so it can go
+        error_code ec;
+        filesystem::remove(entry->second.probe.info_json, ec);
+    }
+    entry->second = CachedProbe{.probe = probe, .probed_at = chrono::steady_clock::now()};
+    return probe;
 }
 
-std::filesystem::path YtDLP::get_real_output_path(const CommandResult& result) {
-    std::istringstream stream(result.out);
-    std::string line;
-    std::filesystem::path final_path;
+filesystem::path YtDLP::download(DownloadConfig config, const string &url, const Deadline &deadline)
+{
+    FetchedAudio fetched = this->fetch(config, url, deadline);
+    return this->transcode(config, url, move(fetched), deadline).get();
+}
 
-    while (std::getline(stream, line)) {
-        // Check for normal download/extract paths
-        if (line.find("[ExtractAudio] Destination: ") == 0 || 
-            line.find("[download] Destination: ") == 0) {
-            size_t prefix_len = line.find("Destination: ") + 13;
-            final_path = std::filesystem::absolute(line.substr(prefix_len));
-        }
-        // Check for already downloaded files
-        else if (line.find("[download] ") == 0 && line.find(" has already been downloaded") != std::string::npos) {
-            size_t start = line.find("[download] ") + 11;
-            size_t end = line.find(" has already been downloaded");
-            std::string filename = line.substr(start, end - start);
-            final_path = std::filesystem::absolute(filename);
-        }
+FetchedAudio YtDLP::fetch(const DownloadConfig &config, const string &url, const Deadline &deadline)
+{
+    vector<string> args = {this->get_path()};
+    // claimed, not just looked up: a concurrent fetch of the same video extracts it itself instead of sharing the file
+    optional<VideoProbe> probed;
+    string_view video_id = video_id_of(url);
+    if (!video_id.empty())
+        probed = this->claim_probe(string(video_id));
+    if (probed.has_value())
+    {
+        // the info JSON carries the url as original_url, so the records still name it
+        LOG_DEBUG("Fetching {} from its probe", "Fetching {} from the info JSON at {}", url, probed->info_json.string());
+        args.insert(args.end(), {"--load-info-json", probed->info_json.string()});
+    }
+    else
+    {
+        args.push_back(url);
+    }
+    vector<string> options = this->download_options(config);
+    args.insert(args.end(), options.begin(), options.end());
+    vector<string> records = YtDLPOutputParser::arguments();
+    args.insert(args.end(), records.begin(), records.end());
+
+    optional<filesystem::path> final_path;
+    optional<string> acodec;
+    string error; // first ERROR line, the rest of stderr is only logged
+
+    ProgressThrottle throttle(this->progress_interval);
+    YtDLPOutputParser parser;
+    parser.on_info([&acodec](const YtDLPVideoInfo &info)
+                   {
+        LOG_DEBUG("Resolved {}", "Resolved {} to video {} ({})", info.original_url, info.id, info.title);
+        acodec = info.acodec; });
+    parser.on_file_ready([&final_path](const YtDLPFileReady &ready)
+                         { final_path = ready.path; });
+    this->track_progress(parser, throttle);
+    parser.on_log([](string_view line)
+                  { LOG_INFO("{}", "{}", line); });
+
+    ProcessRunner runner(args);
+    runner.capture_output(false);
+    runner.set_deadline(deadline);
+    runner.on_stdout_line([&parser](string_view line)
+                          { parser.feed(line); });
+    runner.on_stderr_line([&error](string_view line)
+                          {
+        LOG_ERROR("{}", "{}", line);
+        if (error.empty() && line.substr(0, 6) == "ERROR:")
+            error = string(line); });
+
+    ProcessResult process = runner.run();
+
+    // the stream urls in it are only good for one fetch, a later one extracts the page again
+    if (probed.has_value())
+    {
+        error_code ec;
+        filesystem::remove(probed->info_json, ec);
+    }
+
+    if (process.deadline_exceeded)
+    {
+        this->report_progress(throttle, {.url = url, .phase = DownloadPhase::Failed, .downloaded_bytes = 0, .total_bytes = nullopt, .speed = nullopt, .eta_seconds = nullopt, .transfer_finished = false, .postprocessor = ""});
+        deadline.check("Download of " + url);
     }
 
-    if (final_path.empty()) {
-        throw std::runtime_error("Could not find output path in yt-dlp output");
+    if (process.exit_code != 0 || !final_path.has_value())
+    {
+        string log = "Failed to download: " + url;
+        if (error.empty())
+            error = process.exit_code != 0 ? "yt-dlp exited with code " + to_string(process.exit_code) : "yt-dlp did not report an output file";
+        this->report_progress(throttle, {.url = url, .phase = DownloadPhase::Failed, .downloaded_bytes = 0, .total_bytes = nullopt, .speed = nullopt, .eta_seconds = nullopt, .transfer_finished = false, .postprocessor = ""});
+        THROW_AND_LOG(runtime_error, log, log + ": " + error);
     }
 
-    return final_path;
+    return FetchedAudio{.path = final_path.value(), .acodec = acodec};
 }
 
-std::filesystem::path YtDLP::download(DownloadConfig config, const std::string& url) {
-    this->config = config;
+WorkerPool &YtDLP::transcode_pool(const DownloadConfig &config)
+{
+    lock_guard<mutex> lock(this->transcoders_mutex);
+    if (!this->transcoders)
+    {
+        // 0 gives one thread per core, ffmpeg is CPU-bound
+        this->transcoders = make_unique<WorkerPool>(config.transcode_jobs > 0 ? static_cast<size_t>(config.transcode_jobs) : 0);
+        LOG_DEBUG("Started transcode pool", "Started transcode pool with " + to_string(this->transcoders->size()) + " threads");
+    }
+    return *this->transcoders;
+}
 
-    string command = this->get_path();
-    command += " \"" + url + "\" -x"; // Quote the URL
-    command += " --audio-format " + this->get_download_file_type();
+TranscodeStats YtDLP::transcode_stats() const
+{
+    return TranscodeStats{
+        .encoded = this->encoded_count.load(memory_order_relaxed),
+        .remuxed = this->remuxed_count.load(memory_order_relaxed),
+        .kept = this->kept_count.load(memory_order_relaxed)};
+}
 
-    if (config.retries >= 0)
+future<filesystem::path> YtDLP::transcode(const DownloadConfig &config, const string &url, FetchedAudio fetched, const Deadline &deadline)
+{
+    optional<TranscodeTarget> target = Transcoder::target_for(config.download_file_type);
+    TranscodeMode mode = target.has_value() ? Transcoder::mode_for(fetched, target.value()) : TranscodeMode::Keep;
+    if (target.has_value())
     {
-        command += " --retries " + to_string(config.retries);
+        switch (mode)
+        {
+        case TranscodeMode::Keep:
+            this->kept_count.fetch_add(1, memory_order_relaxed);
+            break;
+        case TranscodeMode::Remux:
+            this->remuxed_count.fetch_add(1, memory_order_relaxed);
+            break;
+        case TranscodeMode::Encode:
+            this->encoded_count.fetch_add(1, memory_order_relaxed);
+            break;
+        }
     }
 
-    if (config.audio_quality >= 0)
+    if (mode == TranscodeMode::Keep)
     {
-        command += " --audio-quality " + to_string(config.audio_quality);
+        ProgressThrottle throttle(this->progress_interval);
+        this->report_progress(throttle, {.url = url, .phase = DownloadPhase::Finished, .downloaded_bytes = 0, .total_bytes = nullopt, .speed = nullopt, .eta_seconds = nullopt, .transfer_finished = false, .postprocessor = ""});
+
+        promise<filesystem::path> done;
+        done.set_value(move(fetched.path));
+        return done.get_future();
     }
 
-    if (config.output)
+    int audio_quality = config.audio_quality;
+    return this->transcode_pool(config).submit([this, url, fetched = move(fetched), target = move(target.value()), mode, audio_quality, deadline]
+                                               {
+        // milestones only, the throttle lets every one of them through
+        ProgressThrottle throttle(this->progress_interval);
+        this->report_progress(throttle, {.url = url, .phase = DownloadPhase::PostProcessing, .downloaded_bytes = 0, .total_bytes = nullopt, .speed = nullopt, .eta_seconds = nullopt, .transfer_finished = false, .postprocessor = mode == TranscodeMode::Remux ? "Remux" : "Transcode"});
+        try
+        {
+            deadline.check("Transcode of " + url);
+            filesystem::path path = Transcoder(this->ffmpeg_path).transcode(fetched, target, audio_quality, deadline);
+            this->report_progress(throttle, {.url = url, .phase = DownloadPhase::Finished, .downloaded_bytes = 0, .total_bytes = nullopt, .speed = nullopt, .eta_seconds = nullopt, .transfer_finished = false, .postprocessor = ""});
+            return path;
+        }
+        catch (...)
+        {
+            this->report_progress(throttle, {.url = url, .phase = DownloadPhase::Failed, .downloaded_bytes = 0, .total_bytes = nullopt, .speed = nullopt, .eta_seconds = nullopt, .transfer_finished = false, .postprocessor = ""});
+            throw;
+        } });
+}
+
+vector<BatchDownloadResult> YtDLP::download_batch(const DownloadConfig &config, const vector<string> &urls, const Deadline &deadline)
+{
+    vector<BatchDownloadResult> results(urls.size());
+    vector<size_t> pending(urls.size());
+    for (size_t i = 0; i < urls.size(); i++)
     {
-        command += " -o \"" + string(config.output) + "\"";
+        results[i].url = urls[i];
+        pending[i] = i;
     }
 
-    CommandResult result = this->execute_command(command);
+    vector<string> args = {this->get_path()};
+    vector<string> options = this->download_options(config);
+    args.insert(args.end(), options.begin(), options.end());
+    vector<string> records = YtDLPOutputParser::arguments();
+    args.insert(args.end(), records.begin(), records.end());
+    // --ignore-errors keeps the worker going past a failed url, the file ready record settles each url
+    args.insert(args.end(), {"--ignore-errors", "--batch-file", "-"});
 
-    if (!result.err.empty() || result.cmd_exit_code != 0)
+    ProgressThrottle throttle(this->progress_interval);
+    auto fail = [&](size_t index, string reason)
     {
-        string log = "Failed to download: " + url;
-        string error_details = result.err.empty() ? "" : ": " + result.err;
-        THROW_AND_LOG(runtime_error, log, log + error_details);
+        results[index].error = move(reason);
+        this->report_progress(throttle, {.url = urls[index], .phase = DownloadPhase::Failed, .downloaded_bytes = 0, .total_bytes = nullopt, .speed = nullopt, .eta_seconds = nullopt, .transfer_finished = false, .postprocessor = ""});
+    };
+
+    vector<pair<size_t, future<filesystem::path>>> transcodes; // queued as files land, collected once yt-dlp is done
+
+    int respawns = 0;
+    while (!pending.empty())
+    {
+        // yt-dlp reads the whole batch file before starting, so the urls go in up front and stdin is closed
+        unordered_map<string, deque<size_t>> waiting; // url -> indices without a result yet, duplicates resolve in order
+        string input;
+        for (size_t index : pending)
+        {
+            waiting[urls[index]].push_back(index);
+            input += urls[index];
+            input += '\n';
+        }
+
+        size_t settled = 0;
+        string unattributed_error;
+        string first_stderr_line, first_error_line; // output is not captured, these explain a worker that never ran
+        unordered_map<string, optional<string>> codecs; // url -> acodec of the format yt-dlp picked
+
+        YtDLPOutputParser parser;
+        parser.on_info([&codecs](const YtDLPVideoInfo &info)
+                       { codecs[info.original_url] = info.acodec; });
+        parser.on_file_ready([&](const YtDLPFileReady &ready)
+                             {
+            auto found = waiting.find(ready.original_url);
+            if (found == waiting.end() || found->second.empty())
+            {
+                LOG_WARN("Unexpected yt-dlp batch result", "Unexpected yt-dlp batch result for " + ready.original_url);
+                return;
+            }
+            size_t index = found->second.front();
+            found->second.pop_front();
+            results[index].error.clear();
+            settled++;
+            FetchedAudio fetched{.path = ready.path, .acodec = codecs[ready.original_url]};
+            transcodes.emplace_back(index, this->transcode(config, ready.original_url, move(fetched), deadline)); });
+        this->track_progress(parser, throttle);
+        parser.on_log([](string_view line)
+                      { LOG_INFO("{}", "{}", line); });
+
+        ProcessRunner runner(args);
+        runner.set_stdin(move(input));
+        runner.capture_output(false);
+        runner.set_deadline(deadline);
+        runner.on_stdout_line([&parser](string_view line)
+                              { parser.feed(line); });
+        runner.on_stderr_line([&](string_view line)
+                              {
+            LOG_ERROR("{}", "{}", line);
+            if (first_stderr_line.empty())
+                first_stderr_line = string(line);
+            // bad options are reported by argparse as "yt-dlp: error: ...", after the usage line
+            if (first_error_line.empty() && (line.substr(0, 6) == "ERROR:" || line.find(": error: ") != string_view::npos))
+                first_error_line = string(line);
+            if (line.substr(0, 6) != "ERROR:")
+                return;
+            // "ERROR: [youtube] <video id>: reason", attributed to the first unsettled url naming that video
+            for (auto &[url, indices] : waiting)
+            {
+                string_view id = video_id_of(url);
+                if (indices.empty() || id.empty() || line.find(id) == string_view::npos)
+                    continue;
+                size_t index = indices.front();
+                indices.pop_front();
+                fail(index, string(line));
+                settled++;
+                return;
+            }
+            unattributed_error = string(line); });
+
+        ProcessResult process = runner.run();
+
+        vector<size_t> unfinished;
+        for (auto &[url, indices] : waiting)
+            unfinished.insert(unfinished.end(), indices.begin(), indices.end());
+        sort(unfinished.begin(), unfinished.end());
+
+        if (unfinished.empty())
+            break;
+
+        auto fail_all = [&](const string &reason)
+        {
+            for (size_t index : unfinished)
+                fail(index, reason);
+        };
+
+        if (process.deadline_exceeded)
+        {
+            fail_all(deadline.token().is_cancelled() ? "download cancelled" : "download deadline exceeded");
+            break;
+        }
+
+        // respawning cannot help when the binary or the options are the problem
+        if (process.exit_code == 127 || process.exit_code == YtDLPExitCodes::UserOptionsError)
+        {
+            string error = first_error_line.empty() ? first_stderr_line : first_error_line;
+            fail_all("yt-dlp could not run the batch (exit code " + to_string(process.exit_code) + ")" + (error.empty() ? "" : ": " + error));
+            break;
+        }
+
+        // 0 or 1 (some urls failed) means the worker went through the whole list, whatever is left was rejected
+        // without an error we could attribute to it
+        if (process.exit_code == YtDLPExitCodes::Success || process.exit_code == YtDLPExitCodes::GenericError)
+        {
+            fail_all(unattributed_error.empty() ? "yt-dlp finished without producing a file" : unattributed_error);
+            break;
+        }
+
+        string reason = "yt-dlp worker exited with code " + to_string(process.exit_code);
+        if (respawns == MAX_WORKER_RESPAWNS)
+        {
+            LOG_ERROR("yt-dlp batch worker keeps failing, giving up", reason + ", giving up on " + to_string(unfinished.size()) + " urls");
+            fail_all(reason);
+            break;
+        }
+
+        // a worker that died before settling anything is stuck on its first url, drop it so the respawn can move on
+        if (settled == 0)
+        {
+            fail(unfinished.front(), reason + " while downloading it");
+            unfinished.erase(unfinished.begin());
+        }
+
+        respawns++;
+        LOG_WARN("Restarting yt-dlp batch worker", reason + ", restarting it for the " + to_string(unfinished.size()) + " remaining urls");
+        pending = move(unfinished);
+    }
+
+    for (auto &[index, transcoded] : transcodes)
+    {
+        try
+        {
+            results[index].path = transcoded.get();
+        }
+        catch (const exception &e)
+        {
+            results[index].error = e.what();
+        }
     }
 
-    // Get the actual output path from yt-dlp output
-    return get_real_output_path(result);
+    return results;
 }
 
-string YtDLP::get_download_file_type()
+string YtDLP::get_download_file_type(const DownloadConfig &config) const
 {
-    switch (this->config.download_file_type)
+    switch (config.download_file_type)
     {
     case DownloadFileType::MP3:
         return "mp3";
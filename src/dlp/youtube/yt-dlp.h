@@ -6,8 +6,23 @@
 #include <gtest/gtest.h>
 #endif
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "../../../include/spotify-dlp.h"
+#include "output_parser.h"
+#include "progress.h"
+#include "transcoder.h"
+#include "../../utils/deadline.h"
+#include "../../utils/worker_pool.h"
 
 enum YtDLPExitCodes
 {
@@ -18,6 +33,12 @@ enum YtDLPExitCodes
     GenericError = 1,
 };
 
+enum class YtDLPExecutionMode
+{
+    Disk,   // extracted once to the per-user cache directory
+    Memory, // Linux only: sealed memfd executed through /proc/self/fd, no filesystem writes; falls back to Disk
+};
+
 struct CommandResult
 {
     int cmd_exit_code;
@@ -26,10 +47,48 @@ struct CommandResult
     std::string err;
 };
 
+struct BatchDownloadResult
+{
+    std::string url;
+    std::optional<std::filesystem::path> path; // std::nullopt when the download failed
+    std::string error;                         // yt-dlp's error for this url, empty on success
+};
+
+struct YtDLPAudioFormat
+{
+    std::string format_id;
+    std::string ext;
+    std::string acodec;
+    std::optional<double> abr; // kbit/s
+};
+
+// what yt-dlp -J extracted for one video, the full info JSON stays on disk for --load-info-json
+struct VideoProbe
+{
+    std::string video_id;
+    std::string title;
+    std::optional<double> duration_seconds;
+    std::string availability; // "public", "unlisted", "needs_auth", ... empty when yt-dlp did not say
+    bool is_live = false;
+    std::vector<YtDLPAudioFormat> audio_formats; // audio-only formats
+    std::filesystem::path info_json;
+};
+
+// what transcode() did with each fetched file that was not BEST
+struct TranscodeStats
+{
+    uint64_t encoded = 0;
+    uint64_t remuxed = 0; // right codec, only the container changed
+    uint64_t kept = 0;    // fetched in the target format
+    uint64_t skipped() const { return remuxed + kept; } // encodes avoided by fetching a native stream
+};
+
 class YtDLP
 {
 #ifdef BUILD_TEST
-    FRIEND_TEST(YtDLPTest, TestWindowsExtraction);
+    FRIEND_TEST(YtDLPTest, TestExtractionIsReused);
+    FRIEND_TEST(YtDLPTest, TestExtractionReplacesTruncatedBinary);
+    FRIEND_TEST(YtDLPTest, TestInMemoryExecution);
     FRIEND_TEST(YtDLPTest, TestExecuteCommand);
     FRIEND_TEST(YtDLPTest, TestInvalidCommand);
     FRIEND_TEST(YtDLPTest, TestStdErrOutput);
@@ -37,28 +96,107 @@ class YtDLP
     FRIEND_TEST(YtDLPTest, TestDownloadSuccess);
     FRIEND_TEST(YtDLPTest, TestDownloadWithCustomConfig);
     FRIEND_TEST(YtDLPTest, TestDownloadGenericError);
-    FRIEND_TEST(YtDLPTest, TestGetRealOutputPath);
-    FRIEND_TEST(YtDLPTest, TestGetRealOutputPathMissing);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadDemultiplexesResults);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadRespawnsAfterCrash);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadSkipsPoisonUrl);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadWorkerFailsToStart);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadReportsOptionsError);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadReportsProgress);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadStopsAtDeadline);
+    FRIEND_TEST(YtDLPTest, TestBatchDownloadTranscodesOffTheWorker);
+    FRIEND_TEST(YtDLPTest, TestFetchThenTranscode);
+    FRIEND_TEST(YtDLPTest, TestTranscodeFailureKeepsFetchedFile);
+    FRIEND_TEST(YtDLPTest, TestNativeStreamSkipsTranscode);
+    FRIEND_TEST(YtDLPTest, TestProbeIsCachedPerVideo);
+    FRIEND_TEST(YtDLPTest, TestFetchReusesProbedInfoJson);
+    FRIEND_TEST(YtDLPTest, TestExpiredProbeIsExtractedAgain);
+    FRIEND_TEST(YtDLPTest, TestClaimedProbeIsNotShared);
+    FRIEND_TEST(YtDLPTest, TestFailedProbeThrows);
 #endif
 
 public:
     YtDLP();
-    std::filesystem::path download(DownloadConfig config, const std::string &url);
+    explicit YtDLP(YtDLPExecutionMode mode);
+    ~YtDLP(); // removes the info JSONs of probes that were never fetched
+    // fetch() and transcode() in one go. Throws DeadlineExceeded when yt-dlp or ffmpeg had to be stopped for the deadline
+    std::filesystem::path download(DownloadConfig config, const std::string &url, const Deadline &deadline = Deadline());
+    // Extracts a video once with yt-dlp -J and caches the result per video id, so its duration, formats and
+    // availability can be checked before committing to a download. A later fetch() of the same video hands the
+    // cached info JSON to yt-dlp (--load-info-json) instead of extracting the page again. That fetch takes the entry
+    // out of the cache and deletes its file afterwards; entries also go once PROBE_TTL passes (the stream urls inside
+    // stop working) and when this instance goes away. Throws runtime_error when yt-dlp cannot extract the url.
+    VideoProbe probe(const std::string &url, const Deadline &deadline = Deadline());
+    std::optional<VideoProbe> cached_probe(const std::string &video_id); // std::nullopt when missing or expired
+
+    // The network half of a download: yt-dlp fetches the best audio stream as it is served, preferring one already in
+    // the target codec, and nothing is converted, except for BEST where yt-dlp's -x only has to remux. Returns the
+    // fetched file and its codec, pass them on to transcode().
+    FetchedAudio fetch(const DownloadConfig &config, const std::string &url, const Deadline &deadline = Deadline());
+    // The CPU half: converts a fetched file to config.download_file_type. Files already in the target format are
+    // ready at once, the rest are remuxed or encoded on the transcode pool, shared by every download of this instance
+    // and sized by DownloadConfig::transcode_jobs the first time it is used. The future holds the final path, or the
+    // conversion's exception. Reports PostProcessing and Finished/Failed.
+    std::future<std::filesystem::path> transcode(const DownloadConfig &config, const std::string &url,
+                                                 FetchedAudio fetched, const Deadline &deadline = Deadline());
+    TranscodeStats transcode_stats() const; // since this instance was created
+    // Downloads every url with one long-lived yt-dlp fed through --batch-file -, so the interpreter and extractor
+    // startup is paid once instead of per url. A worker that dies midway is respawned with the urls it did not
+    // finish. Each fetched file is handed to transcode() right away, so yt-dlp moves on to the next url while it is
+    // converted. A url that fails only fails its own result, results are in input order. Once the deadline expires
+    // the worker is stopped and every unfinished url fails. Can still throw as a whole, e.g. runtime_error when the
+    // worker's pipes cannot be set up or polled, or whatever a progress callback throws.
+    std::vector<BatchDownloadResult> download_batch(const DownloadConfig &config, const std::vector<std::string> &urls,
+                                                    const Deadline &deadline = Deadline());
+
+    // events for every download run through this instance; per job, Downloading events are limited to one
+    // per min_interval, so the cost stays low with many parallel downloads. Without a callback none are built.
+    void on_progress(ProgressCallback callback, std::chrono::milliseconds min_interval = DEFAULT_PROGRESS_INTERVAL);
 
     std::string get_path() const;
 
 private:
-    CommandResult execute_command(const std::string &command);
-    std::string get_download_file_type();
+    static constexpr int MAX_WORKER_RESPAWNS = 3;
+    static constexpr std::chrono::milliseconds DEFAULT_PROGRESS_INTERVAL{250};
+    static constexpr std::chrono::hours PROBE_TTL{4}; // YouTube stream urls expire after about six hours
+
+    struct CachedProbe
+    {
+        VideoProbe probe;
+        std::chrono::steady_clock::time_point probed_at;
+    };
+
+    CommandResult execute_command(const std::vector<std::string> &args);
+    std::string get_download_file_type(const DownloadConfig &config) const;
+    std::vector<std::string> download_options(const DownloadConfig &config) const; // everything after the url
+    void track_progress(YtDLPOutputParser &parser, ProgressThrottle &throttle) const;
+    void report_progress(ProgressThrottle &throttle, DownloadProgressEvent event) const;
+    static VideoProbe parse_probe(const std::string &info_json); // throws runtime_error when it is not an info JSON
+    bool is_stale(const CachedProbe &cached) const;               // expired or its info JSON is gone
+    // removes a live probe from the cache for one fetch, which then owns its info JSON; std::nullopt when none
+    std::optional<VideoProbe> claim_probe(const std::string &video_id);
+    WorkerPool &transcode_pool(const DownloadConfig &config);
     bool command_return_ok(YtDLPExitCodes code);
-    void extract_yt_dlp_windows();
-    void extract_yt_dlp_linux();
-    void get_temp_path();
-    std::filesystem::path get_real_output_path(const CommandResult &result);
+    // hex content hash of the embedded binary, names its directory under user_cache_dir() so a new
+    // yt-dlp never reuses a stale extraction: SHA-256 from CMake, FNV-1a over the bytes otherwise
+    static std::string embedded_binary_key();
+    static bool is_extracted(const std::filesystem::path &path); // stat only, size and executable bit must match
+    static void extract_yt_dlp(const std::filesystem::path &destination); // temp file, chmod 0755, atomic rename
+    static std::optional<std::filesystem::path> in_memory_path(); // loaded once per process, std::nullopt when unsupported
 
-    std::filesystem::path yt_dlp_temp_path;
+    std::filesystem::path yt_dlp_path;
+    std::filesystem::path ffmpeg_path = "ffmpeg";
     std::string program_name;
-    DownloadConfig config;
+    ProgressCallback progress_callback;
+    std::chrono::milliseconds progress_interval = DEFAULT_PROGRESS_INTERVAL;
+    std::filesystem::path probe_dir; // where probe() writes info JSONs, empty means user_cache_dir() / "info-json"
+    std::chrono::steady_clock::duration probe_ttl = PROBE_TTL;
+    std::unordered_map<std::string, CachedProbe> probes; // video id -> last probe
+    std::mutex probes_mutex;
+    std::atomic<uint64_t> encoded_count{0};
+    std::atomic<uint64_t> remuxed_count{0};
+    std::atomic<uint64_t> kept_count{0};
+    std::mutex transcoders_mutex;
+    std::unique_ptr<WorkerPool> transcoders; // created by the first transcode(), last so queued jobs finish while the rest is alive
 };
 
 #endif
\ No newline at end of file
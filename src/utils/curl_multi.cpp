@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <queue>
+#include "curl_multi.h"
+#include "curl_utils.h"
+#include "http_pool.h"
+#include "logger.h"
+
+using namespace std;
+
+namespace
+{
+    using Clock = chrono::steady_clock;
+
+    struct Transfer
+    {
+        size_t index;
+        int attempt;
+        PooledCurl handle;
+        HttpResponse response{};
+    };
+
+    struct PendingAttempt
+    {
+        size_t index;
+        int attempt;
+        bool admitted; // already held back by the admission handler, starts without asking again
+    };
+
+    struct ScheduledRetry
+    {
+        Clock::time_point ready_at;
+        size_t index;
+        int attempt;
+        bool admitted;
+
+        bool operator>(const ScheduledRetry &other) const { return ready_at > other.ready_at; }
+    };
+}
+
+CurlMulti::CurlMulti(size_t max_in_flight) : max_in_flight(max(max_in_flight, size_t(1)))
+{
+    this->multi = curl_multi_init();
+    if (!this->multi)
+    {
+        throw CurlException("Failed to initialize CURL multi handle");
+    }
+    HttpPool::instance().configure_multi(this->multi);
+}
+
+CurlMulti::~CurlMulti()
+{
+    if (this->multi)
+    {
+        curl_multi_cleanup(this->multi);
+        this->multi = nullptr;
+    }
+}
+
+void CurlMulti::on_admission(AdmissionHandler handler)
+{
+    this->admission = move(handler);
+}
+
+void CurlMulti::perform(const vector<HttpRequest> &requests, const CompletionHandler &on_complete, const Deadline &deadline)
+{
+    deque<PendingAttempt> ready;
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        ready.push_back({i, 0, false});
+    }
+
+    priority_queue<ScheduledRetry, vector<ScheduledRetry>, greater<>> delayed;
+    vector<unique_ptr<Transfer>> in_flight;
+
+    // handles must leave the multi handle before their lease hands them back to the pool
+    struct InFlightCleanup
+    {
+        CURLM *multi;
+        vector<unique_ptr<Transfer>> &transfers;
+        ~InFlightCleanup()
+        {
+            for (auto &transfer : transfers)
+                curl_multi_remove_handle(multi, transfer->handle.get());
+        }
+    } cleanup{this->multi, in_flight};
+
+    auto start_transfer = [&](size_t index, int attempt)
+    {
+        auto transfer = make_unique<Transfer>();
+        transfer->index = index;
+        transfer->attempt = attempt;
+
+        const HttpRequest &request = requests[index];
+        curl_slist *headers = nullptr;
+        for (const auto &header : request.headers)
+        {
+            headers = curl_slist_append(headers, header.c_str());
+        }
+        transfer->handle.set_headers(headers);
+
+        CURL *curl = transfer->handle.get();
+        curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->response.body);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer.get());
+        apply_deadline(curl, deadline);
+
+        CURLMcode added = curl_multi_add_handle(this->multi, curl);
+        if (added != CURLM_OK)
+        {
+            string log = "Failed to queue request on CURL multi handle.";
+            THROW_AND_LOG(CurlException, log, log + " " + curl_multi_strerror(added));
+        }
+        in_flight.push_back(move(transfer));
+    };
+
+    while (!ready.empty() || !delayed.empty() || !in_flight.empty())
+    {
+        deadline.check("HTTP requests");
+
+        Clock::time_point now = Clock::now();
+        while (!delayed.empty() && delayed.top().ready_at <= now)
+        {
+            ready.push_back({delayed.top().index, delayed.top().attempt, delayed.top().admitted});
+            delayed.pop();
+        }
+
+        while (in_flight.size() < this->max_in_flight && !ready.empty())
+        {
+            PendingAttempt next = ready.front();
+            ready.pop_front();
+            if (this->admission && !next.admitted)
+            {
+                chrono::milliseconds wait = this->admission(next.index);
+                if (wait.count() > 0)
+                {
+                    delayed.push({Clock::now() + wait, next.index, next.attempt, true});
+                    continue;
+                }
+            }
+            start_transfer(next.index, next.attempt);
+        }
+
+        int running = 0;
+        CURLMcode mc = curl_multi_perform(this->multi, &running);
+        if (mc != CURLM_OK)
+        {
+            string log = "CURL multi transfer failed.";
+            THROW_AND_LOG(CurlException, log, log + " " + curl_multi_strerror(mc));
+        }
+
+        int queued = 0;
+        while (CURLMsg *msg = curl_multi_info_read(this->multi, &queued))
+        {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+
+            Transfer *transfer = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+            transfer->response.code = msg->data.result;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &transfer->response.status);
+            transfer->response.retry_after = retry_after_of(msg->easy_handle);
+            curl_multi_remove_handle(this->multi, msg->easy_handle);
+
+            RetryDelay retry = on_complete(transfer->index, transfer->response, transfer->attempt);
+            if (retry.has_value())
+            {
+                delayed.push({Clock::now() + retry.value(), transfer->index, transfer->attempt + 1, false});
+            }
+
+            in_flight.erase(find_if(in_flight.begin(), in_flight.end(),
+                                    [transfer](const unique_ptr<Transfer> &t)
+                                    { return t.get() == transfer; }));
+        }
+
+        if (in_flight.empty() && ready.empty() && delayed.empty())
+            break;
+        deadline.check("HTTP requests");
+
+        if (!ready.empty() && in_flight.size() < this->max_in_flight)
+            continue;
+
+        int timeout_ms = MAX_POLL_MS;
+        if (!delayed.empty())
+        {
+            auto until_retry = chrono::duration_cast<chrono::milliseconds>(delayed.top().ready_at - Clock::now());
+            timeout_ms = static_cast<int>(clamp<long long>(until_retry.count(), 0, MAX_POLL_MS));
+        }
+        if (optional<chrono::milliseconds> remaining = deadline.remaining())
+        {
+            timeout_ms = min(timeout_ms, static_cast<int>(remaining->count()));
+        }
+
+        mc = curl_multi_poll(this->multi, nullptr, 0, timeout_ms, nullptr);
+        if (mc != CURLM_OK)
+        {
+            string log = "Failed to wait on CURL multi handle.";
+            THROW_AND_LOG(CurlException, log, log + " " + curl_multi_strerror(mc));
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef CURL_MULTI_H
+#define CURL_MULTI_H
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include "deadline.h"
+
+struct HttpRequest
+{
+    std::string url;
+    std::vector<std::string> headers;
+};
+
+struct HttpResponse
+{
+    CURLcode code;
+    long status;
+    std::string body;
+    std::optional<std::chrono::seconds> retry_after; // the Retry-After header, either form, when the server sent one
+};
+
+// Returning a delay from the completion handler re-queues the request after that delay,
+// std::nullopt marks it as finished.
+using RetryDelay = std::optional<std::chrono::milliseconds>;
+using CompletionHandler = std::function<RetryDelay(size_t index, const HttpResponse &response, int attempt)>;
+// Asked before each attempt starts, retries included; a positive wait holds that attempt back for as long
+// without asking again. Lets a rate limiter pace the transfers.
+using AdmissionHandler = std::function<std::chrono::milliseconds(size_t index)>;
+
+// Drives many GET requests over one curl multi handle with a cap on how many are in flight.
+// Delayed retries only park the request that asked for them, the rest keep running.
+class CurlMulti
+{
+public:
+    explicit CurlMulti(size_t max_in_flight);
+    ~CurlMulti();
+
+    CurlMulti(const CurlMulti &) = delete;
+    CurlMulti &operator=(const CurlMulti &) = delete;
+
+    // Blocks until every request has completed, the handler is invoked on the calling thread.
+    // In-flight transfers end with CURLE_OPERATION_TIMEDOUT or CURLE_ABORTED_BY_CALLBACK when the deadline passes
+    // or is cancelled, and DeadlineExceeded is thrown if requests are still left (queued or waiting for a retry).
+    void perform(const std::vector<HttpRequest> &requests, const CompletionHandler &on_complete, const Deadline &deadline = Deadline());
+    void on_admission(AdmissionHandler handler);
+
+private:
+    static constexpr int MAX_POLL_MS = 1000;
+
+    CURLM *multi = nullptr;
+    size_t max_in_flight;
+    AdmissionHandler admission;
+};
+
+#endif
@@ -1,12 +1,55 @@
 #include "curl_utils.h"
+#include <algorithm>
 #include <stdexcept>
 
+namespace
+{
+    int abort_when_cancelled(void *clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+    {
+        return static_cast<const std::atomic<bool> *>(clientp)->load(std::memory_order_relaxed) ? 1 : 0;
+    }
+}
+
 size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     ((std::string *)userp)->append((char *)contents, size * nmemb);
     return size * nmemb;
 }
 
+void apply_deadline(CURL *curl, const Deadline &deadline)
+{
+    std::optional<std::chrono::milliseconds> remaining = deadline.remaining();
+    if (remaining.has_value())
+    {
+        // 0 would mean no timeout at all
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(std::max<long long>(remaining->count(), 1)));
+    }
+
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, abort_when_cancelled);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool> *>(deadline.token().flag()));
+}
+
+std::optional<std::chrono::seconds> retry_after_of(CURL *curl)
+{
+    curl_off_t retry_after = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after) != CURLE_OK || retry_after <= 0)
+    {
+        return std::nullopt;
+    }
+    return std::chrono::seconds(retry_after);
+}
+
+std::optional<std::string> response_header(CURL *curl, const char *name)
+{
+    curl_header *header = nullptr;
+    if (curl_easy_header(curl, name, 0, CURLH_HEADER, -1, &header) != CURLHE_OK)
+    {
+        return std::nullopt;
+    }
+    return std::string(header->value);
+}
+
 CurlGuard::CurlGuard()
 {
     curl = curl_easy_init();
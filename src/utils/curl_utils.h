@@ -3,11 +3,24 @@
 #define CURL_UTILS_H
 
 #include <curl/curl.h>
+#include <chrono>
+#include <optional>
 #include <string>
+#include "deadline.h"
 
 // Callback function for CURL write operations
 size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp);
 
+// Caps the transfer at the time left (CURLE_OPERATION_TIMEDOUT) and aborts it once the deadline's token is
+// cancelled (CURLE_ABORTED_BY_CALLBACK). The deadline's token must outlive the transfer.
+void apply_deadline(CURL *curl, const Deadline &deadline);
+
+// the last response's Retry-After header, a delay or an HTTP date, std::nullopt when it had none
+std::optional<std::chrono::seconds> retry_after_of(CURL *curl);
+
+// value of a header in the last response, std::nullopt when it was not sent
+std::optional<std::string> response_header(CURL *curl, const char *name);
+
 class CurlException : public std::exception
 {
     std::string msg;
@@ -0,0 +1,89 @@
+#include "deadline.h"
+#include "logger.h"
+
+using namespace std;
+
+CancellationToken::CancellationToken() : cancelled(make_shared<atomic<bool>>(false))
+{
+}
+
+void CancellationToken::cancel() const
+{
+    this->cancelled->store(true, memory_order_relaxed);
+}
+
+bool CancellationToken::is_cancelled() const
+{
+    return this->cancelled->load(memory_order_relaxed);
+}
+
+const atomic<bool> *CancellationToken::flag() const
+{
+    return this->cancelled.get();
+}
+
+Deadline::Deadline()
+{
+}
+
+Deadline::Deadline(CancellationToken token) : cancellation(move(token)), cancellable(true)
+{
+}
+
+Deadline::Deadline(Clock::time_point at) : at(at)
+{
+}
+
+Deadline::Deadline(Clock::time_point at, CancellationToken token) : at(at), cancellation(move(token)), cancellable(true)
+{
+}
+
+Deadline Deadline::after(chrono::milliseconds budget)
+{
+    return Deadline(Clock::now() + budget);
+}
+
+Deadline Deadline::after(chrono::milliseconds budget, CancellationToken token)
+{
+    return Deadline(Clock::now() + budget, move(token));
+}
+
+bool Deadline::is_bounded() const
+{
+    return this->at.has_value();
+}
+
+bool Deadline::is_cancellable() const
+{
+    return this->cancellable;
+}
+
+bool Deadline::expired() const
+{
+    return this->cancellation.is_cancelled() || (this->at.has_value() && Clock::now() >= this->at.value());
+}
+
+optional<chrono::milliseconds> Deadline::remaining() const
+{
+    if (!this->at.has_value())
+        return nullopt;
+    if (this->cancellation.is_cancelled())
+        return chrono::milliseconds(0);
+
+    auto left = chrono::ceil<chrono::milliseconds>(this->at.value() - Clock::now());
+    return max(left, chrono::milliseconds(0));
+}
+
+const CancellationToken &Deadline::token() const
+{
+    return this->cancellation;
+}
+
+void Deadline::check(const string &stage) const
+{
+    if (!this->expired())
+        return;
+
+    string log = stage + (this->cancellation.is_cancelled() ? " was cancelled" : " ran past its deadline");
+    THROW_AND_LOG(DeadlineExceeded, log, log);
+}
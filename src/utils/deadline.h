@@ -0,0 +1,62 @@
+#pragma once
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+class DeadlineExceeded : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Copies share one flag, so whoever holds a copy can stop the job and every stage working on it sees that.
+class CancellationToken
+{
+public:
+    CancellationToken();
+
+    void cancel() const;
+    bool is_cancelled() const;
+    const std::atomic<bool> *flag() const; // stays valid while any copy of the token is alive
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+// When a job has to be finished by, and the token that can end it sooner. Passed down by reference through
+// the metadata, search and download stages; curl transfers and child processes are stopped once it expires.
+class Deadline
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Deadline();                                // no time limit and nobody can cancel it
+    explicit Deadline(CancellationToken token); // no time limit, only cancellation
+    explicit Deadline(Clock::time_point at);
+    Deadline(Clock::time_point at, CancellationToken token);
+
+    static Deadline after(std::chrono::milliseconds budget);
+    static Deadline after(std::chrono::milliseconds budget, CancellationToken token);
+
+    bool is_bounded() const;
+    bool is_cancellable() const; // a CancellationToken was handed in, so it may expire without being bounded
+    bool expired() const; // passed or cancelled
+    std::optional<std::chrono::milliseconds> remaining() const; // std::nullopt when unbounded, 0 once expired
+    const CancellationToken &token() const;
+
+    // throws DeadlineExceeded naming the stage that ran out of time
+    void check(const std::string &stage) const;
+
+private:
+    std::optional<Clock::time_point> at;
+    CancellationToken cancellation;
+    bool cancellable = false;
+};
+
+#endif
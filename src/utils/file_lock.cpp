@@ -0,0 +1,37 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+#include "file_lock.h"
+#include "logger.h"
+
+using namespace std;
+
+FileLock::FileLock(const filesystem::path &path)
+{
+#ifndef _WIN32
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd != -1 && flock(fd, LOCK_EX) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    if (fd == -1)
+    {
+        LOG_WARN("Could not lock " + path.filename().string(), "Could not lock " + path.string() + ", continuing without it");
+    }
+#endif
+}
+
+FileLock::~FileLock()
+{
+#ifndef _WIN32
+    if (fd != -1)
+    {
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+#endif
+}
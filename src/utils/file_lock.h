@@ -0,0 +1,23 @@
+#pragma once
+#ifndef FILE_LOCK_H
+#define FILE_LOCK_H
+
+#include <filesystem>
+
+// Exclusive advisory lock (flock) on a separate lock file, held until the object goes away, so processes sharing
+// a file take turns. Locks are per open file, two instances in one process exclude each other as well. When the
+// lock cannot be taken a warning is logged and the caller carries on without it. Windows locks nothing.
+class FileLock
+{
+public:
+    explicit FileLock(const std::filesystem::path &path);
+    ~FileLock();
+
+    FileLock(const FileLock &) = delete;
+    FileLock &operator=(const FileLock &) = delete;
+
+private:
+    int fd = -1;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// FNV-1a, stable across compilers and runs unlike std::hash, so it is safe to use in file names
+constexpr uint64_t fnv1a_64(std::string_view data, uint64_t seed = 14695981039346656037ull)
+{
+    uint64_t hash = seed;
+    for (unsigned char c : data)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline std::string to_hex(uint64_t value)
+{
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string out(16, '0');
+    for (int i = 15; i >= 0; i--, value >>= 4)
+    {
+        out[i] = digits[value & 0xf];
+    }
+    return out;
+}
+
+#endif
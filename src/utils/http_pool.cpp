@@ -0,0 +1,154 @@
+#include <vector>
+#include "http_pool.h"
+#include "curl_utils.h"
+#include "logger.h"
+
+using namespace std;
+
+namespace
+{
+    // released handles of the calling thread, so a handle and the connections it holds never change threads
+    struct IdleHandles
+    {
+        vector<CURL *> handles;
+
+        ~IdleHandles()
+        {
+            for (CURL *curl : handles)
+            {
+                curl_easy_cleanup(curl);
+            }
+        }
+    };
+
+    thread_local IdleHandles idle;
+}
+
+PooledCurl::PooledCurl() : curl(HttpPool::instance().acquire()) {}
+
+PooledCurl::~PooledCurl()
+{
+    if (headers)
+    {
+        curl_slist_free_all(headers);
+        headers = nullptr;
+    }
+    if (curl)
+    {
+        HttpPool::instance().release(curl);
+        curl = nullptr;
+    }
+}
+
+void PooledCurl::set_headers(struct curl_slist *new_headers)
+{
+    if (headers)
+    {
+        curl_slist_free_all(headers);
+    }
+    headers = new_headers;
+}
+
+CURL *PooledCurl::get() { return curl; }
+
+HttpPool &HttpPool::instance()
+{
+    static HttpPool pool;
+    return pool;
+}
+
+HttpPool::HttpPool()
+{
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        throw CurlException("Failed to initialize CURL globally");
+    }
+
+    this->share = curl_share_init();
+    if (!this->share)
+    {
+        throw CurlException("Failed to initialize CURL share handle");
+    }
+
+    curl_share_setopt(this->share, CURLSHOPT_LOCKFUNC, &HttpPool::lock_share);
+    curl_share_setopt(this->share, CURLSHOPT_UNLOCKFUNC, &HttpPool::unlock_share);
+    curl_share_setopt(this->share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(this->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(this->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+HttpPool::~HttpPool()
+{
+    // the exiting thread's idle handles went first, thread_local objects are destroyed before statics
+    curl_share_cleanup(this->share);
+    curl_global_cleanup();
+}
+
+void HttpPool::lock_share(CURL *, curl_lock_data data, curl_lock_access, void *userptr)
+{
+    static_cast<HttpPool *>(userptr)->share_locks[data].lock();
+}
+
+void HttpPool::unlock_share(CURL *, curl_lock_data data, void *userptr)
+{
+    static_cast<HttpPool *>(userptr)->share_locks[data].unlock();
+}
+
+void HttpPool::apply_defaults(CURL *curl)
+{
+    curl_easy_setopt(curl, CURLOPT_SHARE, this->share);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, MAX_TOTAL_CONNECTIONS);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, CONNECT_TIMEOUT_MS);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, LOW_SPEED_LIMIT_BYTES);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, LOW_SPEED_TIME_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, LoggerUtils::detail::g_debug ? 1L : 0L);
+}
+
+CURL *HttpPool::acquire()
+{
+    CURL *curl = nullptr;
+    if (!idle.handles.empty())
+    {
+        curl = idle.handles.back();
+        idle.handles.pop_back();
+    }
+
+    if (!curl)
+    {
+        curl = curl_easy_init();
+        if (!curl)
+        {
+            throw CurlException("Failed to initialize CURL handle");
+        }
+    }
+
+    this->apply_defaults(curl);
+    return curl;
+}
+
+void HttpPool::release(CURL *curl)
+{
+    // reset drops the options of the last request but keeps the handle's caches warm
+    curl_easy_reset(curl);
+
+    if (idle.handles.size() < MAX_IDLE_HANDLES)
+    {
+        idle.handles.push_back(curl);
+        return;
+    }
+    curl_easy_cleanup(curl);
+}
+
+void HttpPool::configure_multi(CURLM *multi) const
+{
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, MAX_CONNECTIONS_PER_HOST);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, MAX_TOTAL_CONNECTIONS);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <array>
+#include <mutex>
+#include <curl/curl.h>
+
+class HttpPool;
+
+// RAII lease on a pooled easy handle, hands the handle back to the pool when destroyed.
+// Used like CurlGuard: set options on get(), give the header list to set_headers() so it is freed with the lease.
+class PooledCurl
+{
+public:
+    PooledCurl();
+    ~PooledCurl();
+
+    PooledCurl(const PooledCurl &) = delete;
+    PooledCurl &operator=(const PooledCurl &) = delete;
+    PooledCurl(PooledCurl &&) = delete;
+    PooledCurl &operator=(PooledCurl &&) = delete;
+
+    void set_headers(struct curl_slist *new_headers);
+
+    CURL *get();
+
+private:
+    CURL *curl = nullptr;
+    struct curl_slist *headers = nullptr;
+};
+
+// Process-wide pool of easy handles shared by SpotifyAPI and Youtube.
+// Every handle is attached to one CURLSH, so DNS lookups and TLS sessions are reused across requests and threads.
+// Open connections are not shared, libcurl cannot hand one connection to concurrent threads: idle handles are kept
+// per thread and keep their connections with them, and transfers run through a CurlMulti use that multi's cache.
+// Connections prefer HTTP/2 and are multiplexed when the server allows it.
+class HttpPool
+{
+public:
+    static constexpr long MAX_CONNECTIONS_PER_HOST = 8;
+    static constexpr long MAX_TOTAL_CONNECTIONS = 32;
+    // every transfer gets these, so a dead host or a stalled connection cannot hold a worker forever
+    static constexpr long CONNECT_TIMEOUT_MS = 10000;
+    static constexpr long LOW_SPEED_LIMIT_BYTES = 1;   // aborted when slower than this...
+    static constexpr long LOW_SPEED_TIME_SECONDS = 30; // ...for this long
+
+    static HttpPool &instance();
+
+    // applies multiplexing and the per-host connection cap to a multi handle
+    void configure_multi(CURLM *multi) const;
+
+private:
+    friend class PooledCurl;
+
+    static constexpr size_t MAX_IDLE_HANDLES = 8; // per thread
+
+    HttpPool();
+    ~HttpPool();
+
+    CURL *acquire();
+    void release(CURL *curl);
+    void apply_defaults(CURL *curl);
+
+    static void lock_share(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
+    static void unlock_share(CURL *handle, curl_lock_data data, void *userptr);
+
+    CURLSH *share = nullptr;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> share_locks;
+};
+
+#endif
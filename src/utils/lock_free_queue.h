@@ -0,0 +1,112 @@
+#pragma once
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+// Bounded multi-producer multi-consumer queue (Vyukov's sequence-numbered ring).
+// Producers never block: try_push returns false when the queue is full, so a slow consumer
+// loses events instead of stalling the threads that produce them.
+template <typename T>
+class LockFreeQueue
+{
+public:
+    // rounded up to a power of two
+    explicit LockFreeQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        this->mask = size - 1;
+        this->cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; i++)
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LockFreeQueue(const LockFreeQueue &) = delete;
+    LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+    bool try_push(T value)
+    {
+        Cell *cell;
+        size_t position = this->enqueue_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &this->cells[position & this->mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0)
+            {
+                if (this->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false; // full, the cell still holds an unconsumed value
+            }
+            else
+            {
+                position = this->enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> try_pop()
+    {
+        Cell *cell;
+        size_t position = this->dequeue_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &this->cells[position & this->mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+            if (difference == 0)
+            {
+                if (this->dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return std::nullopt; // empty
+            }
+            else
+            {
+                position = this->dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        T value = std::move(cell->value);
+        cell->sequence.store(position + this->mask + 1, std::memory_order_release);
+        return value;
+    }
+
+    size_t capacity() const
+    {
+        return this->mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_position{0}; // separate cache lines, producers and consumers do not share
+    alignas(64) std::atomic<size_t> dequeue_position{0};
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include <cstdlib>
+#include "paths.h"
+
+using namespace std;
+
+namespace
+{
+    filesystem::path env_path(const char *name)
+    {
+        const char *value = getenv(name);
+        return (value && *value) ? filesystem::path(value) : filesystem::path();
+    }
+}
+
+filesystem::path user_cache_dir()
+{
+    filesystem::path base;
+#ifdef _WIN32
+    base = env_path("LOCALAPPDATA");
+#else
+    base = env_path("XDG_CACHE_HOME");
+    if (base.empty())
+    {
+        filesystem::path home = env_path("HOME");
+        if (!home.empty())
+            base = home / ".cache";
+    }
+#endif
+    if (base.empty())
+        base = filesystem::temp_directory_path();
+
+    filesystem::path dir = base / "spotify-dlp";
+    filesystem::create_directories(dir);
+    return dir;
+}
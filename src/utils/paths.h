@@ -0,0 +1,12 @@
+#pragma once
+#ifndef PATHS_H
+#define PATHS_H
+
+#include <filesystem>
+
+// Per-user cache directory for spotify-dlp, created on first use.
+// $XDG_CACHE_HOME/spotify-dlp or ~/.cache/spotify-dlp on Linux, %LOCALAPPDATA%\spotify-dlp on Windows,
+// falling back to the system temp directory when none of those are set.
+std::filesystem::path user_cache_dir();
+
+#endif
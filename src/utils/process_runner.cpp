@@ -0,0 +1,477 @@
+#ifdef _WIN32
+#include <windows.h>
+#include <fstream>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <csignal>
+#include <poll.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include "process_runner.h"
+#include "logger.h"
+
+#ifndef _WIN32
+extern char **environ;
+#endif
+
+using namespace std;
+
+ProcessRunner::ProcessRunner(vector<string> args) : args(move(args))
+{
+    if (this->args.empty())
+    {
+        string log = "Cannot run a process without a program name.";
+        THROW_AND_LOG(invalid_argument, log, log);
+    }
+}
+
+void ProcessRunner::on_stdout_line(LineCallback callback)
+{
+    this->stdout_callback = move(callback);
+}
+
+void ProcessRunner::on_stderr_line(LineCallback callback)
+{
+    this->stderr_callback = move(callback);
+}
+
+void ProcessRunner::set_stdin(string input)
+{
+    this->stdin_data = move(input);
+}
+
+void ProcessRunner::capture_output(bool capture)
+{
+    this->capture = capture;
+}
+
+void ProcessRunner::set_deadline(Deadline deadline)
+{
+    // nothing can end an unbounded deadline without a token, polling for it would only cost a process group
+    if (!deadline.is_bounded() && !deadline.is_cancellable())
+    {
+        this->deadline.reset();
+        return;
+    }
+    this->deadline = move(deadline);
+}
+
+void ProcessRunner::dispatch_lines(string &pending, string_view chunk, const LineCallback &callback, bool flush)
+{
+    if (!callback)
+        return;
+
+    pending.append(chunk);
+
+    size_t start = 0;
+    size_t newline;
+    while ((newline = pending.find('\n', start)) != string::npos)
+    {
+        string_view line(pending.data() + start, newline - start);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        callback(line);
+        start = newline + 1;
+    }
+    pending.erase(0, start);
+
+    if (flush && !pending.empty())
+    {
+        callback(pending);
+        pending.clear();
+    }
+}
+
+#ifdef _WIN32
+ProcessResult ProcessRunner::run()
+{
+    // Windows needs temporary files to handle separate streams
+    string command;
+    for (const auto &arg : this->args)
+    {
+        if (!command.empty())
+            command += ' ';
+        command += arg.find(' ') == string::npos ? arg : "\"" + arg + "\"";
+    }
+
+    ProcessResult result{};
+    if (this->deadline.has_value() && this->deadline->expired())
+    {
+        result.exit_code = 1;
+        result.deadline_exceeded = true;
+        return result;
+    }
+
+    string cmd = command + " 1>stdout.tmp 2>stderr.tmp";
+    if (this->stdin_data.has_value())
+    {
+        ofstream stdin_file("stdin.tmp", ios::binary | ios::trunc);
+        stdin_file << this->stdin_data.value();
+        cmd += " <stdin.tmp";
+    }
+    result.exit_code = system(cmd.c_str());
+    if (this->stdin_data.has_value())
+        remove("stdin.tmp");
+
+    string pending;
+    ifstream stdout_file("stdout.tmp", ios::binary);
+    result.out.assign(istreambuf_iterator<char>(stdout_file), istreambuf_iterator<char>());
+    this->dispatch_lines(pending, result.out, this->stdout_callback, true);
+
+    ifstream stderr_file("stderr.tmp", ios::binary);
+    result.err.assign(istreambuf_iterator<char>(stderr_file), istreambuf_iterator<char>());
+    this->dispatch_lines(pending, result.err, this->stderr_callback, true);
+
+    if (!this->capture)
+    {
+        result.out.clear();
+        result.err.clear();
+    }
+
+    stdout_file.close();
+    stderr_file.close();
+    remove("stdout.tmp");
+    remove("stderr.tmp");
+
+    return result;
+}
+#else
+namespace
+{
+    struct Pipe
+    {
+        int read_end = -1;
+        int write_end = -1;
+
+        ~Pipe()
+        {
+            close_read();
+            close_write();
+        }
+
+        void close_read()
+        {
+            if (read_end != -1)
+                close(read_end);
+            read_end = -1;
+        }
+
+        void close_write()
+        {
+            if (write_end != -1)
+                close(write_end);
+            write_end = -1;
+        }
+    };
+
+    void open_pipe(Pipe &p)
+    {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0)
+        {
+            string log = "Failed to create pipe for child process.";
+            THROW_AND_LOG(runtime_error, log, log + " " + strerror(errno));
+        }
+        p.read_end = fds[0];
+        p.write_end = fds[1];
+    }
+
+    // A child that exits without reading all of its stdin must surface as EPIPE rather than a
+    // process-wide SIGPIPE, so the signal is blocked for this thread and any pending one is consumed.
+    ssize_t write_without_sigpipe(int fd, const char *data, size_t size)
+    {
+        sigset_t sigpipe, previous;
+        sigemptyset(&sigpipe);
+        sigaddset(&sigpipe, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &sigpipe, &previous);
+
+        ssize_t written = write(fd, data, size);
+        int error = errno;
+
+        if (written < 0 && error == EPIPE)
+        {
+            timespec no_wait{0, 0};
+            while (sigtimedwait(&sigpipe, nullptr, &no_wait) < 0 && errno == EINTR)
+            {
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+        errno = error;
+        return written;
+    }
+
+    // Process groups of running children that were moved out of ours. A terminal's Ctrl-C only signals the
+    // foreground group, so without forwarding yt-dlp and ffmpeg would keep running after we are gone.
+    constexpr size_t MAX_FORWARDED_GROUPS = 256;
+    array<atomic<pid_t>, MAX_FORWARDED_GROUPS> forwarded_groups{}; // 0 marks a free slot
+    struct sigaction previous_sigint, previous_sigterm;
+    once_flag forwarding_installed;
+
+    void forward_signal(int signal, siginfo_t *info, void *context)
+    {
+        for (auto &group : forwarded_groups)
+        {
+            pid_t pgid = group.load(memory_order_relaxed);
+            if (pgid > 0)
+                kill(-pgid, signal);
+        }
+
+        // then behave as if we had never been installed
+        const struct sigaction &previous = signal == SIGINT ? previous_sigint : previous_sigterm;
+        if (previous.sa_flags & SA_SIGINFO)
+        {
+            previous.sa_sigaction(signal, info, context);
+        }
+        else if (previous.sa_handler == SIG_DFL)
+        {
+            sigaction(signal, &previous, nullptr);
+            raise(signal);
+        }
+        else if (previous.sa_handler != SIG_IGN)
+        {
+            previous.sa_handler(signal);
+        }
+    }
+
+    void install_forwarding(int signal, struct sigaction &previous)
+    {
+        sigaction(signal, nullptr, &previous);
+        if (!(previous.sa_flags & SA_SIGINFO) && previous.sa_handler == SIG_IGN)
+            return; // e.g. started under nohup, the children inherit that as well
+
+        struct sigaction forwarding{};
+        forwarding.sa_sigaction = forward_signal;
+        forwarding.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&forwarding.sa_mask);
+        sigaction(signal, &forwarding, nullptr);
+    }
+
+    // registers the group for as long as the child runs
+    class ForwardedGroup
+    {
+    public:
+        explicit ForwardedGroup(pid_t pgid)
+        {
+            call_once(forwarding_installed, []
+                      {
+                install_forwarding(SIGINT, previous_sigint);
+                install_forwarding(SIGTERM, previous_sigterm); });
+
+            for (auto &group : forwarded_groups)
+            {
+                pid_t free_slot = 0;
+                if (group.compare_exchange_strong(free_slot, pgid))
+                {
+                    this->slot = &group;
+                    return;
+                }
+            }
+            LOG_DEBUG("Not forwarding signals to child", "More than " + to_string(MAX_FORWARDED_GROUPS) + " children in their own process group, signals are not forwarded to " + to_string(pgid));
+        }
+
+        ~ForwardedGroup()
+        {
+            if (this->slot)
+                this->slot->store(0);
+        }
+
+        ForwardedGroup(const ForwardedGroup &) = delete;
+        ForwardedGroup &operator=(const ForwardedGroup &) = delete;
+
+    private:
+        atomic<pid_t> *slot = nullptr;
+    };
+}
+
+ProcessResult ProcessRunner::run()
+{
+    using Clock = chrono::steady_clock;
+    ProcessResult result{};
+
+    if (this->deadline.has_value() && this->deadline->expired())
+    {
+        result.exit_code = 128 + SIGTERM;
+        result.deadline_exceeded = true;
+        return result;
+    }
+
+    Pipe in_pipe, out_pipe, err_pipe;
+    open_pipe(out_pipe);
+    open_pipe(err_pipe);
+    if (this->stdin_data.has_value())
+        open_pipe(in_pipe);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (this->stdin_data.has_value())
+        posix_spawn_file_actions_adddup2(&actions, in_pipe.read_end, STDIN_FILENO);
+    else
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out_pipe.write_end, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err_pipe.write_end, STDERR_FILENO);
+
+    vector<char *> argv;
+    argv.reserve(this->args.size() + 1);
+    for (auto &arg : this->args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    if (this->deadline.has_value())
+    {
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attributes, 0); // pgid = child pid
+    }
+
+    pid_t pid;
+    int spawn_error = posix_spawnp(&pid, argv[0], &actions, &attributes, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+
+    if (spawn_error != 0)
+    {
+        // mirror what a shell would report so callers see a normal failed command
+        result.exit_code = 127;
+        result.err = this->args[0] + ": " + strerror(spawn_error) + "\n";
+        string pending;
+        this->dispatch_lines(pending, result.err, this->stderr_callback, true);
+        return result;
+    }
+
+    optional<ForwardedGroup> forwarded;
+    if (this->deadline.has_value())
+        forwarded.emplace(pid);
+
+    // only the child keeps the write ends, so EOF on both pipes means it is done writing
+    out_pipe.close_write();
+    err_pipe.close_write();
+    in_pipe.close_read();
+
+    // stdin is fed from the same loop so a child blocked writing output never deadlocks against us writing its input
+    string_view input = this->stdin_data.has_value() ? string_view(this->stdin_data.value()) : string_view();
+    if (in_pipe.write_end != -1)
+    {
+        fcntl(in_pipe.write_end, F_SETFL, fcntl(in_pipe.write_end, F_GETFL) | O_NONBLOCK);
+        if (input.empty())
+            in_pipe.close_write();
+    }
+
+    array<char, READ_BUFFER_SIZE> buffer;
+    string out_pending, err_pending;
+    array<pollfd, 3> fds = {{{out_pipe.read_end, POLLIN, 0}, {err_pipe.read_end, POLLIN, 0}, {in_pipe.write_end, POLLOUT, 0}}};
+    int open_streams = 2;
+    optional<Clock::time_point> kill_at; // set once the group got SIGTERM
+    bool killed = false;
+
+    while (open_streams > 0)
+    {
+        int timeout_ms = -1;
+        if (this->deadline.has_value() && !killed)
+        {
+            if (!kill_at.has_value() && this->deadline->expired())
+            {
+                kill(-pid, SIGTERM);
+                kill_at = Clock::now() + KILL_GRACE;
+                result.deadline_exceeded = true;
+                in_pipe.close_write();
+                fds[2].fd = -1;
+            }
+            if (kill_at.has_value() && Clock::now() >= kill_at.value())
+            {
+                kill(-pid, SIGKILL);
+                killed = true;
+            }
+
+            timeout_ms = DEADLINE_POLL_MS;
+            optional<chrono::milliseconds> remaining = this->deadline->remaining();
+            if (!kill_at.has_value() && remaining.has_value())
+                timeout_ms = min<long long>(timeout_ms, remaining->count());
+        }
+
+        if (poll(fds.data(), fds.size(), timeout_ms) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            string log = "Failed to poll child process output.";
+            THROW_AND_LOG(runtime_error, log, log + " " + strerror(errno));
+        }
+
+        if (fds[2].fd != -1 && fds[2].revents != 0)
+        {
+            bool done = true; // POLLERR/POLLHUP without POLLOUT: the child closed its end
+            if (fds[2].revents & POLLOUT)
+            {
+                ssize_t n = write_without_sigpipe(fds[2].fd, input.data(), input.size());
+                if (n > 0)
+                    input.remove_prefix(static_cast<size_t>(n));
+                done = input.empty() || (n < 0 && errno != EINTR && errno != EAGAIN);
+            }
+
+            if (done)
+            {
+                // done, or the child closed its end (EPIPE) and will never read the rest
+                in_pipe.close_write();
+                fds[2].fd = -1;
+            }
+        }
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            if (fds[i].fd == -1 || fds[i].revents == 0)
+                continue;
+
+            ssize_t n = read(fds[i].fd, buffer.data(), buffer.size());
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            bool is_out = i == 0;
+            string &captured = is_out ? result.out : result.err;
+            string &pending = is_out ? out_pending : err_pending;
+            const LineCallback &callback = is_out ? this->stdout_callback : this->stderr_callback;
+
+            if (n <= 0)
+            {
+                this->dispatch_lines(pending, {}, callback, true);
+                fds[i].fd = -1;
+                open_streams--;
+                continue;
+            }
+
+            string_view chunk(buffer.data(), static_cast<size_t>(n));
+            if (this->capture)
+                captured.append(chunk);
+            this->dispatch_lines(pending, chunk, callback, false);
+        }
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            string log = "Failed to wait for child process.";
+            THROW_AND_LOG(runtime_error, log, log + " " + strerror(errno));
+        }
+    }
+
+    if (WIFEXITED(status))
+        result.exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        result.exit_code = 128 + WTERMSIG(status);
+
+    return result;
+}
+#endif
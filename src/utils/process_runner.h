@@ -0,0 +1,65 @@
+#pragma once
+#ifndef PROCESS_RUNNER_H
+#define PROCESS_RUNNER_H
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "deadline.h"
+
+struct ProcessResult
+{
+    int exit_code; // exit status of the child, 128 + signal if it was killed, 127 if it could not be started
+    std::string out;
+    std::string err;
+    bool deadline_exceeded = false; // the child was stopped because the deadline passed or was cancelled
+};
+
+using LineCallback = std::function<void(std::string_view line)>;
+
+// Runs a single child process straight from an argv vector (no shell involved)
+// and drains stdout and stderr together so neither pipe can fill up and stall the child.
+class ProcessRunner
+{
+public:
+    explicit ProcessRunner(std::vector<std::string> args);
+
+    // called once per complete line (without the trailing newline) as output arrives
+    void on_stdout_line(LineCallback callback);
+    void on_stderr_line(LineCallback callback);
+
+    // written to the child's stdin, which is then closed so the child sees EOF; without it stdin is /dev/null
+    void set_stdin(std::string input);
+
+    // on by default; off leaves ProcessResult::out and err empty and only the line callbacks see the output,
+    // so memory stays flat however much the child prints
+    void capture_output(bool capture);
+
+    // POSIX: the child gets its own process group, which is sent SIGTERM once the deadline passes or is cancelled
+    // and SIGKILL if it is still around KILL_GRACE later, so helpers it started (yt-dlp runs ffmpeg) go with it.
+    // SIGINT and SIGTERM sent to us are forwarded to that group, since Ctrl-C only reaches the terminal's foreground
+    // group. A deadline that is neither bounded nor cancellable is ignored and the child stays in our group.
+    // Windows only checks the deadline before starting the child.
+    void set_deadline(Deadline deadline);
+
+    ProcessResult run();
+
+private:
+    static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+    static constexpr int DEADLINE_POLL_MS = 100; // how often a run with a deadline checks for cancellation
+    static constexpr std::chrono::milliseconds KILL_GRACE{2000};
+
+    void dispatch_lines(std::string &pending, std::string_view chunk, const LineCallback &callback, bool flush);
+
+    std::vector<std::string> args;
+    std::optional<std::string> stdin_data;
+    bool capture = true;
+    std::optional<Deadline> deadline;
+    LineCallback stdout_callback;
+    LineCallback stderr_callback;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Runs task(index) for every index in [0, count) on up to `jobs` threads.
+// Workers claim the next index from a shared counter, so whichever worker frees up first
+// takes the next item and one slow item never holds back the rest of the queue.
+// If a task throws, the remaining items still run and the first exception is rethrown at the end.
+template <typename Task>
+void parallel_for(size_t count, size_t jobs, Task &&task)
+{
+    jobs = std::clamp<size_t>(jobs, 1, std::max<size_t>(count, 1));
+
+    std::atomic<size_t> next_index{0};
+    std::exception_ptr first_error;
+    std::mutex error_mutex;
+
+    auto worker = [&]()
+    {
+        for (size_t index = next_index++; index < count; index = next_index++)
+        {
+            try
+            {
+                task(index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!first_error)
+                    first_error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(jobs - 1);
+    for (size_t i = 1; i < jobs; i++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker(); // the calling thread works the queue as well
+
+    for (auto &thread : workers)
+    {
+        thread.join();
+    }
+
+    if (first_error)
+        std::rethrow_exception(first_error);
+}
+
+// Long-lived threads working a shared FIFO of tasks, for stages that are fed piece by piece while other threads
+// keep producing work (e.g. transcoding each file as soon as its download lands).
+// The destructor runs whatever is still queued before joining, so no returned future is left broken.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(size_t threads) // 0 means one per hardware thread
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        this->threads.reserve(threads);
+        for (size_t i = 0; i < threads; i++)
+        {
+            this->threads.emplace_back([this]
+                                       { this->work(); });
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->ready.notify_all();
+        for (auto &thread : this->threads)
+        {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // the future carries the task's result, or rethrows what it threw
+    template <typename Task>
+    std::future<std::invoke_result_t<Task>> submit(Task &&task)
+    {
+        using Result = std::invoke_result_t<Task>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        std::future<Result> future = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->tasks.emplace_back([packaged]
+                                     { (*packaged)(); });
+        }
+        this->ready.notify_one();
+        return future;
+    }
+
+    size_t size() const { return this->threads.size(); }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->ready.wait(lock, [this]
+                                 { return this->stopping || !this->tasks.empty(); });
+                if (this->tasks.empty())
+                    return;
+                task = std::move(this->tasks.front());
+                this->tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
+
+#endif
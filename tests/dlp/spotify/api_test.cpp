@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <future>
+#include <vector>
 #include "../src/dlp/spotify/api.h"
 
 class SpotifyAPITest : public ::testing::Test
@@ -93,11 +95,17 @@ TEST_F(SpotifyAPITest, DetermineContentTypeReturnsCorrectType)
     EXPECT_EQ(api.determine_content_type("playlist"), DownloadType::Playlist);
     EXPECT_THROW(api.determine_content_type("invalid"), std::runtime_error);
 }
+TEST_F(SpotifyAPITest, ParseUrlReturnsTypeAndId)
+{
+    auto item = SpotifyAPI::parse_url("https://open.spotify.com/album/55S2SOsWCYekWJtJ8LwVqV?si=abcdef");
+    EXPECT_EQ(item.type, DownloadType::Album);
+    EXPECT_EQ(item.id, "55S2SOsWCYekWJtJ8LwVqV");
+    EXPECT_THROW(SpotifyAPI::parse_url("https://open.spotify.com/artist/123456"), std::runtime_error);
+}
 TEST_F(SpotifyAPITest, ValidateFetchToken)
 {
     SpotifyAPI api(this->client_id, this->client_secret);
-    api.fetch_oauth_token();
-    EXPECT_FALSE(api.token.empty());
+    EXPECT_FALSE(api.token_manager.get_token().empty());
 }
 TEST_F(SpotifyAPITest, SerializeArtistResponse)
 {
@@ -255,6 +263,7 @@ TEST_F(SpotifyAPITest, SerializePlaylistResponse)
     std::string test_response = R"({
         "name": "test_playlist",
         "id": "test_playlist_id",
+        "snapshot_id": "test_snapshot_id",
         "tracks": {
             "total": 1,
             "items": [{
@@ -303,6 +312,7 @@ TEST_F(SpotifyAPITest, SerializePlaylistResponse)
     PlaylistMetadata expected;
     expected.name = "test_playlist";
     expected.id = "test_playlist_id";
+    expected.snapshot_id = "test_snapshot_id";
     expected.total_tracks = 1;
     expected.tracks = {track};
 
@@ -311,24 +321,120 @@ TEST_F(SpotifyAPITest, SerializePlaylistResponse)
 TEST_F(SpotifyAPITest, FetchTrackMetadataReturnsCorrectData)
 {
     SpotifyAPI api(this->client_id, this->client_secret);
-    api.item_id = "5DQiTQrSoYOZxm5oj3lR4l";
-
-    TrackMetadata result = api.fetch_track_metadata();
+    TrackMetadata result = api.fetch_track_metadata("5DQiTQrSoYOZxm5oj3lR4l");
     ValidateTrackMetadata(result);
 }
 TEST_F(SpotifyAPITest, FetchAlbumMetadataReturnsCorrectData)
 {
     SpotifyAPI api(this->client_id, this->client_secret);
-    api.item_id = "55S2SOsWCYekWJtJ8LwVqV";
-
-    AlbumMetadata result = api.fetch_album_metadata();
+    AlbumMetadata result = api.fetch_album_metadata("55S2SOsWCYekWJtJ8LwVqV");
     ValidateAlbumMetadata(result);
 }
 TEST_F(SpotifyAPITest, FetchPlaylistMetadataReturnsCorrectData)
 {
     SpotifyAPI api(this->client_id, this->client_secret);
-    api.item_id = "7464s7OIoUO0k23f1uxzLL";
-
-    PlaylistMetadata result = api.fetch_playlist_metadata();
+    PlaylistMetadata result = api.fetch_playlist_metadata("7464s7OIoUO0k23f1uxzLL");
     ValidatePlaylistMetadata(result);
-}
\ No newline at end of file
+}
+TEST_F(SpotifyAPITest, GetMetadataIsSafeToShareBetweenThreads)
+{
+    const SpotifyAPI api(this->client_id, this->client_secret);
+    const std::vector<std::string> urls = {
+        "https://open.spotify.com/track/5DQiTQrSoYOZxm5oj3lR4l",
+        "https://open.spotify.com/album/55S2SOsWCYekWJtJ8LwVqV",
+        "https://open.spotify.com/playlist/7464s7OIoUO0k23f1uxzLL",
+    };
+
+    std::vector<std::future<AnyMetadata>> results;
+    for (int round = 0; round < 2; round++)
+    {
+        for (const auto &url : urls)
+        {
+            results.push_back(std::async(std::launch::async, [&api, url]
+                                         { return api.get_metadata(url); }));
+        }
+    }
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        AnyMetadata metadata = results[i].get();
+        switch (i % urls.size())
+        {
+        case 0:
+            ASSERT_TRUE(std::holds_alternative<TrackMetadata>(metadata));
+            ValidateTrackMetadata(std::get<TrackMetadata>(metadata));
+            break;
+        case 1:
+            ASSERT_TRUE(std::holds_alternative<AlbumMetadata>(metadata));
+            ValidateAlbumMetadata(std::get<AlbumMetadata>(metadata));
+            break;
+        default:
+            ASSERT_TRUE(std::holds_alternative<PlaylistMetadata>(metadata));
+            ValidatePlaylistMetadata(std::get<PlaylistMetadata>(metadata));
+        }
+    }
+}
+TEST_F(SpotifyAPITest, RemainingPageOffsetsCoverEveryTrack)
+{
+    EXPECT_TRUE(SpotifyAPI::remaining_page_offsets(100, 100, 100).empty());
+    EXPECT_EQ(SpotifyAPI::remaining_page_offsets(250, 100, 100), (std::vector<int>{100, 200}));
+    EXPECT_EQ(SpotifyAPI::remaining_page_offsets(120, 50, 50), (std::vector<int>{50, 100}));
+    EXPECT_EQ(SpotifyAPI::remaining_page_offsets(101, 100, 100), (std::vector<int>{100}));
+}
+TEST_F(SpotifyAPITest, AppendTrackPagesKeepsOffsetOrder)
+{
+    nlohmann::json tracks = nlohmann::json::parse(R"({
+        "items": [{"id": "0"}, {"id": "1"}],
+        "next": "https://api.spotify.com/v1/playlists/p/tracks?offset=2&limit=2",
+        "total": 5
+    })");
+    // pages are indexed by offset, whatever order their responses arrived in
+    std::vector<nlohmann::json> pages = {
+        nlohmann::json::parse(R"({"items": [{"id": "2"}, {"id": "3"}]})"),
+        nlohmann::json::parse(R"({"items": [{"id": "4"}]})"),
+    };
+
+    SpotifyAPI::append_track_pages(tracks, pages);
+
+    ASSERT_EQ(tracks["items"].size(), 5);
+    for (size_t i = 0; i < 5; i++)
+        EXPECT_EQ(tracks["items"][i]["id"], std::to_string(i));
+    EXPECT_TRUE(tracks["next"].is_null());
+}
+TEST_F(SpotifyAPITest, MultiIdUrlsGroupIds)
+{
+    EXPECT_TRUE(SpotifyAPI::multi_id_urls("/tracks", {}, 50).empty());
+    EXPECT_EQ(SpotifyAPI::multi_id_urls("/albums", {"a", "b", "c"}, 2),
+              (std::vector<std::string>{"https://api.spotify.com/v1/albums?ids=a,b", "https://api.spotify.com/v1/albums?ids=c"}));
+
+    std::vector<std::string> ids(51, "x");
+    auto urls = SpotifyAPI::multi_id_urls("/tracks", ids, 50);
+    ASSERT_EQ(urls.size(), 2);
+    EXPECT_EQ(urls[1], "https://api.spotify.com/v1/tracks?ids=x");
+}
+TEST_F(SpotifyAPITest, ParseMultiIdResponseMatchesItemsToIds)
+{
+    auto lookups = SpotifyAPI::parse_multi_id_response(R"({"tracks": [{"id": "a"}, null, {"id": "c"}]})", "tracks", 3);
+    ASSERT_EQ(lookups.size(), 3);
+    ASSERT_TRUE(lookups[0].item.has_value());
+    EXPECT_EQ(lookups[0].item->at("id"), "a");
+    EXPECT_FALSE(lookups[1].item.has_value());
+    EXPECT_FALSE(lookups[1].error.empty());
+    ASSERT_TRUE(lookups[2].item.has_value());
+    EXPECT_EQ(lookups[2].item->at("id"), "c");
+}
+TEST_F(SpotifyAPITest, ParseMultiIdResponseFailsEveryIdOnError)
+{
+    for (const std::string &body : {std::string(R"({"error": {"status": 400, "message": "invalid id"}})"),
+                                    std::string(R"({"albums": [{"id": "a"}]})"),
+                                    std::string("not json")})
+    {
+        auto lookups = SpotifyAPI::parse_multi_id_response(body, "albums", 2);
+        ASSERT_EQ(lookups.size(), 2);
+        for (const auto &lookup : lookups)
+        {
+            EXPECT_FALSE(lookup.item.has_value());
+            EXPECT_FALSE(lookup.error.empty());
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include "../src/dlp/spotify/rate_governor.h"
+
+using namespace std::chrono_literals;
+
+class RateGovernorTest : public ::testing::Test
+{
+protected:
+    static HttpResponse response(long status, std::optional<std::chrono::seconds> retry_after = std::nullopt)
+    {
+        return HttpResponse{.code = CURLE_OK, .status = status, .body = "", .retry_after = retry_after};
+    }
+};
+
+TEST_F(RateGovernorTest, BurstIsAdmittedThenPaced)
+{
+    RateGovernor governor(10, 2);
+    auto now = RateGovernor::Clock::now();
+
+    EXPECT_EQ(governor.reserve(now), 0ms);
+    EXPECT_EQ(governor.reserve(now), 0ms);
+    EXPECT_EQ(governor.reserve(now), 100ms);
+    EXPECT_EQ(governor.reserve(now), 200ms);
+    // a second later the queued tokens are paid back and one has refilled
+    EXPECT_EQ(governor.reserve(now + 1s), 0ms);
+
+    RateGovernorStats stats = governor.stats();
+    EXPECT_EQ(stats.requests, 5);
+    EXPECT_EQ(stats.waited, 300ms);
+}
+
+TEST_F(RateGovernorTest, RetryAfterPausesEveryRequest)
+{
+    RateGovernor governor(10, 10);
+    auto now = RateGovernor::Clock::now();
+
+    RetryDelay retry = governor.on_response(response(429, 2s), 0, now);
+    ASSERT_TRUE(retry.has_value());
+    EXPECT_EQ(retry.value(), 2000ms);
+    EXPECT_GE(governor.reserve(now), 2000ms);
+    EXPECT_GE(governor.reserve(now + 1s), 1000ms);
+
+    // a shorter Retry-After does not cut the pause that is already running
+    governor.on_response(response(429, 1s), 0, now);
+
+    RateGovernorStats stats = governor.stats();
+    EXPECT_EQ(stats.throttled_responses, 2);
+    EXPECT_EQ(stats.paused, 2000ms);
+    EXPECT_DOUBLE_EQ(stats.requests_per_second, 2.5);
+}
+
+TEST_F(RateGovernorTest, SuccessRaisesTheRate)
+{
+    RateGovernor governor(1, 1);
+    auto now = RateGovernor::Clock::now();
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_FALSE(governor.on_response(response(200), 0, now).has_value());
+    }
+    EXPECT_NEAR(governor.stats().requests_per_second, 2.0, 1e-9);
+
+    RateGovernor fastest(RateGovernor::MAX_RATE, 1);
+    fastest.on_response(response(200), 0, now);
+    EXPECT_DOUBLE_EQ(fastest.stats().requests_per_second, RateGovernor::MAX_RATE);
+}
+
+TEST_F(RateGovernorTest, RaisedRateOnlyAppliesFromNowOn)
+{
+    RateGovernor governor(1, 10);
+    auto now = RateGovernor::Clock::now();
+    for (int i = 0; i < 10; i++)
+        governor.reserve(now);
+
+    // five seconds at one request per second earn five tokens, not five at the raised rate
+    governor.on_response(response(200), 0, now + 5s);
+    governor.refill(now + 5s);
+    EXPECT_NEAR(governor.tokens, 5.0, 1e-9);
+    EXPECT_NEAR(governor.stats().requests_per_second, 1.1, 1e-9);
+}
+
+TEST_F(RateGovernorTest, FailuresBackOffWithJitter)
+{
+    RateGovernor governor;
+    auto now = RateGovernor::Clock::now();
+
+    for (int attempt = 0; attempt + 1 < RateGovernor::MAX_ATTEMPTS; attempt++)
+    {
+        RetryDelay retry = governor.on_response(response(503), attempt, now);
+        ASSERT_TRUE(retry.has_value());
+        auto full = std::min(RateGovernor::BASE_BACKOFF * (1 << attempt), RateGovernor::MAX_BACKOFF);
+        EXPECT_GE(retry.value(), full / 2);
+        EXPECT_LE(retry.value(), full);
+    }
+    EXPECT_FALSE(governor.on_response(response(503), RateGovernor::MAX_ATTEMPTS - 1, now).has_value());
+
+    HttpResponse refused{.code = CURLE_COULDNT_CONNECT, .status = 0, .body = "", .retry_after = std::nullopt};
+    EXPECT_TRUE(governor.on_response(refused, 0, now).has_value());
+    EXPECT_FALSE(governor.on_response(response(404), 0, now).has_value());
+    EXPECT_EQ(governor.stats().retries, RateGovernor::MAX_ATTEMPTS);
+}
+
+TEST_F(RateGovernorTest, AcquireStopsAtDeadline)
+{
+    RateGovernor governor(RateGovernor::MIN_RATE, 1);
+    governor.acquire(Deadline::after(1s));
+    // the next token is two seconds away
+    EXPECT_THROW(governor.acquire(Deadline::after(100ms)), DeadlineExceeded);
+
+    // the refused request handed its token back, the next one waits for the same slot and not the one after
+    EXPECT_EQ(governor.stats().requests, 1);
+    EXPECT_LE(governor.reserve(), 2000ms);
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include "../src/dlp/spotify/response_cache.h"
+#include "../../temp_dir.h"
+
+class ResponseCacheTest : public ::testing::Test
+{
+protected:
+    TempDir temp_dir{"spotify_dlp_response_cache_test"};
+    std::filesystem::path dir = temp_dir.path() / "cache"; // created by the cache
+};
+
+TEST_F(ResponseCacheTest, ParsesCacheControl)
+{
+    EXPECT_EQ(ResponseCache::max_age("public, max-age=3600"), std::chrono::seconds(3600));
+    EXPECT_EQ(ResponseCache::max_age("Private, Max-Age = 60"), std::chrono::seconds(60));
+    EXPECT_EQ(ResponseCache::max_age(""), std::chrono::seconds(0));
+    EXPECT_EQ(ResponseCache::max_age("max-age=60, no-cache"), std::chrono::seconds(0));
+    EXPECT_EQ(ResponseCache::max_age("max-age=abc"), std::chrono::seconds(0));
+    EXPECT_FALSE(ResponseCache::max_age("no-store, max-age=60").has_value());
+}
+
+TEST_F(ResponseCacheTest, FreshResponseIsAHit)
+{
+    ResponseCache cache(dir);
+    EXPECT_FALSE(cache.lookup("https://api.spotify.com/v1/tracks/a").has_value());
+
+    cache.store("https://api.spotify.com/v1/tracks/a", R"({"id": "a"})", "\"etag-a\"", "public, max-age=3600");
+    auto cached = cache.lookup("https://api.spotify.com/v1/tracks/a");
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_TRUE(cached->is_fresh());
+    EXPECT_EQ(cached->body, R"({"id": "a"})");
+    EXPECT_EQ(cached->etag, "\"etag-a\"");
+
+    ResponseCacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.entries, 1);
+}
+
+TEST_F(ResponseCacheTest, StaleResponseIsRevalidated)
+{
+    ResponseCache cache(dir);
+    cache.store("url", "body", "\"v1\"", "max-age=0");
+
+    auto cached = cache.lookup("url");
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_FALSE(cached->is_fresh());
+    EXPECT_EQ(cache.stats().hits, 0);
+
+    cache.revalidated(cached.value(), "max-age=600");
+    auto renewed = cache.lookup("url");
+    ASSERT_TRUE(renewed.has_value());
+    EXPECT_TRUE(renewed->is_fresh());
+    EXPECT_EQ(renewed->body, "body");
+    EXPECT_EQ(cache.stats().revalidated, 1);
+    EXPECT_EQ(cache.stats().hits, 1);
+}
+
+TEST_F(ResponseCacheTest, SkipsResponsesThatCannotBeReused)
+{
+    ResponseCache cache(dir);
+    cache.store("no-store", "body", "\"v1\"", "no-store");
+    cache.store("no-validator", "body", "", "max-age=0");
+    EXPECT_FALSE(cache.lookup("no-store").has_value());
+    EXPECT_FALSE(cache.lookup("no-validator").has_value());
+    EXPECT_EQ(cache.stats().entries, 0);
+    EXPECT_EQ(cache.stats().misses, 2);
+}
+
+TEST_F(ResponseCacheTest, UncacheableResponseDropsTheStoredOne)
+{
+    ResponseCache cache(dir, 1000);
+    cache.store("no-store", "old body", "\"v1\"", "max-age=0");
+    cache.store("too-big", "old body", "\"v1\"", "max-age=0");
+    ASSERT_EQ(cache.stats().entries, 2);
+
+    // the stored body and ETag describe an older version, revalidating them could serve it again
+    cache.store("no-store", "new body", "\"v2\"", "no-store");
+    cache.store("too-big", std::string(2000, 'x'), "\"v2\"", "max-age=60");
+    EXPECT_FALSE(cache.lookup("no-store").has_value());
+    EXPECT_FALSE(cache.lookup("too-big").has_value());
+    EXPECT_EQ(cache.stats().entries, 0);
+    EXPECT_EQ(cache.stats().bytes, 0);
+}
+
+TEST_F(ResponseCacheTest, RemoveDropsTheEntry)
+{
+    ResponseCache cache(dir);
+    cache.store("url", "{truncated", "\"v1\"", "max-age=3600");
+    cache.remove("url");
+    cache.remove("never stored");
+
+    EXPECT_FALSE(cache.lookup("url").has_value());
+    EXPECT_EQ(cache.stats().entries, 0);
+    EXPECT_EQ(cache.stats().bytes, 0);
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()), 0);
+}
+
+TEST_F(ResponseCacheTest, EvictsLeastRecentlyUsedOverBudget)
+{
+    std::string body(400, 'x');
+    ResponseCache cache(dir, 1000);
+    cache.store("a", body, "\"a\"", "max-age=60");
+    cache.store("b", body, "\"b\"", "max-age=60");
+    ASSERT_TRUE(cache.lookup("a").has_value()); // b is now the least recently used
+    cache.store("c", body, "\"c\"", "max-age=60");
+
+    EXPECT_TRUE(cache.lookup("a").has_value());
+    EXPECT_FALSE(cache.lookup("b").has_value());
+    EXPECT_TRUE(cache.lookup("c").has_value());
+    EXPECT_EQ(cache.stats().evictions, 1);
+    EXPECT_LE(cache.stats().bytes, 1000);
+}
+
+TEST_F(ResponseCacheTest, EntriesSurviveReopening)
+{
+    {
+        ResponseCache cache(dir);
+        cache.store("url", "body", "\"v1\"", "max-age=3600");
+    }
+    ResponseCache reopened(dir);
+    auto cached = reopened.lookup("url");
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(cached->body, "body");
+    EXPECT_EQ(reopened.stats().entries, 1);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include "../src/dlp/spotify/token_manager.h"
+#include "../../temp_dir.h"
+
+class SpotifyTokenManagerTest : public ::testing::Test
+{
+protected:
+    TempDir temp_dir{"spotify_dlp_token_test"};
+    std::filesystem::path cache_path = temp_dir.path() / "token.json";
+
+    OAuthToken make_token(const std::string &value, std::chrono::seconds lifetime)
+    {
+        // the cache stores whole seconds
+        auto now = std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now());
+        return OAuthToken{.access_token = value, .expires_at = now + lifetime};
+    }
+};
+
+TEST_F(SpotifyTokenManagerTest, StoresAndLoadsCachedToken)
+{
+    SpotifyTokenManager manager("id", "secret", cache_path);
+    OAuthToken token = make_token("cached_token", std::chrono::seconds(3600));
+    manager.store_cached_token(token);
+
+    auto loaded = manager.load_cached_token();
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_EQ(loaded->access_token, "cached_token");
+    EXPECT_EQ(loaded->expires_at, token.expires_at);
+}
+
+TEST_F(SpotifyTokenManagerTest, IgnoresExpiredCachedToken)
+{
+    SpotifyTokenManager manager("id", "secret", cache_path);
+    manager.store_cached_token(make_token("old_token", std::chrono::seconds(-10)));
+
+    auto loaded = manager.load_cached_token();
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_FALSE(loaded->valid_for(std::chrono::seconds(0)));
+}
+
+TEST_F(SpotifyTokenManagerTest, UsesValidCachedTokenWithoutRequest)
+{
+    {
+        SpotifyTokenManager writer("id", "secret", cache_path);
+        writer.store_cached_token(make_token("shared_token", std::chrono::seconds(3600)));
+    }
+
+    // credentials are bogus, so this only passes if no request is made
+    SpotifyTokenManager reader("id", "secret", cache_path);
+    EXPECT_EQ(reader.get_token(), "shared_token");
+}
+
+TEST_F(SpotifyTokenManagerTest, CacheIsPrivateToTheUser)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "POSIX permissions";
+#endif
+    using std::filesystem::perms;
+    std::filesystem::path nested = cache_path.parent_path() / "created" / "token.json";
+    SpotifyTokenManager manager("id", "secret", nested);
+    manager.store_cached_token(make_token("private_token", std::chrono::seconds(3600)));
+
+    EXPECT_EQ(std::filesystem::status(nested).permissions() & perms::all, perms::owner_read | perms::owner_write);
+    EXPECT_EQ(std::filesystem::status(nested.parent_path()).permissions() & perms::all, perms::owner_all);
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(nested.parent_path()), std::filesystem::directory_iterator()), 1)
+        << "temp file left behind";
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "../src/dlp/youtube/edit_distance.h"
+
+namespace
+{
+    int reference_distance(const std::string &a, const std::string &b)
+    {
+        std::vector<int> previous(b.size() + 1), current(b.size() + 1);
+        for (size_t j = 0; j <= b.size(); j++)
+            previous[j] = static_cast<int>(j);
+
+        for (size_t i = 1; i <= a.size(); i++)
+        {
+            current[0] = static_cast<int>(i);
+            for (size_t j = 1; j <= b.size(); j++)
+            {
+                int cost = a[i - 1] == b[j - 1] ? 0 : 1;
+                current[j] = std::min({previous[j] + 1, current[j - 1] + 1, previous[j - 1] + cost});
+            }
+            std::swap(previous, current);
+        }
+        return previous[b.size()];
+    }
+
+    std::string random_string(std::mt19937 &rng, size_t length, char alphabet_end)
+    {
+        std::uniform_int_distribution<int> pick('a', alphabet_end);
+        std::string s(length, 'a');
+        for (char &c : s)
+            c = static_cast<char>(pick(rng));
+        return s;
+    }
+}
+
+TEST(EditDistanceTest, KnownDistances)
+{
+    EXPECT_EQ(EditDistance::levenshtein("", ""), 0);
+    EXPECT_EQ(EditDistance::levenshtein("abc", ""), 3);
+    EXPECT_EQ(EditDistance::levenshtein("", "abc"), 3);
+    EXPECT_EQ(EditDistance::levenshtein("kitten", "sitting"), 3);
+    EXPECT_EQ(EditDistance::levenshtein("flaw", "lawn"), 2);
+    EXPECT_EQ(EditDistance::levenshtein("test", "test1"), 1);
+}
+
+TEST(EditDistanceTest, MatchesReferenceAcrossBlockSizes)
+{
+    std::mt19937 rng(1234);
+    const size_t lengths[] = {1, 5, 63, 64, 65, 127, 128, 129, 200, 300};
+
+    for (size_t m : lengths)
+    {
+        for (size_t n : lengths)
+        {
+            std::string a = random_string(rng, m, 'd');
+            std::string b = random_string(rng, n, 'd');
+            EXPECT_EQ(EditDistance::levenshtein(a, b), reference_distance(a, b)) << "m=" << m << " n=" << n;
+        }
+    }
+}
+
+TEST(EditDistanceTest, HandlesNonAsciiBytes)
+{
+    std::string a = "beyonc\xc3\xa9 halo";
+    std::string b = "beyonce halo";
+    EXPECT_EQ(EditDistance::levenshtein(a, b), reference_distance(a, b));
+}
+
+TEST(EditDistanceTest, ManyMatchesSingleDistance)
+{
+    std::mt19937 rng(42);
+
+    for (size_t m : {8, 64, 100})
+    {
+        std::string pattern = random_string(rng, m, 'f');
+        EditDistance::MyersPattern compiled(pattern);
+
+        std::vector<std::string> storage;
+        std::uniform_int_distribution<size_t> length(0, 90);
+        for (int i = 0; i < 23; i++)
+            storage.push_back(random_string(rng, length(rng), 'f'));
+
+        std::vector<std::string_view> texts(storage.begin(), storage.end());
+        std::vector<int> distances = EditDistance::levenshtein_many(compiled, texts);
+
+        ASSERT_EQ(distances.size(), texts.size());
+        for (size_t i = 0; i < texts.size(); i++)
+        {
+            EXPECT_EQ(distances[i], reference_distance(pattern, storage[i])) << "m=" << m << " i=" << i;
+        }
+    }
+}
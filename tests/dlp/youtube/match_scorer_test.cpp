@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../src/dlp/youtube/match_scorer.h"
+
+namespace
+{
+    // the per-candidate scoring match_scorer replaced, kept as the reference for identical results
+    double reference_similarity(const std::string &a, const std::string &b)
+    {
+        size_t max_len = std::max(a.size(), b.size());
+        if (max_len == 0)
+            return 0.0;
+        return 1.0 - (static_cast<double>(EditDistance::levenshtein(a, b)) / max_len);
+    }
+
+    double reference_track_score(const SearchResult &result, const std::string &name, const std::string &artists, const std::string &album)
+    {
+        double score = 0.0;
+        score += reference_similarity(TextNormalizer::normalize(result.title), TextNormalizer::normalize(name)) * 0.45;
+        score += reference_similarity(TextNormalizer::normalize(artists), TextNormalizer::normalize(result.artist)) * 0.45;
+        score += reference_similarity(TextNormalizer::normalize(result.title), TextNormalizer::normalize(album)) * 0.10;
+        return score;
+    }
+
+    SearchResult make_result(const std::string &id, const std::string &title, const std::string &artist, double score = 0.0)
+    {
+        return SearchResult{.video_id = id, .title = title, .artist = artist, .duration_seconds = 0, .score = score};
+    }
+
+    std::vector<SearchResult> make_candidates()
+    {
+        return {
+            make_result("a", "Daft Punk - Harder, Better, Faster, Stronger (Official Video)", "Daft Punk"),
+            make_result("b", "Harder Better Faster Stronger", "Daft Punk - Topic"),
+            make_result("c", "Harder, Better, Faster, Stronger (Live)", "Daft Punk"),
+            make_result("d", "Kanye West - Stronger", "KanyeWestVEVO"),
+            make_result("e", "", ""),
+            make_result("f", "Discovery (Full Album)", "Daft Punk")};
+    }
+}
+
+TEST(MatchScorerTest, TrackScoresMatchReference)
+{
+    TrackMatchContext context{
+        .title = MatchField(TextNormalizer::normalize("Harder, Better, Faster, Stronger")),
+        .artists = MatchField(TextNormalizer::normalize("Daft Punk")),
+        .album = MatchField(TextNormalizer::normalize("Discovery"))};
+
+    NormalizerCache normalizer(16);
+    std::vector<SearchResult> candidates = make_candidates();
+    MatchScorer::score(context, candidates, normalizer);
+
+    for (const auto &candidate : candidates)
+    {
+        EXPECT_DOUBLE_EQ(candidate.score, reference_track_score(candidate, "Harder, Better, Faster, Stronger", "Daft Punk", "Discovery"))
+            << candidate.video_id;
+    }
+}
+
+TEST(MatchScorerTest, AlbumScoresRewardAlbumKeyword)
+{
+    AlbumMatchContext context{
+        .name = MatchField(TextNormalizer::normalize("Discovery")),
+        .artists = MatchField(TextNormalizer::normalize("Daft Punk"))};
+
+    NormalizerCache normalizer(16);
+    std::vector<SearchResult> candidates = {
+        make_result("album", "Discovery Full Album", "Daft Punk"),
+        make_result("plain", "Discovery Full", "Daft Punk")};
+    MatchScorer::score(context, candidates, normalizer);
+
+    double title_similarity = 1.0 - (static_cast<double>(EditDistance::levenshtein("discovery", "discovery full album")) / 20);
+    EXPECT_DOUBLE_EQ(candidates[0].score, title_similarity * 0.50 + 1.0 * 0.40 + 0.10);
+    EXPECT_LT(candidates[1].score, 0.90);
+}
+
+TEST(MatchScorerTest, RankMovesBestToFrontAndKeepsTiesInOrder)
+{
+    std::vector<SearchResult> candidates = {
+        make_result("a", "", "", 0.2),
+        make_result("b", "", "", 0.9),
+        make_result("c", "", "", 0.5),
+        make_result("d", "", "", 0.9),
+        make_result("e", "", "", 0.1)};
+
+    MatchScorer::rank(candidates, 2);
+
+    std::vector<std::string> ids;
+    for (const auto &candidate : candidates)
+        ids.push_back(candidate.video_id);
+    EXPECT_EQ(ids, (std::vector<std::string>{"b", "d", "a", "c", "e"}));
+}
+
+TEST(MatchScorerTest, RankMatchesFullSortForTopCandidate)
+{
+    TrackMatchContext context{
+        .title = MatchField(TextNormalizer::normalize("Stronger")),
+        .artists = MatchField(TextNormalizer::normalize("Kanye West")),
+        .album = std::nullopt};
+
+    NormalizerCache normalizer(16);
+    std::vector<SearchResult> candidates = make_candidates();
+    MatchScorer::score(context, candidates, normalizer);
+
+    std::vector<SearchResult> sorted = candidates;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const SearchResult &a, const SearchResult &b)
+                     { return a.score > b.score; });
+
+    MatchScorer::rank(candidates, 1);
+    EXPECT_EQ(candidates[0].video_id, sorted[0].video_id);
+    EXPECT_EQ(candidates[0].video_id, "d");
+    EXPECT_EQ(candidates.size(), sorted.size());
+}
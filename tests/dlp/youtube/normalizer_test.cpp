@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "../src/dlp/youtube/normalizer.h"
+
+TEST(NormalizerTest, MatchesAsciiBehaviour)
+{
+    EXPECT_EQ(TextNormalizer::normalize("Test String!"), "test string");
+    EXPECT_EQ(TextNormalizer::normalize("  Spaces  "), "spaces");
+    EXPECT_EQ(TextNormalizer::normalize("Special@#$Characters"), "special characters");
+    EXPECT_EQ(TextNormalizer::normalize("AC/DC - Back In Black (Official Video)"), "ac dc back in black official video");
+    EXPECT_EQ(TextNormalizer::normalize(""), "");
+    EXPECT_EQ(TextNormalizer::normalize("!!!"), "");
+}
+
+TEST(NormalizerTest, FoldsLatinDiacritics)
+{
+    EXPECT_EQ(TextNormalizer::normalize("Beyonc\xc3\xa9"), "beyonce");
+    EXPECT_EQ(TextNormalizer::normalize("Sigur R\xc3\xb3s"), "sigur ros");
+    EXPECT_EQ(TextNormalizer::normalize("Motorhead \xc3\x86ON"), "motorhead aeon");
+    EXPECT_EQ(TextNormalizer::normalize("Stra\xc3\x9f" "e"), "strasse");
+    EXPECT_EQ(TextNormalizer::normalize("\xc5\x81\xc3\xb3" "d\xc5\xba"), "lodz");
+    EXPECT_EQ(TextNormalizer::normalize("Dvo\xc5\x99\xc3\xa1k"), "dvorak");
+}
+
+TEST(NormalizerTest, TreatsOtherBytesAsSeparators)
+{
+    EXPECT_EQ(TextNormalizer::normalize("a \xc3\x97 b"), "a b");                 // multiplication sign
+    EXPECT_EQ(TextNormalizer::normalize("song \xe2\x80\x93 artist"), "song artist"); // en dash
+    EXPECT_EQ(TextNormalizer::normalize("\xe6\x9d\xb1\xe4\xba\xac tokyo"), "tokyo");
+    EXPECT_EQ(TextNormalizer::normalize("broken\xc3"), "broken");
+}
+
+TEST(NormalizerTest, CacheReturnsSameResultAndStaysBounded)
+{
+    NormalizerCache cache(2);
+
+    EXPECT_EQ(cache.normalize("Beyonc\xc3\xa9"), "beyonce");
+    EXPECT_EQ(cache.normalize("Beyonc\xc3\xa9"), "beyonce");
+    EXPECT_EQ(cache.size(), 1);
+
+    cache.normalize("Halo");
+    cache.normalize("Beyonc\xc3\xa9"); // refresh so "Halo" is the eviction candidate
+    cache.normalize("Crazy In Love");
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.normalize("Halo"), "halo");
+    EXPECT_EQ(cache.size(), 2);
+}
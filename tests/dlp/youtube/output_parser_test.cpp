@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../src/dlp/youtube/output_parser.h"
+
+using namespace std;
+
+TEST(YtDLPOutputParserTest, ArgumentsRequestEveryRecord)
+{
+    vector<string> args = YtDLPOutputParser::arguments();
+
+    auto has = [&](const string &arg)
+    { return find(args.begin(), args.end(), arg) != args.end(); };
+    EXPECT_TRUE(has("--no-simulate"));
+    EXPECT_TRUE(has("--progress-template"));
+    EXPECT_TRUE(any_of(args.begin(), args.end(), [](const string &arg)
+                       { return arg.rfind("after_move:", 0) == 0; }));
+    EXPECT_TRUE(any_of(args.begin(), args.end(), [](const string &arg)
+                       { return arg.rfind("video:", 0) == 0; }));
+}
+
+TEST(YtDLPOutputParserTest, ParsesFileReady)
+{
+    YtDLPOutputParser parser;
+    vector<YtDLPFileReady> ready;
+    parser.on_file_ready([&](const YtDLPFileReady &record)
+                         { ready.push_back(record); });
+
+    // the path is the last field, so tabs in it survive
+    parser.feed("spotify-dlp:done\thttps://www.youtube.com/watch?v=abc\t/music/a\tb.mp3");
+
+    ASSERT_EQ(ready.size(), 1);
+    EXPECT_EQ(ready[0].original_url, "https://www.youtube.com/watch?v=abc");
+    EXPECT_EQ(ready[0].path, filesystem::path("/music/a\tb.mp3"));
+}
+
+TEST(YtDLPOutputParserTest, ParsesProgressWithUnknownFields)
+{
+    YtDLPOutputParser parser;
+    vector<YtDLPProgress> progress;
+    parser.on_progress([&](const YtDLPProgress &record)
+                       { progress.push_back(record); });
+
+    parser.feed("spotify-dlp:progress\tdownloading\t1024\t4096.5\t512.25\t6\thttps://www.youtube.com/watch?v=abc");
+    parser.feed("spotify-dlp:progress\tdownloading\t2048\tNA\tNA\tNA\thttps://www.youtube.com/watch?v=abc");
+
+    ASSERT_EQ(progress.size(), 2);
+    EXPECT_EQ(progress[0].status, "downloading");
+    EXPECT_EQ(progress[0].downloaded_bytes, 1024);
+    EXPECT_EQ(progress[0].total_bytes, 4096);
+    EXPECT_DOUBLE_EQ(progress[0].speed.value(), 512.25);
+    EXPECT_DOUBLE_EQ(progress[0].eta_seconds.value(), 6);
+    EXPECT_EQ(progress[0].original_url, "https://www.youtube.com/watch?v=abc");
+
+    EXPECT_EQ(progress[1].downloaded_bytes, 2048);
+    EXPECT_FALSE(progress[1].total_bytes.has_value());
+    EXPECT_FALSE(progress[1].speed.has_value());
+    EXPECT_FALSE(progress[1].eta_seconds.has_value());
+}
+
+TEST(YtDLPOutputParserTest, ParsesPostprocess)
+{
+    YtDLPOutputParser parser;
+    vector<YtDLPPostprocess> records;
+    parser.on_postprocess([&](const YtDLPPostprocess &record)
+                          { records.push_back(record); });
+
+    parser.feed("spotify-dlp:postprocess\tstarted\tExtractAudio\thttps://www.youtube.com/watch?v=abc");
+
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(records[0].status, "started");
+    EXPECT_EQ(records[0].postprocessor, "ExtractAudio");
+    EXPECT_EQ(records[0].original_url, "https://www.youtube.com/watch?v=abc");
+}
+
+TEST(YtDLPOutputParserTest, ParsesInfo)
+{
+    YtDLPOutputParser parser;
+    vector<YtDLPVideoInfo> infos;
+    parser.on_info([&](const YtDLPVideoInfo &record)
+                   { infos.push_back(record); });
+
+    parser.feed(R"(spotify-dlp:info	https://www.youtube.com/watch?v=abc	{"id": "abc", "title": "Tab\there", "duration": 215, "acodec": "opus"})");
+    parser.feed(R"(spotify-dlp:info	https://www.youtube.com/watch?v=live	{"id": "live", "title": null, "duration": null, "acodec": "none"})");
+
+    ASSERT_EQ(infos.size(), 2);
+    EXPECT_EQ(infos[0].id, "abc");
+    EXPECT_EQ(infos[0].title, "Tab\there");
+    EXPECT_DOUBLE_EQ(infos[0].duration_seconds.value(), 215);
+    EXPECT_EQ(infos[0].acodec, "opus");
+    EXPECT_TRUE(infos[1].title.empty());
+    EXPECT_FALSE(infos[1].duration_seconds.has_value());
+    EXPECT_FALSE(infos[1].acodec.has_value());
+}
+
+TEST(YtDLPOutputParserTest, OtherLinesGoToLog)
+{
+    YtDLPOutputParser parser;
+    vector<string> logged;
+    size_t records = 0;
+    parser.on_log([&](string_view line)
+                  { logged.emplace_back(line); });
+    parser.on_file_ready([&](const YtDLPFileReady &)
+                         { records++; });
+
+    parser.feed("[ExtractAudio] Destination: output.mp3");
+    parser.feed("spotify-dlp:info\thttps://www.youtube.com/watch?v=abc\tnot json");
+    parser.feed("spotify-dlp:done\tmissing path");
+
+    EXPECT_EQ(records, 0);
+    EXPECT_EQ(logged.size(), 3);
+    EXPECT_EQ(logged[0], "[ExtractAudio] Destination: output.mp3");
+}
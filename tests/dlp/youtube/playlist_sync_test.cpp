@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "../src/dlp/youtube/playlist_sync.h"
+#include "../../temp_dir.h"
+
+class PlaylistSyncTest : public ::testing::Test
+{
+protected:
+    TempDir temp_dir{"spotify_dlp_playlist_sync_test"};
+    std::filesystem::path dir = temp_dir.path() / "state"; // created by the store
+
+    static PlaylistMetadata playlist(const std::string &snapshot_id, const std::vector<std::string> &track_ids)
+    {
+        PlaylistMetadata playlist;
+        playlist.name = "test_playlist";
+        playlist.id = "playlist_id";
+        playlist.snapshot_id = snapshot_id;
+        for (const auto &id : track_ids)
+        {
+            TrackMetadata track{};
+            track.id = id;
+            track.name = "track " + id;
+            playlist.tracks.push_back(track);
+        }
+        playlist.total_tracks = static_cast<int>(playlist.tracks.size());
+        return playlist;
+    }
+
+    static std::vector<std::string> ids_of(const std::vector<TrackMetadata> &tracks)
+    {
+        std::vector<std::string> ids;
+        for (const auto &track : tracks)
+            ids.push_back(track.id);
+        return ids;
+    }
+};
+
+TEST_F(PlaylistSyncTest, StoreRoundTripsSnapshots)
+{
+    PlaylistSnapshotStore store(dir);
+    EXPECT_FALSE(store.load("playlist_id").has_value());
+
+    PlaylistSnapshot snapshot = PlaylistSnapshotStore::snapshot_of(playlist("snap1", {"a", "b", "a"}));
+    store.save(snapshot);
+
+    auto loaded = PlaylistSnapshotStore(dir).load("playlist_id");
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_EQ(loaded->playlist_id, "playlist_id");
+    EXPECT_EQ(loaded->snapshot_id, "snap1");
+    EXPECT_EQ(loaded->track_ids, (std::vector<std::string>{"a", "b", "a"}));
+    EXPECT_TRUE(loaded->pending.empty());
+    EXPECT_EQ(std::chrono::duration_cast<std::chrono::seconds>(loaded->synced_at.time_since_epoch()),
+              std::chrono::duration_cast<std::chrono::seconds>(snapshot.synced_at.time_since_epoch()));
+}
+
+TEST_F(PlaylistSyncTest, StoreIgnoresUnreadableSnapshot)
+{
+    PlaylistSnapshotStore store(dir);
+    std::ofstream(dir / "playlist_id.json") << "{not json";
+    EXPECT_FALSE(store.load("playlist_id").has_value());
+}
+
+TEST_F(PlaylistSyncTest, FirstSyncAddsEveryTrack)
+{
+    PlaylistDiff diff = PlaylistSnapshotStore::diff(std::nullopt, playlist("snap1", {"a", "b"}));
+    EXPECT_EQ(ids_of(diff.added), (std::vector<std::string>{"a", "b"}));
+    EXPECT_TRUE(diff.removed.empty());
+}
+
+TEST_F(PlaylistSyncTest, DiffFindsAddedAndRemovedTracks)
+{
+    auto previous = PlaylistSnapshotStore::snapshot_of(playlist("snap1", {"a", "b", "c"}));
+    PlaylistDiff diff = PlaylistSnapshotStore::diff(previous, playlist("snap2", {"c", "d", "a", "e"}));
+    EXPECT_EQ(ids_of(diff.added), (std::vector<std::string>{"d", "e"}));
+    EXPECT_EQ(diff.removed, (std::vector<std::string>{"b"}));
+}
+
+TEST_F(PlaylistSyncTest, DiffCountsRepeatedTracks)
+{
+    auto previous = PlaylistSnapshotStore::snapshot_of(playlist("snap1", {"a", "b", "b"}));
+    PlaylistDiff diff = PlaylistSnapshotStore::diff(previous, playlist("snap2", {"a", "a", "b"}));
+    EXPECT_EQ(ids_of(diff.added), (std::vector<std::string>{"a"}));
+    EXPECT_EQ(diff.removed, (std::vector<std::string>{"b"}));
+
+    // reordering alone changes the snapshot but not the tracks
+    EXPECT_TRUE(PlaylistSnapshotStore::diff(previous, playlist("snap3", {"b", "a", "b"})).empty());
+}
+
+TEST_F(PlaylistSyncTest, PendingTracksAreAddedAgain)
+{
+    auto attempted = std::chrono::system_clock::now() - std::chrono::hours(1);
+    PlaylistSnapshotStore store(dir);
+    store.save(PlaylistSnapshotStore::snapshot_of(playlist("snap1", {"a", "b", "a", "c"}),
+                                                  {PendingTrack{.track_id = "a", .attempts = 2, .last_attempt = attempted},
+                                                   PendingTrack{.track_id = "c", .attempts = 1, .last_attempt = attempted}}));
+
+    auto loaded = store.load("playlist_id");
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_EQ(loaded->track_ids, (std::vector<std::string>{"b", "a"}));
+    ASSERT_EQ(loaded->pending.size(), 2);
+    EXPECT_EQ(loaded->pending[0].track_id, "a");
+    EXPECT_EQ(loaded->pending[0].attempts, 2);
+    EXPECT_EQ(std::chrono::duration_cast<std::chrono::seconds>(loaded->pending[0].last_attempt.time_since_epoch()),
+              std::chrono::duration_cast<std::chrono::seconds>(attempted.time_since_epoch()));
+    EXPECT_EQ(loaded->pending[1].track_id, "c");
+
+    // the next full sync sees the pending tracks as additions
+    PlaylistDiff diff = PlaylistSnapshotStore::diff(loaded, playlist("snap2", {"a", "b", "a", "c"}));
+    EXPECT_EQ(ids_of(diff.added), (std::vector<std::string>{"a", "c"}));
+    EXPECT_TRUE(diff.removed.empty());
+
+    // a pending track that was removed meanwhile is simply dropped
+    diff = PlaylistSnapshotStore::diff(loaded, playlist("snap2", {"a", "b"}));
+    EXPECT_TRUE(diff.empty());
+}
+
+TEST_F(PlaylistSyncTest, PendingTracksAreRetriedOnceDue)
+{
+    auto now = std::chrono::system_clock::now();
+    PlaylistSnapshot snapshot = PlaylistSnapshotStore::snapshot_of(playlist("snap1", {"a", "b"}));
+    EXPECT_FALSE(PlaylistSync::retry_due(snapshot, std::chrono::hours(24)));
+
+    // a track that just failed does not force a full sync of an unchanged playlist
+    snapshot.pending = {PendingTrack{.track_id = "b", .attempts = 1, .last_attempt = now - std::chrono::hours(1)}};
+    EXPECT_FALSE(PlaylistSync::retry_due(snapshot, std::chrono::hours(24)));
+
+    snapshot.pending.push_back(PendingTrack{.track_id = "c", .attempts = 1, .last_attempt = now - std::chrono::hours(25)});
+    EXPECT_TRUE(PlaylistSync::retry_due(snapshot, std::chrono::hours(24)));
+}
+
+TEST_F(PlaylistSyncTest, PendingTracksAreGivenUpAfterMaxAttempts)
+{
+    std::vector<PendingTrack> previous = {
+        PendingTrack{.track_id = "a", .attempts = PlaylistSync::MAX_PENDING_ATTEMPTS - 1, .last_attempt = {}},
+        PendingTrack{.track_id = "b", .attempts = 1, .last_attempt = {}},
+        PendingTrack{.track_id = "gone", .attempts = 1, .last_attempt = {}},
+    };
+
+    // b was downloaded this time and gone left the playlist, a failed once too often, c is new
+    std::vector<std::string> abandoned;
+    std::vector<PendingTrack> pending = PlaylistSync::next_pending(previous, {"a", "c"}, abandoned);
+    EXPECT_EQ(abandoned, (std::vector<std::string>{"a"}));
+    ASSERT_EQ(pending.size(), 1);
+    EXPECT_EQ(pending[0].track_id, "c");
+    EXPECT_EQ(pending[0].attempts, 1);
+
+    // a given up track stays in track_ids, so no diff adds it again
+    PlaylistSnapshot snapshot = PlaylistSnapshotStore::snapshot_of(playlist("snap2", {"a", "c"}), pending);
+    EXPECT_EQ(snapshot.track_ids, (std::vector<std::string>{"a"}));
+}
+
+TEST_F(PlaylistSyncTest, SummaryListsChanges)
+{
+    PlaylistSyncReport report;
+    report.playlist_id = "playlist_id";
+    report.name = "test_playlist";
+    report.diff.added = playlist("snap2", {"d"}).tracks;
+    report.diff.removed = {"b"};
+
+    std::string summary = report.summary();
+    EXPECT_NE(summary.find("1 added, 1 removed"), std::string::npos);
+    EXPECT_NE(summary.find("+ track d (d)"), std::string::npos);
+    EXPECT_NE(summary.find("- b"), std::string::npos);
+
+    report.pending = {"d"};
+    report.abandoned = {"e"};
+    summary = report.summary();
+    EXPECT_NE(summary.find("0 failed, 1 pending, 1 given up"), std::string::npos);
+    EXPECT_NE(summary.find("? d"), std::string::npos);
+    EXPECT_NE(summary.find("x e"), std::string::npos);
+
+    report.unchanged = true;
+    report.snapshot_id = "snap1";
+    EXPECT_NE(report.summary().find("unchanged since snapshot snap1, 1 pending"), std::string::npos);
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include "../src/dlp/youtube/progress.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    DownloadProgressEvent downloading(const std::string &url, uint64_t bytes, uint64_t total = 1000, bool finished = false)
+    {
+        DownloadProgressEvent event;
+        event.url = url;
+        event.phase = DownloadPhase::Downloading;
+        event.downloaded_bytes = bytes;
+        event.total_bytes = total;
+        event.transfer_finished = finished;
+        return event;
+    }
+}
+
+TEST(ProgressThrottleTest, LimitsDownloadingEventsToOnePerInterval)
+{
+    ProgressThrottle throttle(250ms);
+    auto start = std::chrono::steady_clock::now();
+
+    EXPECT_TRUE(throttle.admit(downloading("a", 10), start));
+    EXPECT_FALSE(throttle.admit(downloading("a", 20), start + 100ms));
+    EXPECT_FALSE(throttle.admit(downloading("a", 30), start + 249ms));
+    EXPECT_TRUE(throttle.admit(downloading("a", 40), start + 250ms));
+    EXPECT_FALSE(throttle.admit(downloading("a", 50), start + 300ms));
+}
+
+TEST(ProgressThrottleTest, AlwaysAdmitsMilestones)
+{
+    ProgressThrottle throttle(250ms);
+    auto now = std::chrono::steady_clock::now();
+
+    EXPECT_TRUE(throttle.admit(downloading("a", 10), now));
+    EXPECT_TRUE(throttle.admit(downloading("a", 1000, 1000, true), now)); // transfer complete
+    EXPECT_TRUE(throttle.admit(downloading("b", 10), now));   // next url of a batch
+
+    DownloadProgressEvent postprocessing{.url = "b", .phase = DownloadPhase::PostProcessing, .downloaded_bytes = 0, .total_bytes = std::nullopt, .speed = std::nullopt, .eta_seconds = std::nullopt, .transfer_finished = false, .postprocessor = ""};
+    EXPECT_TRUE(throttle.admit(postprocessing, now));
+    EXPECT_TRUE(throttle.admit(postprocessing, now));
+
+    EXPECT_TRUE(throttle.admit({.url = "b", .phase = DownloadPhase::Finished, .downloaded_bytes = 0, .total_bytes = std::nullopt, .speed = std::nullopt, .eta_seconds = std::nullopt, .transfer_finished = false, .postprocessor = ""}, now));
+    EXPECT_TRUE(throttle.admit({.url = "c", .phase = DownloadPhase::Failed, .downloaded_bytes = 0, .total_bytes = std::nullopt, .speed = std::nullopt, .eta_seconds = std::nullopt, .transfer_finished = false, .postprocessor = ""}, now));
+}
+
+TEST(ProgressThrottleTest, ReachingAnEstimatedTotalIsStillThrottled)
+{
+    ProgressThrottle throttle(250ms);
+    auto now = std::chrono::steady_clock::now();
+
+    // yt-dlp's estimate can be lower than the real size, so only its "finished" status ends the transfer
+    EXPECT_TRUE(throttle.admit(downloading("a", 10), now));
+    EXPECT_FALSE(throttle.admit(downloading("a", 1000), now + 10ms));
+    EXPECT_FALSE(throttle.admit(downloading("a", 1200), now + 20ms));
+    EXPECT_TRUE(throttle.admit(downloading("a", 1500, 1500, true), now + 30ms));
+}
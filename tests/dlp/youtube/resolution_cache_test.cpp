@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "../src/dlp/youtube/resolution_cache.h"
+#include "../../temp_dir.h"
+
+class ResolutionCacheTest : public ::testing::Test
+{
+protected:
+    TempDir temp_dir{"spotify_dlp_resolution_cache_test"};
+    std::filesystem::path dir = temp_dir.path();
+
+    TrackMetadata make_track(const std::string &id, std::optional<std::string> isrc = std::nullopt)
+    {
+        TrackMetadata track;
+        track.id = id;
+        track.name = "name";
+        track.isrc = isrc;
+        track.track_number = 1;
+        return track;
+    }
+
+    Resolution make_resolution(const std::string &track_id, std::optional<std::string> video_id,
+                               std::optional<std::string> isrc = std::nullopt,
+                               std::chrono::system_clock::time_point at = std::chrono::system_clock::now())
+    {
+        return Resolution{.track_id = track_id, .isrc = isrc, .video_id = video_id, .score = 0.9, .resolved_at = at};
+    }
+};
+
+TEST_F(ResolutionCacheTest, PersistsAcrossInstances)
+{
+    {
+        ResolutionCache cache(dir / "cache.jsonl", std::chrono::hours(1));
+        cache.store(make_resolution("track1", "video1"));
+    }
+
+    ResolutionCache reopened(dir / "cache.jsonl", std::chrono::hours(1));
+    auto hit = reopened.lookup(make_track("track1"));
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(hit->video_id, "video1");
+    EXPECT_DOUBLE_EQ(hit->score, 0.9);
+}
+
+TEST_F(ResolutionCacheTest, FallsBackToIsrc)
+{
+    ResolutionCache cache(dir / "cache.jsonl", std::chrono::hours(1));
+    cache.store(make_resolution("original_release", "video1", "USRC17607839"));
+
+    auto hit = cache.lookup(make_track("compilation_release", "USRC17607839"));
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(hit->video_id, "video1");
+
+    EXPECT_FALSE(cache.lookup(make_track("compilation_release")).has_value());
+}
+
+TEST_F(ResolutionCacheTest, NoMatchEntriesExpire)
+{
+    ResolutionCache cache(dir / "cache.jsonl", std::chrono::hours(1));
+    cache.store(make_resolution("fresh_miss", std::nullopt));
+    cache.store(make_resolution("stale_miss", std::nullopt, std::nullopt, std::chrono::system_clock::now() - std::chrono::hours(2)));
+    cache.store(make_resolution("old_match", "video1", std::nullopt, std::chrono::system_clock::now() - std::chrono::hours(2)));
+
+    auto fresh = cache.lookup(make_track("fresh_miss"));
+    ASSERT_TRUE(fresh.has_value());
+    EXPECT_FALSE(fresh->video_id.has_value());
+
+    EXPECT_FALSE(cache.lookup(make_track("stale_miss")).has_value());
+    EXPECT_TRUE(cache.lookup(make_track("old_match")).has_value());
+}
+
+TEST_F(ResolutionCacheTest, LaterEntriesWin)
+{
+    ResolutionCache cache(dir / "cache.jsonl", std::chrono::hours(1));
+    cache.store(make_resolution("track1", "video1"));
+    cache.store(make_resolution("track1", "video2"));
+
+    ResolutionCache reopened(dir / "cache.jsonl", std::chrono::hours(1));
+    EXPECT_EQ(reopened.size(), 1);
+    EXPECT_EQ(reopened.lookup(make_track("track1"))->video_id, "video2");
+}
+
+TEST_F(ResolutionCacheTest, CompactsLogOnLoad)
+{
+    {
+        ResolutionCache cache(dir / "cache.jsonl", std::chrono::hours(1));
+        cache.store(make_resolution("track1", "video1"));
+        cache.store(make_resolution("track1", "video2"));
+        cache.store(make_resolution("stale_miss", std::nullopt, std::nullopt, std::chrono::system_clock::now() - std::chrono::hours(2)));
+    }
+
+    auto count_lines = [&]
+    {
+        std::ifstream in(dir / "cache.jsonl");
+        size_t lines = 0;
+        for (std::string line; std::getline(in, line);)
+            lines++;
+        return lines;
+    };
+    EXPECT_EQ(count_lines(), 3);
+
+    ResolutionCache reopened(dir / "cache.jsonl", std::chrono::hours(1));
+    EXPECT_EQ(count_lines(), 1);
+    EXPECT_EQ(reopened.lookup(make_track("track1"))->video_id, "video2");
+
+    // the compacted file is still appended to
+    reopened.store(make_resolution("track2", "video3"));
+    EXPECT_EQ(count_lines(), 2);
+}
+
+TEST_F(ResolutionCacheTest, AppendsSurviveCompactionByAnotherInstance)
+{
+    ResolutionCache first(dir / "cache.jsonl", std::chrono::hours(1));
+    first.store(make_resolution("track1", "video1"));
+    first.store(make_resolution("track1", "video2"));
+
+    // a second process opening the shared file compacts it away under the first one's open log
+    ResolutionCache second(dir / "cache.jsonl", std::chrono::hours(1));
+    first.store(make_resolution("track2", "video3"));
+    second.store(make_resolution("track3", "video4"));
+
+    ResolutionCache reopened(dir / "cache.jsonl", std::chrono::hours(1));
+    ASSERT_TRUE(reopened.lookup(make_track("track2")).has_value());
+    EXPECT_EQ(reopened.lookup(make_track("track2"))->video_id, "video3");
+    EXPECT_EQ(reopened.lookup(make_track("track3"))->video_id, "video4");
+    EXPECT_EQ(reopened.lookup(make_track("track1"))->video_id, "video2");
+
+    // only the log and its lock file, no temp files left behind
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()), 2);
+}
+
+TEST_F(ResolutionCacheTest, ExportThenImportSeedsNewCache)
+{
+    ResolutionCache source(dir / "source.jsonl", std::chrono::hours(1));
+    source.store(make_resolution("track1", "video1"));
+    source.store(make_resolution("track2", "video2", "ISRC2"));
+    EXPECT_EQ(source.export_jsonl(dir / "export.jsonl"), 2);
+
+    ResolutionCache seeded(dir / "seeded.jsonl", std::chrono::hours(1));
+    EXPECT_EQ(seeded.import_jsonl(dir / "export.jsonl"), 2);
+    EXPECT_EQ(seeded.lookup(make_track("track2"))->video_id, "video2");
+
+    // imported entries are persisted to the new cache's own file
+    ResolutionCache reopened(dir / "seeded.jsonl", std::chrono::hours(1));
+    EXPECT_EQ(reopened.size(), 2);
+}
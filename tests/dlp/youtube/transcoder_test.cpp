@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "../src/dlp/youtube/transcoder.h"
+#include "../../temp_dir.h"
+
+using namespace std;
+
+class TranscoderTest : public testing::Test
+{
+protected:
+    TempDir temp_dir{"spotify_dlp_transcoder_test"};
+    filesystem::path dir = temp_dir.path();
+
+    filesystem::path write_file(const string &name, const string &contents)
+    {
+        filesystem::path path = dir / name;
+        ofstream file(path, ios::trunc);
+        file << contents;
+        return path;
+    }
+
+    string read_file(const filesystem::path &path)
+    {
+        ifstream file(path);
+        stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+
+    // stands in for ffmpeg: "converts" by copying the -i file to the last argument with a marker line
+    filesystem::path write_fake_ffmpeg(const string &body = "")
+    {
+        filesystem::path path = write_file("ffmpeg", "#!/bin/sh\n" + body + R"(while [ $# -gt 1 ]; do
+    [ "$1" = -i ] && input=$2
+    shift
+done
+{ cat "$input"; echo converted; } > "$1"
+)");
+        filesystem::permissions(path, filesystem::perms::owner_all);
+        return path;
+    }
+
+    bool has_temp_files()
+    {
+        return any_of(filesystem::directory_iterator(dir), filesystem::directory_iterator(), [](const filesystem::directory_entry &entry)
+                      { return entry.path().filename().string().find(".temp.") != string::npos; });
+    }
+};
+
+TEST_F(TranscoderTest, BestKeepsTheDownloadedStream)
+{
+    EXPECT_FALSE(Transcoder::target_for(DownloadFileType::BEST).has_value());
+
+    TranscodeTarget vorbis = Transcoder::target_for(DownloadFileType::VORBIS).value();
+    EXPECT_EQ(vorbis.extension, "ogg");
+    EXPECT_EQ(Transcoder::destination_for("/music/song.webm", vorbis), filesystem::path("/music/song.ogg"));
+}
+
+TEST_F(TranscoderTest, PrefersStreamsInTheTargetCodec)
+{
+    EXPECT_EQ(Transcoder::format_selector(Transcoder::target_for(DownloadFileType::OPUS).value()), "bestaudio[acodec^=opus]/bestaudio/best");
+    EXPECT_EQ(Transcoder::format_selector(Transcoder::target_for(DownloadFileType::M4A).value()), "bestaudio[acodec^=mp4a]/bestaudio/best");
+    EXPECT_EQ(Transcoder::format_selector(Transcoder::target_for(DownloadFileType::FLAC).value()), "bestaudio/best");
+}
+
+TEST_F(TranscoderTest, ModeFollowsTheFetchedCodec)
+{
+    TranscodeTarget m4a = Transcoder::target_for(DownloadFileType::M4A).value();
+    EXPECT_EQ(Transcoder::mode_for({"song.m4a", "mp4a.40.2"}, m4a), TranscodeMode::Keep);
+    EXPECT_EQ(Transcoder::mode_for({"song.M4A", "mp4a.40.5"}, m4a), TranscodeMode::Keep);
+    EXPECT_EQ(Transcoder::mode_for({"song.webm", "opus"}, m4a), TranscodeMode::Encode);
+
+    TranscodeTarget opus = Transcoder::target_for(DownloadFileType::OPUS).value();
+    EXPECT_EQ(Transcoder::mode_for({"song.webm", "opus"}, opus), TranscodeMode::Remux);
+    EXPECT_EQ(Transcoder::mode_for({"song.m4a", "mp4a.40.2"}, opus), TranscodeMode::Encode);
+
+    // without a codec only the extension can tell, and .m4a says nothing about ALAC
+    EXPECT_EQ(Transcoder::mode_for({"song.m4a", nullopt}, m4a), TranscodeMode::Keep);
+    EXPECT_EQ(Transcoder::mode_for({"song.webm", nullopt}, opus), TranscodeMode::Encode);
+    TranscodeTarget alac = Transcoder::target_for(DownloadFileType::ALAC).value();
+    EXPECT_EQ(Transcoder::mode_for({"song.m4a", nullopt}, alac), TranscodeMode::Encode);
+    EXPECT_EQ(Transcoder::mode_for({"song.m4a", "mp4a.40.2"}, alac), TranscodeMode::Encode);
+}
+
+TEST_F(TranscoderTest, ArgumentsFollowYtDLPQualityScale)
+{
+    Transcoder transcoder("ffmpeg");
+    auto quality_of = [&](DownloadFileType type, int audio_quality) -> string
+    {
+        vector<string> args = transcoder.arguments("in.webm", "out.tmp", Transcoder::target_for(type).value(), TranscodeMode::Encode, audio_quality);
+        auto flag = find(args.begin(), args.end(), "-q:a");
+        return flag == args.end() ? "" : *(flag + 1);
+    };
+
+    EXPECT_EQ(quality_of(DownloadFileType::MP3, 0), "0");
+    EXPECT_EQ(quality_of(DownloadFileType::MP3, 5), "5");
+    EXPECT_EQ(quality_of(DownloadFileType::VORBIS, 10), "0");
+    EXPECT_EQ(quality_of(DownloadFileType::M4A, 0), "4");
+    EXPECT_EQ(quality_of(DownloadFileType::OPUS, 5), "");
+    EXPECT_EQ(quality_of(DownloadFileType::MP3, -1), "");
+
+    vector<string> args = transcoder.arguments("in.webm", "out.tmp", Transcoder::target_for(DownloadFileType::M4A).value(), TranscodeMode::Encode, -1);
+    vector<string> expected = {"ffmpeg", "-nostdin", "-hide_banner", "-loglevel", "error", "-y", "-i", "in.webm", "-vn",
+                               "-c:a", "aac", "-f", "ipod", "out.tmp"};
+    EXPECT_EQ(args, expected);
+
+    // a remux copies the stream, quality does not apply
+    args = transcoder.arguments("in.webm", "out.tmp", Transcoder::target_for(DownloadFileType::OPUS).value(), TranscodeMode::Remux, 5);
+    expected = {"ffmpeg", "-nostdin", "-hide_banner", "-loglevel", "error", "-y", "-i", "in.webm", "-vn",
+                "-c:a", "copy", "-f", "opus", "out.tmp"};
+    EXPECT_EQ(args, expected);
+}
+
+TEST_F(TranscoderTest, ConvertsNextToTheSourceAndRemovesIt)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake ffmpeg is a shell script";
+#endif
+    filesystem::path source = write_file("song.webm", "audio\n");
+    Transcoder transcoder(write_fake_ffmpeg());
+
+    filesystem::path converted = transcoder.transcode({source, "opus"}, Transcoder::target_for(DownloadFileType::MP3).value(), 5);
+
+    EXPECT_EQ(converted, dir / "song.mp3");
+    EXPECT_EQ(read_file(converted), "audio\nconverted\n");
+    EXPECT_FALSE(filesystem::exists(source));
+    EXPECT_FALSE(has_temp_files());
+}
+
+TEST_F(TranscoderTest, FailedConversionKeepsTheSource)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake ffmpeg is a shell script";
+#endif
+    filesystem::path source = write_file("song.webm", "audio\n");
+    Transcoder transcoder(write_fake_ffmpeg(R"(for last; do :; done
+echo partial > "$last"
+echo "Invalid data found when processing input" >&2
+exit 1
+)"));
+
+    EXPECT_THROW(transcoder.transcode({source, "opus"}, Transcoder::target_for(DownloadFileType::FLAC).value(), -1), runtime_error);
+
+    EXPECT_EQ(read_file(source), "audio\n");
+    EXPECT_FALSE(filesystem::exists(dir / "song.flac"));
+    EXPECT_FALSE(has_temp_files());
+}
+
+TEST_F(TranscoderTest, RewritesSourceWhenTheExtensionIsShared)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake ffmpeg is a shell script";
+#endif
+    filesystem::path source = write_file("song.m4a", "aac\n");
+    Transcoder transcoder(write_fake_ffmpeg());
+
+    filesystem::path converted = transcoder.transcode({source, "mp4a.40.2"}, Transcoder::target_for(DownloadFileType::ALAC).value(), -1);
+
+    EXPECT_EQ(converted, source);
+    EXPECT_EQ(read_file(converted), "aac\nconverted\n");
+    EXPECT_FALSE(has_temp_files());
+}
+
+TEST_F(TranscoderTest, KeepsFilesAlreadyInTheTargetFormat)
+{
+    filesystem::path source = write_file("song.opus", "opus\n");
+    Transcoder transcoder(dir / "missing-ffmpeg"); // would fail if it were run
+
+    filesystem::path kept = transcoder.transcode({source, "opus"}, Transcoder::target_for(DownloadFileType::OPUS).value(), 5);
+
+    EXPECT_EQ(kept, source);
+    EXPECT_EQ(read_file(kept), "opus\n");
+}
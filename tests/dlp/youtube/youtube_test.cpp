@@ -24,6 +24,12 @@ protected:
         config.audio_quality = 5;
         config.download_file_type = DownloadFileType::MP3;
         config.minimum_match_score = 0.6;
+        config.max_concurrent_searches = 4;
+        config.jobs = 2;
+        config.resolution_cache_path = nullptr;
+        config.yt_dlp_in_memory = 0;
+        config.batch_downloads = 1;
+        config.transcode_jobs = 0;
 
         return config;
     }
@@ -94,7 +100,8 @@ TEST_F(YoutubeTest, CalculateMatchScoreTrackTest)
     EXPECT_LT(yt.calculate_match_score(partial_result), 0.7);
 
     // Poor match
-    auto poor_result = create_test_result("Completely Different", "Random Artist");
+    // the artist shares no words with "Test Artist", with a correct edit distance "Random Artist" scores ~0.35
+    auto poor_result = create_test_result("Completely Different", "Someone Else");
     EXPECT_LT(yt.calculate_match_score(poor_result), 0.3);
 }
 
@@ -161,7 +168,7 @@ TEST_F(YoutubeTest, ParseResponseTest)
         ]
     })";
 
-    auto results = yt.parse_response(test_response);
+    auto results = yt.parse_response(test_response, yt.make_match_context(create_test_track()));
     ASSERT_EQ(results.size(), 1);
     EXPECT_EQ(results[0].video_id, "test123");
     EXPECT_EQ(results[0].title, "Test Track");
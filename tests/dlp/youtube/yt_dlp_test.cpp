@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include "../src/dlp/youtube/yt-dlp.h"
 #include "../include/spotify-dlp.h"
 
@@ -13,23 +16,126 @@ protected:
         struct stat buffer;
         return (stat(name.c_str(), &buffer) == 0);
     }
+
+    // stands in for yt-dlp in the batch tests, reads the urls from stdin like --batch-file -
+    filesystem::path write_fake_yt_dlp(const string &name, const string &body)
+    {
+        filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_batch_test";
+        filesystem::create_directories(dir);
+        filesystem::path path = dir / name;
+        {
+            ofstream script(path, ios::trunc);
+            script << "#!/bin/sh\n" << body;
+        }
+        filesystem::permissions(path, filesystem::perms::owner_all);
+        return path;
+    }
+
+    // settles one url the way the real worker does, "bad" video ids fail
+    // answers -J like yt-dlp, and logs whether a download extracted its url or loaded a probed info JSON
+    filesystem::path write_fake_prober(const filesystem::path &dir)
+    {
+        return write_fake_yt_dlp("prober", "dir=" + dir.string() + "\nlog=" + (dir / "log").string() + R"(
+case "$1" in
+-J)
+    echo "probe $3" >> "$log"
+    case "$3" in *gone*) echo "ERROR: [youtube] gone: Video unavailable" >&2; exit 1 ;; esac
+    id=${3##*v=}
+    id=${id%%&*}
+    printf '{"id": "%s", "title": "Song %s", "duration": 215.5, "availability": "public", "is_live": false, "original_url": "%s", "formats": [' "$id" "$id" "$3"
+    printf '{"format_id": "251", "ext": "webm", "acodec": "opus", "vcodec": "none", "abr": 130.5}, '
+    printf '{"format_id": "140", "ext": "m4a", "acodec": "mp4a.40.2", "vcodec": "none", "abr": null}, '
+    printf '{"format_id": "18", "ext": "mp4", "acodec": "mp4a.40.2", "vcodec": "avc1"}, '
+    printf '{"format_id": "sb0", "ext": "mhtml", "acodec": "none", "vcodec": "none"}]}\n'
+    ;;
+--load-info-json)
+    echo "load $2" >> "$log"
+    echo stream > "$dir/loaded.webm"
+    printf 'spotify-dlp:done\t%s\t%s\n' "from-json" "$dir/loaded.webm"
+    ;;
+*)
+    echo "extract $1" >> "$log"
+    echo stream > "$dir/extracted.webm"
+    printf 'spotify-dlp:done\t%s\t%s\n' "$1" "$dir/extracted.webm"
+    ;;
+esac
+)");
+    }
+
+    vector<string> read_lines(const filesystem::path &path)
+    {
+        ifstream file(path);
+        vector<string> lines;
+        for (string line; getline(file, line);)
+            lines.push_back(line);
+        return lines;
+    }
+
+    static constexpr const char *FAKE_SETTLE = R"(settle() {
+    id=${1##*v=}
+    case "$id" in
+    bad*) echo "ERROR: [youtube] $id: Video unavailable" >&2; status=1 ;;
+    *) printf 'spotify-dlp:done\t%s\t%s\n' "$1" "/tmp/$id.mp3" ;;
+    esac
+}
+status=0
+)";
 };
 
-// idk how to test for linux because we check in compiliation if we are on linux (im not) there's probably someway to but if
-// its an issue it'll get brought up in the future
-TEST_F(YtDLPTest, TestWindowsExtraction)
+TEST_F(YtDLPTest, TestExtractionIsReused)
+{
+    filesystem::path path = dlp.yt_dlp_path;
+    EXPECT_EQ(path.parent_path().filename().string(), "yt-dlp-" + YtDLP::embedded_binary_key());
+    ASSERT_TRUE(YtDLP::is_extracted(path));
+
+    auto written = filesystem::last_write_time(path);
+    YtDLP second;
+    EXPECT_EQ(second.yt_dlp_path, path);
+    EXPECT_EQ(filesystem::last_write_time(path), written);
+}
+
+TEST_F(YtDLPTest, TestExtractionReplacesTruncatedBinary)
 {
-    dlp.extract_yt_dlp_windows();
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_yt_dlp_extraction_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    filesystem::path path = dir / "yt_dlp";
 
-    ASSERT_TRUE(file_exists(dlp.yt_dlp_temp_path.string()));
+    {
+        ofstream truncated(path, ios::binary);
+        truncated << "#!";
+    }
+    EXPECT_FALSE(YtDLP::is_extracted(path));
+
+    YtDLP::extract_yt_dlp(path);
+    EXPECT_TRUE(YtDLP::is_extracted(path));
+
+    // only the binary itself is left behind, no temp files
+    EXPECT_EQ(distance(filesystem::directory_iterator(dir), filesystem::directory_iterator()), 1);
+    filesystem::remove_all(dir);
+}
+
+TEST_F(YtDLPTest, TestInMemoryExecution)
+{
+    YtDLP in_memory(YtDLPExecutionMode::Memory);
+
+#ifdef __linux__
+    EXPECT_EQ(in_memory.get_path().rfind("/proc/self/fd/", 0), 0) << in_memory.get_path();
+    // loaded once per process
+    EXPECT_EQ(YtDLP(YtDLPExecutionMode::Memory).get_path(), in_memory.get_path());
+#endif
+
+    auto result = in_memory.execute_command({in_memory.get_path(), "--version"});
+    EXPECT_EQ(result.cmd_exit_code, 0) << result.err;
+    EXPECT_FALSE(result.out.empty());
 }
 
 TEST_F(YtDLPTest, TestExecuteCommand)
 {
 #ifdef _WIN32
-    auto result = dlp.execute_command("echo Hello World");
+    auto result = dlp.execute_command({"echo", "Hello", "World"});
 #else
-    auto result = dlp.execute_command("/bin/echo Hello World");
+    auto result = dlp.execute_command({"/bin/echo", "Hello", "World"});
 #endif
 
     EXPECT_EQ(result.cmd_exit_code, 0);
@@ -40,7 +146,7 @@ TEST_F(YtDLPTest, TestExecuteCommand)
 
 TEST_F(YtDLPTest, TestInvalidCommand)
 {
-    auto result = dlp.execute_command("invalid_command_that_doesnt_exist");
+    auto result = dlp.execute_command({"invalid_command_that_doesnt_exist"});
 
     EXPECT_NE(result.cmd_exit_code, 0);
     EXPECT_FALSE(result.err.empty());
@@ -49,9 +155,9 @@ TEST_F(YtDLPTest, TestInvalidCommand)
 TEST_F(YtDLPTest, TestStdErrOutput)
 {
 #ifdef _WIN32
-    auto result = dlp.execute_command("dir /invalid_flag");
+    auto result = dlp.execute_command({"dir", "/invalid_flag"});
 #else
-    auto result = dlp.execute_command("ls --invalid_flag");
+    auto result = dlp.execute_command({"ls", "--invalid_flag"});
 #endif
 
     EXPECT_NE(result.cmd_exit_code, 0);
@@ -61,9 +167,9 @@ TEST_F(YtDLPTest, TestStdErrOutput)
 TEST_F(YtDLPTest, TestMultilineOutput)
 {
 #ifdef _WIN32
-    auto result = dlp.execute_command("dir");
+    auto result = dlp.execute_command({"dir"});
 #else
-    auto result = dlp.execute_command("ls -la");
+    auto result = dlp.execute_command({"ls", "-la"});
 #endif
 
     EXPECT_EQ(result.cmd_exit_code, 0);
@@ -107,23 +213,496 @@ TEST_F(YtDLPTest, TestDownloadGenericError)
     }
 }
 
-TEST_F(YtDLPTest, TestGetRealOutputPath)
+TEST_F(YtDLPTest, TestBatchDownloadDemultiplexesResults)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    // answers in reverse order, results still have to line up with the input
+    dlp.yt_dlp_path = write_fake_yt_dlp("demux", string(FAKE_SETTLE) + R"(tac | while read url; do settle "$url"; done
+exit 1
+)");
+    vector<string> urls = {
+        "https://www.youtube.com/watch?v=first",
+        "https://www.youtube.com/watch?v=bad_one",
+        "https://www.youtube.com/watch?v=third",
+        "https://www.youtube.com/watch?v=first",
+    };
+
+    auto results = dlp.download_batch(dlp_create_default_download_config(), urls);
+    ASSERT_EQ(results.size(), urls.size());
+
+    for (size_t i : {0, 2, 3})
+    {
+        EXPECT_EQ(results[i].url, urls[i]);
+        ASSERT_TRUE(results[i].path.has_value()) << urls[i];
+        EXPECT_TRUE(results[i].error.empty());
+    }
+    EXPECT_EQ(results[0].path->filename(), "first.mp3");
+    EXPECT_EQ(results[2].path->filename(), "third.mp3");
+    EXPECT_EQ(results[3].path->filename(), "first.mp3");
+
+    EXPECT_FALSE(results[1].path.has_value());
+    EXPECT_NE(results[1].error.find("Video unavailable"), string::npos);
+}
+
+TEST_F(YtDLPTest, TestBatchDownloadRespawnsAfterCrash)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    filesystem::path log = filesystem::temp_directory_path() / "spotify_dlp_batch_test" / "respawn.log";
+    filesystem::remove(log);
+
+    // the first run dies after its first url, every run logs the urls it was given
+    dlp.yt_dlp_path = write_fake_yt_dlp("respawn", string(FAKE_SETTLE) + "log=" + log.string() + R"(
+first_run=1
+[ -e "$log" ] && first_run=0
+echo run >> "$log"
+while read url; do
+    echo "$url" >> "$log"
+    settle "$url"
+    [ $first_run = 1 ] && kill -9 $$
+done
+exit $status
+)");
+    vector<string> urls = {
+        "https://www.youtube.com/watch?v=a",
+        "https://www.youtube.com/watch?v=b",
+        "https://www.youtube.com/watch?v=c",
+    };
+
+    auto results = dlp.download_batch(dlp_create_default_download_config(), urls);
+    ASSERT_EQ(results.size(), urls.size());
+    for (const auto &result : results)
+        EXPECT_TRUE(result.path.has_value()) << result.url << ": " << result.error;
+
+    // the respawned worker only got the urls the crashed one did not finish
+    ifstream logged(log);
+    string contents((istreambuf_iterator<char>(logged)), istreambuf_iterator<char>());
+    EXPECT_EQ(contents, "run\n" + urls[0] + "\nrun\n" + urls[1] + "\n" + urls[2] + "\n");
+}
+
+TEST_F(YtDLPTest, TestBatchDownloadSkipsPoisonUrl)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    // crashes whenever the poison url comes first, so only dropping it lets the rest through
+    dlp.yt_dlp_path = write_fake_yt_dlp("poison", string(FAKE_SETTLE) + R"(while read url; do
+    case "$url" in *poison*) kill -9 $$ ;; esac
+    settle "$url"
+done
+exit $status
+)");
+    vector<string> urls = {
+        "https://www.youtube.com/watch?v=poison",
+        "https://www.youtube.com/watch?v=a",
+        "https://www.youtube.com/watch?v=b",
+    };
+
+    auto results = dlp.download_batch(dlp_create_default_download_config(), urls);
+    ASSERT_EQ(results.size(), urls.size());
+    EXPECT_FALSE(results[0].path.has_value());
+    EXPECT_FALSE(results[0].error.empty());
+    EXPECT_TRUE(results[1].path.has_value()) << results[1].error;
+    EXPECT_TRUE(results[2].path.has_value()) << results[2].error;
+}
+
+TEST_F(YtDLPTest, TestBatchDownloadWorkerFailsToStart)
+{
+    dlp.yt_dlp_path = filesystem::temp_directory_path() / "spotify_dlp_batch_test" / "missing_yt_dlp";
+    vector<string> urls = {"https://www.youtube.com/watch?v=a", "https://www.youtube.com/watch?v=b"};
+
+    vector<BatchDownloadResult> results;
+    ASSERT_NO_THROW(results = dlp.download_batch(dlp_create_default_download_config(), urls));
+    ASSERT_EQ(results.size(), urls.size());
+    for (const auto &result : results)
+    {
+        EXPECT_FALSE(result.path.has_value());
+        EXPECT_NE(result.error.find("missing_yt_dlp"), string::npos) << result.error;
+    }
+}
+
+TEST_F(YtDLPTest, TestBatchDownloadReportsOptionsError)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    // stderr is not captured in batch mode, the reason has to come from the line callback
+    dlp.yt_dlp_path = write_fake_yt_dlp("options", R"(echo "Usage: yt-dlp [OPTIONS] URL [URL...]" >&2
+echo "yt-dlp: error: no such option: --bogus" >&2
+exit 2
+)");
+    vector<string> urls = {"https://www.youtube.com/watch?v=a"};
+
+    auto results = dlp.download_batch(dlp_create_default_download_config(), urls);
+    ASSERT_EQ(results.size(), urls.size());
+    EXPECT_FALSE(results[0].path.has_value());
+    EXPECT_NE(results[0].error.find("no such option: --bogus"), string::npos) << results[0].error;
+}
+
+TEST_F(YtDLPTest, TestBatchDownloadReportsProgress)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    dlp.yt_dlp_path = write_fake_yt_dlp("progress", string(FAKE_SETTLE) + R"(while read url; do
+    for bytes in 100 200 300 400; do
+        printf 'spotify-dlp:progress\tdownloading\t%s\t400\t1000.5\t1\t%s\n' $bytes "$url"
+    done
+    printf 'spotify-dlp:progress\tfinished\t400\t400\tNA\tNA\t%s\n' "$url"
+    printf 'spotify-dlp:postprocess\tstarted\tExtractAudio\t%s\n' "$url"
+    printf 'spotify-dlp:postprocess\tfinished\tExtractAudio\t%s\n' "$url"
+    settle "$url"
+done
+exit $status
+)");
+
+    vector<DownloadProgressEvent> events;
+    dlp.on_progress([&](const DownloadProgressEvent &event)
+                    { events.push_back(event); },
+                    chrono::hours(1));
+
+    vector<string> urls = {"https://www.youtube.com/watch?v=a", "https://www.youtube.com/watch?v=bad"};
+    dlp.download_batch(dlp_create_default_download_config(), urls);
+
+    // the updates after the first are throttled away, even the one reaching total_bytes, but not yt-dlp's "finished"
+    vector<pair<DownloadPhase, uint64_t>> expected_a = {
+        {DownloadPhase::Downloading, 100},
+        {DownloadPhase::Downloading, 400},
+        {DownloadPhase::PostProcessing, 0},
+        {DownloadPhase::PostProcessing, 0},
+        {DownloadPhase::Finished, 0},
+    };
+    ASSERT_EQ(events.size(), 2 * expected_a.size());
+    for (size_t i = 0; i < expected_a.size(); i++)
+    {
+        EXPECT_EQ(events[i].url, urls[0]);
+        EXPECT_EQ(events[i].phase, expected_a[i].first) << i;
+        EXPECT_EQ(events[i].downloaded_bytes, expected_a[i].second) << i;
+    }
+    EXPECT_EQ(events[0].total_bytes, 400);
+    EXPECT_DOUBLE_EQ(events[0].speed.value(), 1000.5);
+    EXPECT_EQ(events[2].postprocessor, "ExtractAudio");
+
+    EXPECT_EQ(events.back().url, urls[1]);
+    EXPECT_EQ(events.back().phase, DownloadPhase::Failed);
+}
+
+TEST_F(YtDLPTest, TestBatchDownloadStopsAtDeadline)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    // settles the first url, then hangs on the second
+    dlp.yt_dlp_path = write_fake_yt_dlp("hang", string(FAKE_SETTLE) + R"(read url
+settle "$url"
+sleep 30
+)");
+    vector<string> urls = {"https://www.youtube.com/watch?v=a", "https://www.youtube.com/watch?v=b"};
+
+    auto start = chrono::steady_clock::now();
+    auto results = dlp.download_batch(dlp_create_default_download_config(), urls, Deadline::after(chrono::milliseconds(300)));
+    EXPECT_LT(chrono::steady_clock::now() - start, chrono::seconds(5));
+
+    ASSERT_EQ(results.size(), urls.size());
+    EXPECT_TRUE(results[0].path.has_value()) << results[0].error;
+    EXPECT_FALSE(results[1].path.has_value());
+    EXPECT_EQ(results[1].error, "download deadline exceeded");
+}
+
+TEST_F(YtDLPTest, TestFetchThenTranscode)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp and ffmpeg are shell scripts";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_transcode_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    // fetches the native stream, and the options must not ask yt-dlp to convert it
+    dlp.yt_dlp_path = write_fake_yt_dlp("fetch", "dir=" + dir.string() + R"(
+case "$*" in *--audio-format*) echo "ERROR: asked to extract audio" >&2; exit 2 ;; esac
+echo stream > "$dir/a.webm"
+printf 'spotify-dlp:done\t%s\t%s\n' "$1" "$dir/a.webm"
+)");
+    dlp.ffmpeg_path = write_fake_yt_dlp("ffmpeg", R"(for last; do :; done
+echo mp3 > "$last"
+)");
+
+    vector<DownloadProgressEvent> events;
+    dlp.on_progress([&](const DownloadProgressEvent &event)
+                    { events.push_back(event); });
+
+    DownloadConfig config = dlp_create_default_download_config();
+    config.download_file_type = DownloadFileType::MP3;
+    filesystem::path path = dlp.download(config, "https://www.youtube.com/watch?v=a");
+
+    EXPECT_EQ(path, dir / "a.mp3");
+    EXPECT_TRUE(filesystem::exists(path));
+    EXPECT_FALSE(filesystem::exists(dir / "a.webm"));
+
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[0].phase, DownloadPhase::PostProcessing);
+    EXPECT_EQ(events[0].postprocessor, "Transcode");
+    EXPECT_EQ(events[1].phase, DownloadPhase::Finished);
+    filesystem::remove_all(dir);
+}
+
+TEST_F(YtDLPTest, TestNativeStreamSkipsTranscode)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp and ffmpeg are shell scripts";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_transcode_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    filesystem::path log = dir / "log";
+    // serves the codec the selector asks for, in YouTube's containers
+    dlp.yt_dlp_path = write_fake_yt_dlp("native", "dir=" + dir.string() + R"(
+case "$*" in
+*"bestaudio[acodec^=opus]"*) codec=opus ext=webm ;;
+*"bestaudio[acodec^=mp4a]"*) codec=mp4a.40.2 ext=m4a ;;
+*) codec=mp3 ext=mp3 ;;
+esac
+echo stream > "$dir/a.$ext"
+printf 'spotify-dlp:info\t%s\t{"id": "a", "title": "A", "duration": 1, "acodec": "%s"}\n' "$1" "$codec"
+printf 'spotify-dlp:done\t%s\t%s\n' "$1" "$dir/a.$ext"
+)");
+    dlp.ffmpeg_path = write_fake_yt_dlp("ffmpeg", "log=" + log.string() + R"(
+echo "$*" >> "$log"
+for last; do :; done
+echo converted > "$last"
+)");
+
+    DownloadConfig config = dlp_create_default_download_config();
+    config.download_file_type = DownloadFileType::M4A;
+    EXPECT_EQ(dlp.download(config, "https://www.youtube.com/watch?v=a"), dir / "a.m4a");
+
+    config.download_file_type = DownloadFileType::OPUS;
+    EXPECT_EQ(dlp.download(config, "https://www.youtube.com/watch?v=a"), dir / "a.opus");
+
+    config.download_file_type = DownloadFileType::FLAC;
+    EXPECT_EQ(dlp.download(config, "https://www.youtube.com/watch?v=a"), dir / "a.flac");
+
+    // only the opus stream had to be copied into another container, only flac was encoded
+    ifstream log_file(log);
+    string remux, encode, extra;
+    getline(log_file, remux);
+    getline(log_file, encode);
+    EXPECT_NE(remux.find("-c:a copy -f opus"), string::npos) << remux;
+    EXPECT_NE(encode.find("-c:a flac -f flac"), string::npos) << encode;
+    EXPECT_FALSE(getline(log_file, extra));
+
+    TranscodeStats stats = dlp.transcode_stats();
+    EXPECT_EQ(stats.kept, 1);
+    EXPECT_EQ(stats.remuxed, 1);
+    EXPECT_EQ(stats.encoded, 1);
+    EXPECT_EQ(stats.skipped(), 2);
+    filesystem::remove_all(dir);
+}
+
+TEST_F(YtDLPTest, TestProbeIsCachedPerVideo)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_probe_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    dlp.yt_dlp_path = write_fake_prober(dir);
+    dlp.probe_dir = dir / "probes";
+
+    VideoProbe probe = dlp.probe("https://www.youtube.com/watch?v=abc");
+    EXPECT_EQ(probe.video_id, "abc");
+    EXPECT_EQ(probe.title, "Song abc");
+    EXPECT_DOUBLE_EQ(probe.duration_seconds.value(), 215.5);
+    EXPECT_EQ(probe.availability, "public");
+    EXPECT_FALSE(probe.is_live);
+    ASSERT_EQ(probe.audio_formats.size(), 2);
+    EXPECT_EQ(probe.audio_formats[0].format_id, "251");
+    EXPECT_EQ(probe.audio_formats[0].acodec, "opus");
+    EXPECT_DOUBLE_EQ(probe.audio_formats[0].abr.value(), 130.5);
+    EXPECT_EQ(probe.audio_formats[1].ext, "m4a");
+    EXPECT_FALSE(probe.audio_formats[1].abr.has_value());
+    EXPECT_EQ(probe.info_json.parent_path(), dir / "probes");
+    EXPECT_EQ(probe.info_json.filename().string().substr(0, 4), "abc.");
+    EXPECT_TRUE(probe.info_json.string().ends_with(".info.json"));
+    EXPECT_TRUE(filesystem::exists(probe.info_json));
+    EXPECT_EQ(distance(filesystem::directory_iterator(dir / "probes"), filesystem::directory_iterator()), 1) << "temp file left behind";
+
+    // another url of the same video is answered from the cache
+    VideoProbe again = dlp.probe("https://music.youtube.com/watch?v=abc&feature=share");
+    EXPECT_EQ(again.title, probe.title);
+    EXPECT_EQ(read_lines(dir / "log"), vector<string>{"probe https://www.youtube.com/watch?v=abc"});
+    filesystem::remove_all(dir);
+}
+
+TEST_F(YtDLPTest, TestFetchReusesProbedInfoJson)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_probe_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    dlp.yt_dlp_path = write_fake_prober(dir);
+    dlp.probe_dir = dir / "probes";
+
+    VideoProbe probe = dlp.probe("https://www.youtube.com/watch?v=abc");
+    EXPECT_EQ(dlp.download(dlp_create_default_download_config(), "https://www.youtube.com/watch?v=abc"), dir / "loaded.webm");
+    EXPECT_EQ(dlp.download(dlp_create_default_download_config(), "https://www.youtube.com/watch?v=other"), dir / "extracted.webm");
+
+    vector<string> expected = {
+        "probe https://www.youtube.com/watch?v=abc",
+        "load " + probe.info_json.string(),
+        "extract https://www.youtube.com/watch?v=other",
+    };
+    EXPECT_EQ(read_lines(dir / "log"), expected);
+
+    // the fetch used the info JSON up
+    EXPECT_FALSE(filesystem::exists(probe.info_json));
+    EXPECT_FALSE(dlp.cached_probe("abc").has_value());
+    filesystem::remove_all(dir);
+}
+
+TEST_F(YtDLPTest, TestExpiredProbeIsExtractedAgain)
 {
-    CommandResult result;
-    result.out = R"([download] Destination: temp.webm
-[ExtractAudio] Destination: output.mp3
-[download] 100% of 5.00MiB)";
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_probe_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    dlp.yt_dlp_path = write_fake_prober(dir);
+    dlp.probe_dir = dir / "probes";
+    dlp.probe_ttl = chrono::seconds(0);
+
+    VideoProbe probe = dlp.probe("https://www.youtube.com/watch?v=abc");
+    EXPECT_FALSE(dlp.cached_probe("abc").has_value());
+    EXPECT_FALSE(filesystem::exists(probe.info_json));
+    dlp.download(dlp_create_default_download_config(), "https://www.youtube.com/watch?v=abc");
+
+    vector<string> expected = {
+        "probe https://www.youtube.com/watch?v=abc",
+        "extract https://www.youtube.com/watch?v=abc",
+    };
+    EXPECT_EQ(read_lines(dir / "log"), expected);
+    filesystem::remove_all(dir);
+}
 
-    auto path = dlp.get_real_output_path(result);
-    EXPECT_EQ(path.filename().string(), "output.mp3");
+TEST_F(YtDLPTest, TestClaimedProbeIsNotShared)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_probe_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    dlp.yt_dlp_path = write_fake_prober(dir);
+    dlp.probe_dir = dir / "probes";
+
+    VideoProbe first = dlp.probe("https://www.youtube.com/watch?v=abc");
+    optional<VideoProbe> claimed = dlp.claim_probe("abc");
+    ASSERT_TRUE(claimed.has_value());
+    EXPECT_EQ(claimed->info_json, first.info_json);
+    // a second fetch of the same video finds nothing to load, it cannot race the first one for the file
+    EXPECT_FALSE(dlp.claim_probe("abc").has_value());
+
+    // a new probe while the claimed file is still in use gets its own file, deleting the claimed one leaves it alone
+    VideoProbe second = dlp.probe("https://www.youtube.com/watch?v=abc");
+    EXPECT_NE(second.info_json, first.info_json);
+    filesystem::remove(claimed->info_json);
+    EXPECT_TRUE(filesystem::exists(second.info_json));
+    ASSERT_TRUE(dlp.cached_probe("abc").has_value());
+    EXPECT_EQ(dlp.cached_probe("abc")->info_json, second.info_json);
+    filesystem::remove_all(dir);
 }
 
-TEST_F(YtDLPTest, TestGetRealOutputPathMissing)
+TEST_F(YtDLPTest, TestFailedProbeThrows)
 {
-    CommandResult result;
-    result.out = "[download] 100% of 5.00MiB";
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp is a shell script";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_probe_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    dlp.yt_dlp_path = write_fake_prober(dir);
+    dlp.probe_dir = dir / "probes";
+
+    EXPECT_THROW(dlp.probe("https://www.youtube.com/watch?v=gone"), runtime_error);
+    EXPECT_FALSE(dlp.cached_probe("gone").has_value());
+    filesystem::remove_all(dir);
+}
+
+TEST_F(YtDLPTest, TestTranscodeFailureKeepsFetchedFile)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp and ffmpeg are shell scripts";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_transcode_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    dlp.yt_dlp_path = write_fake_yt_dlp("fetch", "dir=" + dir.string() + R"(
+echo stream > "$dir/a.webm"
+printf 'spotify-dlp:done\t%s\t%s\n' "$1" "$dir/a.webm"
+)");
+    dlp.ffmpeg_path = write_fake_yt_dlp("ffmpeg", R"(echo "Conversion failed!" >&2
+exit 1
+)");
+
+    DownloadConfig config = dlp_create_default_download_config();
+    config.download_file_type = DownloadFileType::OPUS;
+    EXPECT_THROW(dlp.download(config, "https://www.youtube.com/watch?v=a"), runtime_error);
+    EXPECT_TRUE(filesystem::exists(dir / "a.webm"));
+    filesystem::remove_all(dir);
+}
+
+TEST_F(YtDLPTest, TestBatchDownloadTranscodesOffTheWorker)
+{
+#ifdef _WIN32
+    GTEST_SKIP() << "fake yt-dlp and ffmpeg are shell scripts";
+#endif
+    filesystem::path dir = filesystem::temp_directory_path() / "spotify_dlp_transcode_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    filesystem::path log = dir / "log";
+    dlp.yt_dlp_path = write_fake_yt_dlp("fetch_batch", "dir=" + dir.string() + "\nlog=" + log.string() + R"(
+while read url; do
+    id=${url##*v=}
+    echo stream > "$dir/$id.webm"
+    printf 'spotify-dlp:done\t%s\t%s\n' "$url" "$dir/$id.webm"
+    echo "fetched $id" >> "$log"
+done
+)");
+    // slow enough that a worker waiting on conversions would show up in the log
+    dlp.ffmpeg_path = write_fake_yt_dlp("ffmpeg", "log=" + log.string() + R"(
+sleep 0.3
+for last; do :; done
+echo flac > "$last"
+echo converted >> "$log"
+)");
+
+    DownloadConfig config = dlp_create_default_download_config();
+    config.download_file_type = DownloadFileType::FLAC;
+    config.transcode_jobs = 1;
+    vector<string> urls = {"https://www.youtube.com/watch?v=a", "https://www.youtube.com/watch?v=b", "https://www.youtube.com/watch?v=c"};
+    auto results = dlp.download_batch(config, urls);
+
+    ASSERT_EQ(results.size(), urls.size());
+    for (const auto &result : results)
+    {
+        ASSERT_TRUE(result.path.has_value()) << result.error;
+        EXPECT_EQ(result.path->extension(), ".flac");
+        EXPECT_TRUE(filesystem::exists(result.path.value()));
+    }
+    EXPECT_EQ(results[1].path, dir / "b.flac");
 
-    EXPECT_THROW(dlp.get_real_output_path(result), std::runtime_error);
+    ifstream log_file(log);
+    stringstream lines;
+    lines << log_file.rdbuf();
+    EXPECT_EQ(lines.str(), "fetched a\nfetched b\nfetched c\nconverted\nconverted\nconverted\n");
+    filesystem::remove_all(dir);
 }
 
 TEST_F(YtDLPTest, TestDownloadReturnsPath)
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef TEMP_DIR_H
+#define TEMP_DIR_H
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <process.h>
+#endif
+
+// A new directory under the system temp directory, unique to this test (mkdtemp), so concurrent test runs sharing
+// /tmp never see each other's files. It is removed with everything in it when the object goes away.
+class TempDir
+{
+public:
+    explicit TempDir(const std::string &prefix = "spotify_dlp_test")
+    {
+#ifdef _WIN32
+        static std::atomic<unsigned> counter{0};
+        while (true)
+        {
+            std::filesystem::path candidate = std::filesystem::temp_directory_path() /
+                                              (prefix + "_" + std::to_string(_getpid()) + "_" + std::to_string(counter++));
+            if (std::filesystem::create_directory(candidate))
+            {
+                dir = candidate;
+                break;
+            }
+        }
+#else
+        std::string path_template = (std::filesystem::temp_directory_path() / (prefix + "_XXXXXX")).string();
+        if (mkdtemp(path_template.data()) == nullptr)
+            throw std::runtime_error("mkdtemp failed for " + path_template);
+        dir = path_template;
+#endif
+    }
+
+    ~TempDir()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+    }
+
+    TempDir(const TempDir &) = delete;
+    TempDir &operator=(const TempDir &) = delete;
+
+    const std::filesystem::path &path() const { return dir; }
+
+private:
+    std::filesystem::path dir;
+};
+
+#endif
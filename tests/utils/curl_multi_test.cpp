@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "../src/utils/curl_multi.h"
+#include "../temp_dir.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+class CurlMultiTest : public ::testing::Test
+{
+protected:
+    TempDir temp_dir{"spotify_dlp_curl_multi_test"};
+    std::filesystem::path dir = temp_dir.path();
+
+    void SetUp() override
+    {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+    }
+
+    HttpRequest make_file_request(const std::string &name, const std::string &contents)
+    {
+        std::filesystem::path path = dir / name;
+        std::ofstream(path) << contents;
+        return HttpRequest{.url = "file://" + path.string(), .headers = {}};
+    }
+};
+
+TEST_F(CurlMultiTest, CompletesEveryRequestWithCappedConcurrency)
+{
+    std::vector<HttpRequest> requests;
+    for (int i = 0; i < 10; i++)
+    {
+        requests.push_back(make_file_request("body" + std::to_string(i), "body-" + std::to_string(i)));
+    }
+
+    std::vector<std::string> bodies(requests.size());
+    CurlMulti multi(3);
+    multi.perform(requests, [&](size_t index, const HttpResponse &response, int) -> RetryDelay
+                  {
+        EXPECT_EQ(response.code, CURLE_OK);
+        bodies[index] = response.body;
+        return std::nullopt; });
+
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+        EXPECT_EQ(bodies[i], "body-" + std::to_string(i));
+    }
+}
+
+TEST_F(CurlMultiTest, RetriesOnlyTheRequestThatAskedForIt)
+{
+    std::vector<HttpRequest> requests = {make_file_request("a", "a"), make_file_request("b", "b")};
+
+    std::vector<int> attempts(requests.size(), 0);
+    CurlMulti multi(2);
+    multi.perform(requests, [&](size_t index, const HttpResponse &, int attempt) -> RetryDelay
+                  {
+        attempts[index]++;
+        if (index == 0 && attempt < 2)
+            return std::chrono::milliseconds(10);
+        return std::nullopt; });
+
+    EXPECT_EQ(attempts[0], 3);
+    EXPECT_EQ(attempts[1], 1);
+}
+
+TEST_F(CurlMultiTest, AdmissionHoldsBackEachAttemptOnce)
+{
+    std::vector<HttpRequest> requests = {make_file_request("a", "a"), make_file_request("b", "b")};
+
+    std::vector<int> admissions(requests.size(), 0);
+    std::vector<int> attempts(requests.size(), 0);
+    CurlMulti multi(2);
+    multi.on_admission([&](size_t index)
+                       { return admissions[index]++ == 0 && index == 1 ? std::chrono::milliseconds(50) : std::chrono::milliseconds(0); });
+
+    auto start = std::chrono::steady_clock::now();
+    multi.perform(requests, [&](size_t index, const HttpResponse &, int attempt) -> RetryDelay
+                  {
+        attempts[index]++;
+        if (index == 0 && attempt == 0)
+            return std::chrono::milliseconds(1);
+        return std::nullopt; });
+
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    EXPECT_EQ(attempts, (std::vector<int>{2, 1}));
+    // the retry of a asks again, the held back attempt of b does not
+    EXPECT_EQ(admissions, (std::vector<int>{2, 1}));
+}
+
+TEST_F(CurlMultiTest, DeadlineEndsRetryWait)
+{
+    std::vector<HttpRequest> requests = {make_file_request("a", "a")};
+
+    CurlMulti multi(1);
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_THROW(multi.perform(requests, [&](size_t, const HttpResponse &, int) -> RetryDelay
+                               { return std::chrono::seconds(30); },
+                               Deadline::after(std::chrono::milliseconds(200))),
+                 DeadlineExceeded);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+#ifndef _WIN32
+TEST_F(CurlMultiTest, DeadlineTimesOutStalledTransfer)
+{
+    // the kernel completes the handshake for the backlog, but nothing ever answers the request
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(server, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(server, 4), 0);
+    socklen_t length = sizeof(address);
+    getsockname(server, reinterpret_cast<sockaddr *>(&address), &length);
+
+    std::vector<HttpRequest> requests = {{.url = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/", .headers = {}}};
+    std::optional<CURLcode> code;
+
+    // curl's own timeout and the deadline fire together, either may be the one to end the transfer
+    CurlMulti multi(1);
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        multi.perform(requests, [&](size_t, const HttpResponse &response, int) -> RetryDelay
+                      {
+            code = response.code;
+            return std::nullopt; },
+                      Deadline::after(std::chrono::milliseconds(300)));
+        EXPECT_EQ(code, CURLE_OPERATION_TIMEDOUT);
+    }
+    catch (const DeadlineExceeded &)
+    {
+        EXPECT_FALSE(code.has_value());
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    close(server);
+}
+#endif
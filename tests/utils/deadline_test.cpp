@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "../src/utils/deadline.h"
+
+using namespace std::chrono_literals;
+
+TEST(DeadlineTest, UnboundedNeverExpiresOnItsOwn)
+{
+    Deadline deadline;
+    EXPECT_FALSE(deadline.is_bounded());
+    EXPECT_FALSE(deadline.expired());
+    EXPECT_FALSE(deadline.remaining().has_value());
+    EXPECT_NO_THROW(deadline.check("stage"));
+}
+
+TEST(DeadlineTest, ExpiresAfterItsBudget)
+{
+    Deadline deadline = Deadline::after(50ms);
+    EXPECT_TRUE(deadline.is_bounded());
+    EXPECT_FALSE(deadline.expired());
+    EXPECT_LE(deadline.remaining().value(), 50ms);
+
+    std::this_thread::sleep_for(60ms);
+    EXPECT_TRUE(deadline.expired());
+    EXPECT_EQ(deadline.remaining().value(), 0ms);
+    EXPECT_THROW(deadline.check("stage"), DeadlineExceeded);
+}
+
+TEST(DeadlineTest, CancellationIsSharedBetweenCopies)
+{
+    CancellationToken token;
+    Deadline search(token);
+    Deadline download = Deadline::after(1h, token);
+
+    token.cancel();
+
+    EXPECT_TRUE(search.expired());
+    EXPECT_TRUE(download.expired());
+    EXPECT_EQ(download.remaining().value(), 0ms);
+    try
+    {
+        download.check("Download");
+        FAIL() << "Expected DeadlineExceeded";
+    }
+    catch (const DeadlineExceeded &e)
+    {
+        EXPECT_STREQ(e.what(), "Download was cancelled");
+    }
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include "../src/utils/curl_utils.h"
+#include "../src/utils/http_pool.h"
+#include "../temp_dir.h"
+
+TEST(HttpPoolTest, ReusesReleasedHandles)
+{
+    CURL *first = nullptr;
+    {
+        PooledCurl lease;
+        first = lease.get();
+        ASSERT_NE(first, nullptr);
+    }
+
+    PooledCurl lease;
+    EXPECT_EQ(lease.get(), first);
+}
+
+TEST(HttpPoolTest, ReleasedHandlesStayOnTheirThread)
+{
+    std::promise<CURL *> released;
+    std::promise<void> done;
+    std::thread other([&]
+                      {
+        CURL *handle = nullptr;
+        {
+            PooledCurl lease;
+            handle = lease.get();
+        }
+        released.set_value(handle);
+        done.get_future().wait(); });
+
+    CURL *other_handle = released.get_future().get();
+    {
+        PooledCurl lease;
+        EXPECT_NE(lease.get(), other_handle);
+    }
+    done.set_value();
+    other.join();
+}
+
+TEST(HttpPoolTest, ConcurrentLeasesGetDistinctHandles)
+{
+    PooledCurl a;
+    PooledCurl b;
+    EXPECT_NE(a.get(), b.get());
+}
+
+TEST(HttpPoolTest, ReleasedHandleDoesNotKeepOldOptions)
+{
+    TempDir temp_dir("spotify_dlp_http_pool_test");
+    std::filesystem::path path = temp_dir.path() / "body";
+    std::ofstream(path) << "pooled";
+
+    std::string first_body;
+    {
+        PooledCurl lease;
+        curl_easy_setopt(lease.get(), CURLOPT_URL, ("file://" + path.string()).c_str());
+        curl_easy_setopt(lease.get(), CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(lease.get(), CURLOPT_WRITEDATA, &first_body);
+        ASSERT_EQ(curl_easy_perform(lease.get()), CURLE_OK);
+    }
+    EXPECT_EQ(first_body, "pooled");
+
+    PooledCurl lease;
+    char *url = nullptr;
+    curl_easy_getinfo(lease.get(), CURLINFO_EFFECTIVE_URL, &url);
+    EXPECT_TRUE(url == nullptr || std::string(url).empty());
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/utils/lock_free_queue.h"
+
+TEST(LockFreeQueueTest, PopsInPushOrder)
+{
+    LockFreeQueue<std::string> queue(4);
+    EXPECT_TRUE(queue.try_push("a"));
+    EXPECT_TRUE(queue.try_push("b"));
+
+    EXPECT_EQ(queue.try_pop(), "a");
+    EXPECT_EQ(queue.try_pop(), "b");
+    EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(LockFreeQueueTest, DropsWhenFull)
+{
+    LockFreeQueue<int> queue(3);
+    ASSERT_EQ(queue.capacity(), 4);
+
+    for (int i = 0; i < 4; i++)
+        EXPECT_TRUE(queue.try_push(i));
+    EXPECT_FALSE(queue.try_push(4));
+
+    // a freed slot is reused
+    EXPECT_EQ(queue.try_pop(), 0);
+    EXPECT_TRUE(queue.try_push(5));
+    for (int expected : {1, 2, 3, 5})
+        EXPECT_EQ(queue.try_pop(), expected);
+}
+
+TEST(LockFreeQueueTest, ManyProducersOneConsumer)
+{
+    constexpr int PRODUCERS = 4;
+    constexpr int PER_PRODUCER = 20000;
+    LockFreeQueue<int> queue(64);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        producers.emplace_back([&queue, p]
+                               {
+            for (int i = 0; i < PER_PRODUCER; i++)
+            {
+                while (!queue.try_push(p * PER_PRODUCER + i))
+                    std::this_thread::yield();
+            } });
+    }
+
+    // every value arrives exactly once, and each producer's values in order
+    std::vector<int> last_seen(PRODUCERS, -1);
+    int received = 0;
+    while (received < PRODUCERS * PER_PRODUCER)
+    {
+        std::optional<int> value = queue.try_pop();
+        if (!value.has_value())
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        int producer = value.value() / PER_PRODUCER;
+        int sequence = value.value() % PER_PRODUCER;
+        EXPECT_EQ(sequence, last_seen[producer] + 1);
+        last_seen[producer] = sequence;
+        received++;
+    }
+
+    for (auto &producer : producers)
+        producer.join();
+    EXPECT_FALSE(queue.try_pop().has_value());
+}
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../src/utils/process_runner.h"
+
+TEST(ProcessRunnerTest, CapturesStdoutAndStderrSeparately)
+{
+    ProcessRunner runner({"/bin/sh", "-c", "echo out; echo err 1>&2; exit 3"});
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.exit_code, 3);
+    EXPECT_EQ(result.out, "out\n");
+    EXPECT_EQ(result.err, "err\n");
+}
+
+TEST(ProcessRunnerTest, RunsChildExactlyOnce)
+{
+    ProcessRunner runner({"/bin/sh", "-c", "echo run"});
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(result.out, "run\n");
+}
+
+TEST(ProcessRunnerTest, ArgumentsAreNotShellExpanded)
+{
+    ProcessRunner runner({"/bin/echo", "$HOME", "a b", "\"quoted\""});
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.out, "$HOME a b \"quoted\"\n");
+}
+
+TEST(ProcessRunnerTest, DrainsLargeOutputOnBothStreams)
+{
+    // enough output on both streams to fill a pipe buffer several times over
+    ProcessRunner runner({"/bin/sh", "-c", "i=0; while [ $i -lt 20000 ]; do echo stdout-line-$i; echo stderr-line-$i 1>&2; i=$((i+1)); done"});
+
+    size_t out_lines = 0;
+    size_t err_lines = 0;
+    runner.on_stdout_line([&](std::string_view)
+                          { out_lines++; });
+    runner.on_stderr_line([&](std::string_view)
+                          { err_lines++; });
+
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(out_lines, 20000);
+    EXPECT_EQ(err_lines, 20000);
+}
+
+TEST(ProcessRunnerTest, LineCallbackFlushesUnterminatedLine)
+{
+    ProcessRunner runner({"/usr/bin/printf", "first\nsecond"});
+
+    std::vector<std::string> lines;
+    runner.on_stdout_line([&](std::string_view line)
+                          { lines.emplace_back(line); });
+    runner.run();
+
+    ASSERT_EQ(lines.size(), 2);
+    EXPECT_EQ(lines[0], "first");
+    EXPECT_EQ(lines[1], "second");
+}
+
+TEST(ProcessRunnerTest, MissingProgramReportsNotFound)
+{
+    ProcessRunner runner({"invalid_command_that_doesnt_exist"});
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.exit_code, 127);
+    EXPECT_FALSE(result.err.empty());
+}
+
+TEST(ProcessRunnerTest, FeedsStdinAndClosesIt)
+{
+    ProcessRunner runner({"/bin/cat"});
+    runner.set_stdin("first\nsecond\n");
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(result.out, "first\nsecond\n");
+}
+
+TEST(ProcessRunnerTest, LargeStdinIsFedWhileOutputDrains)
+{
+    // far more than a pipe buffer in both directions, cat only reads more once its output is drained
+    std::string input;
+    for (int i = 0; i < 100000; i++)
+        input += "line-" + std::to_string(i) + "\n";
+
+    ProcessRunner runner({"/bin/cat"});
+    runner.set_stdin(input);
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(result.out, input);
+}
+
+TEST(ProcessRunnerTest, ChildIgnoringStdinDoesNotRaiseSigpipe)
+{
+    ProcessRunner runner({"/bin/sh", "-c", "exit 0"});
+    runner.set_stdin(std::string(1 << 20, 'x'));
+    ProcessResult result = runner.run();
+
+    EXPECT_EQ(result.exit_code, 0);
+}
+
+namespace
+{
+    // a killed orphan can linger as a zombie until its new parent reaps it, which still answers kill(pid, 0)
+    bool is_running(pid_t pid)
+    {
+        std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+        if (!stat.is_open())
+            return kill(pid, 0) == 0;
+
+        std::string contents((std::istreambuf_iterator<char>(stat)), std::istreambuf_iterator<char>());
+        size_t state = contents.rfind(')');
+        return state != std::string::npos && state + 2 < contents.size() && contents[state + 2] != 'Z';
+    }
+}
+
+TEST(ProcessRunnerTest, DeadlineStopsTheWholeProcessGroup)
+{
+    // the background sleep stands in for a helper like ffmpeg, it holds the output pipe open as well
+    ProcessRunner runner({"/bin/sh", "-c", "sleep 30 & echo $!; sleep 30"});
+    runner.set_deadline(Deadline::after(std::chrono::milliseconds(200)));
+
+    std::string helper_pid;
+    runner.on_stdout_line([&](std::string_view line)
+                          { helper_pid = std::string(line); });
+
+    auto start = std::chrono::steady_clock::now();
+    ProcessResult result = runner.run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_TRUE(result.deadline_exceeded);
+    EXPECT_EQ(result.exit_code, 128 + SIGTERM);
+    EXPECT_LT(elapsed, std::chrono::seconds(5));
+
+    ASSERT_FALSE(helper_pid.empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(is_running(std::stoi(helper_pid))) << "helper outlived the deadline";
+}
+
+TEST(ProcessRunnerTest, CancellationStopsTheChild)
+{
+    CancellationToken token;
+    ProcessRunner runner({"/bin/sh", "-c", "sleep 30"});
+    runner.set_deadline(Deadline(token));
+
+    std::thread canceller([token]
+                          {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        token.cancel(); });
+
+    auto start = std::chrono::steady_clock::now();
+    ProcessResult result = runner.run();
+    canceller.join();
+
+    EXPECT_TRUE(result.deadline_exceeded);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST(ProcessRunnerTest, ExpiredDeadlineDoesNotStartTheChild)
+{
+    CancellationToken token;
+    token.cancel();
+
+    ProcessRunner runner({"/bin/sh", "-c", "echo started"});
+    runner.set_deadline(Deadline(token));
+    ProcessResult result = runner.run();
+
+    EXPECT_TRUE(result.deadline_exceeded);
+    EXPECT_TRUE(result.out.empty());
+}
+
+TEST(ProcessRunnerTest, DeadlineLeavesFastChildAlone)
+{
+    ProcessRunner runner({"/bin/sh", "-c", "echo done"});
+    runner.set_deadline(Deadline::after(std::chrono::seconds(30)));
+    ProcessResult result = runner.run();
+
+    EXPECT_FALSE(result.deadline_exceeded);
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(result.out, "done\n");
+}
+
+TEST(ProcessRunnerTest, UnboundedDeadlineKeepsTheChildInOurGroup)
+{
+    // $$ is the shell, field 5 of its stat is its process group
+    ProcessRunner unbounded({"/bin/sh", "-c", "cut -d' ' -f5 /proc/$$/stat"});
+    unbounded.set_deadline(Deadline());
+    EXPECT_EQ(unbounded.run().out, std::to_string(getpgrp()) + "\n");
+
+    ProcessRunner bounded({"/bin/sh", "-c", "echo $$; cut -d' ' -f5 /proc/$$/stat"});
+    bounded.set_deadline(Deadline::after(std::chrono::seconds(30)));
+    std::vector<std::string> lines;
+    bounded.on_stdout_line([&](std::string_view line)
+                           { lines.emplace_back(line); });
+    bounded.run();
+    ASSERT_EQ(lines.size(), 2);
+    EXPECT_EQ(lines[0], lines[1]) << "the child should lead its own group";
+}
+
+TEST(ProcessRunnerTest, ForwardsTerminationToTheChildGroup)
+{
+    std::filesystem::path pid_file = std::filesystem::temp_directory_path() / "spotify_dlp_forwarded_helper.pid";
+    std::filesystem::remove(pid_file);
+
+    // SIGTERM is sent to us, not the child, while the child and its helper run in their own group. They inherit
+    // the death test's pipe, so EXPECT_EXIT only returns early when they went down with us.
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EXIT(
+        {
+            ProcessRunner runner({"/bin/sh", "-c", "sleep 30 & echo $!; sleep 30"});
+            runner.set_deadline(Deadline::after(std::chrono::seconds(30)));
+            runner.on_stdout_line([&](std::string_view line)
+                                  {
+                std::ofstream(pid_file) << line;
+                kill(getpid(), SIGTERM); });
+            runner.run();
+            exit(0);
+        },
+        testing::KilledBySignal(SIGTERM), "");
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+
+    std::ifstream in(pid_file);
+    pid_t helper_pid = 0;
+    ASSERT_TRUE(in >> helper_pid);
+    std::filesystem::remove(pid_file);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    bool orphaned = is_running(helper_pid);
+    if (orphaned)
+        kill(helper_pid, SIGKILL);
+    EXPECT_FALSE(orphaned) << "helper outlived the signal sent to its parent";
+}
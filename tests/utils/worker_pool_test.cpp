@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include "../src/utils/worker_pool.h"
+
+TEST(WorkerPoolTest, RunsEveryIndexExactlyOnce)
+{
+    std::vector<std::atomic<int>> hits(1000);
+    parallel_for(hits.size(), 8, [&](size_t index)
+                 { hits[index]++; });
+
+    for (const auto &hit : hits)
+    {
+        EXPECT_EQ(hit.load(), 1);
+    }
+}
+
+TEST(WorkerPoolTest, FailingTaskDoesNotStopOthers)
+{
+    std::atomic<int> completed{0};
+    EXPECT_THROW(parallel_for(20, 4, [&](size_t index)
+                              {
+        if (index == 3)
+            throw std::runtime_error("track failed");
+        completed++; }),
+                 std::runtime_error);
+
+    EXPECT_EQ(completed.load(), 19);
+}
+
+TEST(WorkerPoolTest, HandlesEmptyInput)
+{
+    bool called = false;
+    parallel_for(0, 4, [&](size_t)
+                 { called = true; });
+    EXPECT_FALSE(called);
+}
+
+TEST(WorkerPoolTest, PoolReturnsResultsThroughFutures)
+{
+    WorkerPool pool(3);
+    EXPECT_EQ(pool.size(), 3);
+
+    std::vector<std::future<size_t>> results;
+    for (size_t i = 0; i < 100; i++)
+    {
+        results.push_back(pool.submit([i]
+                                      { return i * i; }));
+    }
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        EXPECT_EQ(results[i].get(), i * i);
+    }
+}
+
+TEST(WorkerPoolTest, PoolPassesExceptionsToTheFuture)
+{
+    WorkerPool pool(2);
+    std::future<int> failed = pool.submit([]() -> int
+                                          { throw std::runtime_error("transcode failed"); });
+    std::future<int> fine = pool.submit([]
+                                        { return 7; });
+
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_EQ(fine.get(), 7);
+}
+
+TEST(WorkerPoolTest, PoolFinishesQueuedTasksBeforeShuttingDown)
+{
+    std::atomic<int> completed{0};
+    {
+        WorkerPool pool(1);
+        for (int i = 0; i < 50; i++)
+        {
+            pool.submit([&completed]
+                        { completed++; });
+        }
+    }
+    EXPECT_EQ(completed.load(), 50);
+}
+
+TEST(WorkerPoolTest, PoolDefaultsToHardwareThreads)
+{
+    WorkerPool pool(0);
+    EXPECT_EQ(pool.size(), std::max(1u, std::thread::hardware_concurrency()));
+}